@@ -0,0 +1,394 @@
+#ifndef RSTAN_ADAPTIVE_WARMUP_HPP
+#define RSTAN_ADAPTIVE_WARMUP_HPP
+
+#include <stan/callbacks/interrupt.hpp>
+#include <stan/callbacks/logger.hpp>
+#include <stan/callbacks/writer.hpp>
+#include <stan/io/var_context.hpp>
+#include <stan/mcmc/hmc/nuts/adapt_dense_e_nuts.hpp>
+#include <stan/mcmc/hmc/nuts/adapt_diag_e_nuts.hpp>
+#include <stan/mcmc/sample.hpp>
+#include <stan/mcmc/stepsize_adaptation.hpp>
+#include <stan/services/error_codes.hpp>
+#include <stan/services/util/create_rng.hpp>
+#include <stan/services/util/generate_transitions.hpp>
+#include <stan/services/util/initialize.hpp>
+#include <stan/services/util/mcmc_writer.hpp>
+#include <stan/services/util/read_dense_inv_metric.hpp>
+#include <stan/services/util/read_diag_inv_metric.hpp>
+#include <stan/services/util/validate_dense_inv_metric.hpp>
+#include <stan/services/util/validate_diag_inv_metric.hpp>
+#include <boost/random/mixmax.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace rstan {
+
+  namespace {
+    void report_warmup_progress(int m, int finish, int refresh,
+                                stan::callbacks::logger& logger) {
+      if (refresh <= 0 || !(m == 0 || m + 1 == finish || (m + 1) % refresh == 0))
+        return;
+      int it_print_width = std::ceil(std::log10(static_cast<double>(finish)));
+      std::stringstream message;
+      message << "Iteration: ";
+      message << std::setw(it_print_width) << m + 1 << " / " << finish;
+      message << " [" << std::setw(3)
+              << static_cast<int>((100.0 * (m + 1)) / finish) << "%] ";
+      message << " (Warmup)";
+      logger.info(message);
+    }
+
+    template <class Model, class RNG>
+    void read_inv_metric(stan::mcmc::adapt_diag_e_nuts<Model, RNG>& sampler,
+                         const stan::io::var_context& init_inv_metric,
+                         size_t num_params, stan::callbacks::logger& logger) {
+      Eigen::VectorXd inv_metric
+        = stan::services::util::read_diag_inv_metric(init_inv_metric,
+                                                     num_params, logger);
+      stan::services::util::validate_diag_inv_metric(inv_metric, logger);
+      sampler.set_metric(inv_metric);
+    }
+
+    template <class Model, class RNG>
+    void read_inv_metric(stan::mcmc::adapt_dense_e_nuts<Model, RNG>& sampler,
+                         const stan::io::var_context& init_inv_metric,
+                         size_t num_params, stan::callbacks::logger& logger) {
+      Eigen::MatrixXd inv_metric
+        = stan::services::util::read_dense_inv_metric(init_inv_metric,
+                                                      num_params, logger);
+      stan::services::util::validate_dense_inv_metric(inv_metric, logger);
+      sampler.set_metric(inv_metric);
+    }
+
+    template <class Sampler>
+    bool configure_adapt_sampler(Sampler& sampler,
+                                 const stan::io::var_context& init_inv_metric,
+                                 size_t num_params, double stepsize,
+                                 double stepsize_jitter, int max_depth,
+                                 double delta, double gamma, double kappa,
+                                 double t0, stan::callbacks::logger& logger) {
+      try {
+        read_inv_metric(sampler, init_inv_metric, num_params, logger);
+      } catch (const std::domain_error& e) {
+        return false;
+      }
+      sampler.set_nominal_stepsize(stepsize);
+      sampler.set_stepsize_jitter(stepsize_jitter);
+      sampler.set_max_depth(max_depth);
+
+      sampler.get_stepsize_adaptation().set_mu(std::log(10 * stepsize));
+      sampler.get_stepsize_adaptation().set_delta(delta);
+      sampler.get_stepsize_adaptation().set_gamma(gamma);
+      sampler.get_stepsize_adaptation().set_kappa(kappa);
+      sampler.get_stepsize_adaptation().set_t0(t0);
+      return true;
+    }
+  }
+
+  /**
+   * A version of stan::services::util::run_adaptive_sampler that can end
+   * warmup before <code>num_warmup</code> iterations.
+   *
+   * Whenever an adaptation window closes (which is when the sampler
+   * updates its metric), the new metric is compared to the one of the
+   * previous window and the adapted step sizes of the last
+   * <code>term_buffer</code> iterations are compared to each other. If
+   * the relative change of the metric (in the Frobenius norm) and the
+   * relative range of the step sizes are both below <code>tol</code>,
+   * the metric is kept as it is and warmup ends with a terminal buffer
+   * in which only the step size is adapted, as at the end of the usual
+   * windowed adaptation.
+   *
+   * The adapted step size is the dual averaging estimate exp(x_bar)
+   * that the step size adaptation settles on when it completes, not
+   * the nominal step size of each iteration, which is its noisy latest
+   * iterate.
+   *
+   * The warmup draws are not saved, as their number is not known in
+   * advance. The number of warmup iterations done is written to the
+   * sample writer after the adaptation info.
+   */
+  template <class Sampler, class Model, class RNG>
+  void run_adaptive_sampler_early_stop(Sampler& sampler, Model& model,
+                                       std::vector<double>& cont_vector,
+                                       int num_warmup, int num_samples,
+                                       int num_thin, int refresh,
+                                       unsigned int term_buffer, double tol,
+                                       RNG& rng,
+                                       stan::callbacks::interrupt& interrupt,
+                                       stan::callbacks::logger& logger,
+                                       stan::callbacks::writer& sample_writer,
+                                       stan::callbacks::writer& diagnostic_writer) {
+    typedef typename std::decay<decltype(sampler.z().inv_e_metric_)>::type
+      metric_t;
+    Eigen::Map<Eigen::VectorXd> cont_params(cont_vector.data(),
+                                            cont_vector.size());
+    sampler.engage_adaptation();
+    try {
+      sampler.z().q = cont_params;
+      sampler.init_stepsize(logger);
+    } catch (const std::exception& e) {
+      logger.info("Exception initializing step size.");
+      logger.info(e.what());
+      return;
+    }
+
+    stan::services::util::mcmc_writer writer(sample_writer, diagnostic_writer,
+                                             logger);
+    stan::mcmc::sample s(cont_params, 0, 0);
+    writer.write_sample_names(s, sampler, model);
+    writer.write_diagnostic_names(s, sampler, model);
+
+    auto start_warm = std::chrono::steady_clock::now();
+    metric_t metric = sampler.z().inv_e_metric_;
+    metric_t last_window_metric;
+    std::deque<double> stepsizes;
+    const size_t num_stepsizes = std::max(term_buffer, 10U);
+    int m = 0;
+    bool ended_early = false;
+    for (; m < num_warmup; ++m) {
+      interrupt();
+      report_warmup_progress(m, num_warmup + num_samples, refresh, logger);
+      s = sampler.transition(s, logger);
+      if ((sampler.z().inv_e_metric_.array() != metric.array()).any()) {
+        metric = sampler.z().inv_e_metric_;
+        if (last_window_metric.size() > 0 && stepsizes.size() == num_stepsizes) {
+          double metric_change = (metric - last_window_metric).norm()
+                                 / last_window_metric.norm();
+          double lo = *std::min_element(stepsizes.begin(), stepsizes.end());
+          double hi = *std::max_element(stepsizes.begin(), stepsizes.end());
+          double mean = 0;
+          for (size_t i = 0; i < stepsizes.size(); i++) mean += stepsizes[i];
+          mean /= stepsizes.size();
+          ended_early = metric_change < tol && (hi - lo) / mean < tol;
+        }
+        last_window_metric = metric;
+        stepsizes.clear();
+        if (ended_early) break;
+      } else {
+        // x_bar is not exposed; completing a copy of the adaptation
+        // gives exp(x_bar) without touching the sampler's
+        stan::mcmc::stepsize_adaptation adaptation
+          = sampler.get_stepsize_adaptation();
+        double adapted_stepsize;
+        adaptation.complete_adaptation(adapted_stepsize);
+        stepsizes.push_back(adapted_stepsize);
+        if (stepsizes.size() > num_stepsizes) stepsizes.pop_front();
+      }
+    }
+
+    if (ended_early) {
+      // The step size has been restarted for the next window. Adapt it
+      // for a terminal buffer with the metric held fixed: adaptation is
+      // disengaged (so that no more windows close) and the step size is
+      // learned here as adapt_*_nuts::transition would.
+      double epsilon = sampler.get_nominal_stepsize();
+      sampler.disengage_adaptation();
+      sampler.set_nominal_stepsize(epsilon);
+      sampler.get_stepsize_adaptation().restart();
+      int end = std::min(num_warmup, m + 1 + static_cast<int>(term_buffer));
+      for (++m; m < end; ++m) {
+        interrupt();
+        report_warmup_progress(m, num_warmup + num_samples, refresh, logger);
+        s = sampler.transition(s, logger);
+        sampler.get_stepsize_adaptation().learn_stepsize(epsilon,
+                                                         s.accept_stat());
+        sampler.set_nominal_stepsize(epsilon);
+      }
+      sampler.get_stepsize_adaptation().complete_adaptation(epsilon);
+      sampler.set_nominal_stepsize(epsilon);
+    } else {
+      sampler.disengage_adaptation();
+    }
+    auto end_warm = std::chrono::steady_clock::now();
+    double warm_delta_t = std::chrono::duration_cast<std::chrono::milliseconds>(
+                            end_warm - start_warm).count() / 1000.0;
+    writer.write_adapt_finish(sampler);
+    sampler.write_sampler_state(sample_writer);
+    std::stringstream msg;
+    msg << "Warmup iterations = " << m;
+    if (ended_early) msg << " (ended early out of " << num_warmup << ")";
+    sample_writer(msg.str());
+
+    auto start_sample = std::chrono::steady_clock::now();
+    stan::services::util::generate_transitions(sampler, num_samples, m,
+                                               m + num_samples, num_thin,
+                                               refresh, true, false, writer,
+                                               s, model, rng, interrupt,
+                                               logger);
+    auto end_sample = std::chrono::steady_clock::now();
+    double sample_delta_t = std::chrono::duration_cast<std::chrono::milliseconds>(
+                              end_sample - start_sample).count() / 1000.0;
+    writer.write_timing(warm_delta_t, sample_delta_t);
+  }
+
+  /**
+   * hmc_nuts_diag_e_adapt and hmc_nuts_dense_e_adapt of
+   * stan::services::sample with run_adaptive_sampler_early_stop in place
+   * of run_adaptive_sampler. <code>Sampler</code> is
+   * stan::mcmc::adapt_diag_e_nuts or stan::mcmc::adapt_dense_e_nuts.
+   */
+  template <template <class, class> class Sampler, class Model>
+  int hmc_nuts_adapt_early_stop(Model& model, const stan::io::var_context& init,
+                                const stan::io::var_context& init_inv_metric,
+                                unsigned int random_seed, unsigned int chain,
+                                double init_radius, int num_warmup,
+                                int num_samples, int num_thin, int refresh,
+                                double stepsize, double stepsize_jitter,
+                                int max_depth, double delta, double gamma,
+                                double kappa, double t0,
+                                unsigned int init_buffer,
+                                unsigned int term_buffer, unsigned int window,
+                                double tol,
+                                stan::callbacks::interrupt& interrupt,
+                                stan::callbacks::logger& logger,
+                                stan::callbacks::writer& init_writer,
+                                stan::callbacks::writer& sample_writer,
+                                stan::callbacks::writer& diagnostic_writer) {
+    boost::random::mixmax rng = stan::services::util::create_rng(random_seed,
+                                                                 chain);
+    std::vector<double> cont_vector
+      = stan::services::util::initialize(model, init, rng, init_radius, true,
+                                         logger, init_writer);
+
+    Sampler<Model, boost::random::mixmax> sampler(model, rng);
+    if (!configure_adapt_sampler(sampler, init_inv_metric,
+                                 model.num_params_r(), stepsize,
+                                 stepsize_jitter, max_depth, delta, gamma,
+                                 kappa, t0, logger))
+      return stan::services::error_codes::CONFIG;
+    sampler.set_window_params(num_warmup, init_buffer, term_buffer, window,
+                              logger);
+
+    run_adaptive_sampler_early_stop(sampler, model, cont_vector, num_warmup,
+                                    num_samples, num_thin, refresh,
+                                    term_buffer, tol, rng, interrupt, logger,
+                                    sample_writer, diagnostic_writer);
+    return stan::services::error_codes::OK;
+  }
+
+  /**
+   * A version of stan::services::util::run_adaptive_sampler that adapts
+   * only the step size in warmup and keeps the metric it is given, as
+   * when warm starting from a cached adaptation (see adapt_cache.R).
+   *
+   * Windowed adaptation cannot be configured to never update the
+   * metric (a window without draws gives a degenerate estimate), so
+   * the sampler's adaptation stays disengaged and the step size is
+   * learned here as adapt_*_nuts::transition would.
+   */
+  template <class Sampler, class Model, class RNG>
+  void run_stepsize_adaptive_sampler(Sampler& sampler, Model& model,
+                                     std::vector<double>& cont_vector,
+                                     int num_warmup, int num_samples,
+                                     int num_thin, int refresh,
+                                     bool save_warmup, RNG& rng,
+                                     stan::callbacks::interrupt& interrupt,
+                                     stan::callbacks::logger& logger,
+                                     stan::callbacks::writer& sample_writer,
+                                     stan::callbacks::writer& diagnostic_writer) {
+    Eigen::Map<Eigen::VectorXd> cont_params(cont_vector.data(),
+                                            cont_vector.size());
+    sampler.disengage_adaptation();
+    try {
+      sampler.z().q = cont_params;
+      sampler.init_stepsize(logger);
+    } catch (const std::exception& e) {
+      logger.info("Exception initializing step size.");
+      logger.info(e.what());
+      return;
+    }
+
+    stan::services::util::mcmc_writer writer(sample_writer, diagnostic_writer,
+                                             logger);
+    stan::mcmc::sample s(cont_params, 0, 0);
+    writer.write_sample_names(s, sampler, model);
+    writer.write_diagnostic_names(s, sampler, model);
+
+    auto start_warm = std::chrono::steady_clock::now();
+    double epsilon = sampler.get_nominal_stepsize();
+    sampler.get_stepsize_adaptation().restart();
+    for (int m = 0; m < num_warmup; ++m) {
+      interrupt();
+      report_warmup_progress(m, num_warmup + num_samples, refresh, logger);
+      s = sampler.transition(s, logger);
+      sampler.get_stepsize_adaptation().learn_stepsize(epsilon,
+                                                       s.accept_stat());
+      sampler.set_nominal_stepsize(epsilon);
+      if (save_warmup && m % num_thin == 0) {
+        writer.write_sample_params(rng, s, sampler, model);
+        writer.write_diagnostic_params(s, sampler);
+      }
+    }
+    if (num_warmup > 0) {
+      sampler.get_stepsize_adaptation().complete_adaptation(epsilon);
+      sampler.set_nominal_stepsize(epsilon);
+    }
+    auto end_warm = std::chrono::steady_clock::now();
+    double warm_delta_t = std::chrono::duration_cast<std::chrono::milliseconds>(
+                            end_warm - start_warm).count() / 1000.0;
+    writer.write_adapt_finish(sampler);
+    sampler.write_sampler_state(sample_writer);
+
+    auto start_sample = std::chrono::steady_clock::now();
+    stan::services::util::generate_transitions(sampler, num_samples,
+                                               num_warmup,
+                                               num_warmup + num_samples,
+                                               num_thin, refresh, true, false,
+                                               writer, s, model, rng,
+                                               interrupt, logger);
+    auto end_sample = std::chrono::steady_clock::now();
+    double sample_delta_t = std::chrono::duration_cast<std::chrono::milliseconds>(
+                              end_sample - start_sample).count() / 1000.0;
+    writer.write_timing(warm_delta_t, sample_delta_t);
+  }
+
+  /**
+   * hmc_nuts_diag_e_adapt and hmc_nuts_dense_e_adapt of
+   * stan::services::sample with run_stepsize_adaptive_sampler in place
+   * of run_adaptive_sampler, for control$adapt_metric = FALSE.
+   */
+  template <template <class, class> class Sampler, class Model>
+  int hmc_nuts_stepsize_adapt(Model& model, const stan::io::var_context& init,
+                              const stan::io::var_context& init_inv_metric,
+                              unsigned int random_seed, unsigned int chain,
+                              double init_radius, int num_warmup,
+                              int num_samples, int num_thin, bool save_warmup,
+                              int refresh, double stepsize,
+                              double stepsize_jitter, int max_depth,
+                              double delta, double gamma, double kappa,
+                              double t0, stan::callbacks::interrupt& interrupt,
+                              stan::callbacks::logger& logger,
+                              stan::callbacks::writer& init_writer,
+                              stan::callbacks::writer& sample_writer,
+                              stan::callbacks::writer& diagnostic_writer) {
+    boost::random::mixmax rng = stan::services::util::create_rng(random_seed,
+                                                                 chain);
+    std::vector<double> cont_vector
+      = stan::services::util::initialize(model, init, rng, init_radius, true,
+                                         logger, init_writer);
+
+    Sampler<Model, boost::random::mixmax> sampler(model, rng);
+    if (!configure_adapt_sampler(sampler, init_inv_metric,
+                                 model.num_params_r(), stepsize,
+                                 stepsize_jitter, max_depth, delta, gamma,
+                                 kappa, t0, logger))
+      return stan::services::error_codes::CONFIG;
+
+    run_stepsize_adaptive_sampler(sampler, model, cont_vector, num_warmup,
+                                  num_samples, num_thin, refresh, save_warmup,
+                                  rng, interrupt, logger, sample_writer,
+                                  diagnostic_writer);
+    return stan::services::error_codes::OK;
+  }
+
+}
+#endif
@@ -0,0 +1,102 @@
+#ifndef RSTAN_CONSTRAIN_JACOBIAN_HPP
+#define RSTAN_CONSTRAIN_JACOBIAN_HPP
+
+#include <stan/math/prim/fun/Eigen.hpp>
+#include <stan/services/util/create_rng.hpp>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace rstan {
+
+  /**
+   * The Jacobian of the map from the unconstrained parameters to the
+   * parameters (and, if <code>include_tparams</code>, the transformed
+   * parameters) written by <code>write_array</code>, at every row of
+   * <code>upars</code>. The generated code of write_array is not
+   * templated on the scalar type, so the derivatives are taken by the
+   * sixth order central differences of
+   * stan::math::finite_diff_gradient, with the same step size.
+   *
+   * The (draw, unconstrained parameter) pairs are split over
+   * <code>n_threads</code> threads, so that a single draw with many
+   * parameters is also computed in parallel. Nothing in here touches R.
+   *
+   * @param jacobian[out] A matrix for each draw, with a row for each
+   *   constrained value and a column for each unconstrained parameter;
+   *   filled with NaN for the draws at which write_array threw
+   * @param errors[out] The error messages, empty if a draw succeeded
+   */
+  template <class Model>
+  void parallel_constrain_jacobian(const Model& model,
+                                   const Eigen::Ref<const Eigen::MatrixXd>& upars,
+                                   bool include_tparams, int n_threads,
+                                   std::vector<Eigen::MatrixXd>& jacobian,
+                                   std::vector<std::string>& errors) {
+    std::vector<std::string> names;
+    model.constrained_param_names(names, include_tparams, false);
+    const size_t P = names.size();
+    const size_t K = upars.cols();
+    const size_t N = upars.rows();
+    jacobian.assign(N, Eigen::MatrixXd::Zero(P, K));
+    errors.assign(N, std::string());
+    if (n_threads < 1) n_threads = 1;
+
+    static const double epsilon = 1e-3;
+    static const int order = 6;
+    static const double perturbations[order]
+      = {-3, -2, -1, 1, 2, 3};
+    static const double coefficients[order]
+      = {-1 / 60.0, 3 / 20.0, -3 / 4.0, 3 / 4.0, -3 / 20.0, 1 / 60.0};
+
+    // several pairs may fail for the same draw, so the messages are kept
+    // for each pair and the first one of each draw is reported
+    std::vector<std::string> pair_errors(N * K);
+    tbb::task_arena arena(n_threads);
+    arena.execute([&] {
+      tbb::parallel_for(tbb::blocked_range<size_t>(0, N * K),
+                        [&](const tbb::blocked_range<size_t>& r) {
+        boost::random::mixmax rng = stan::services::util::create_rng(0, 1);
+        std::vector<double> params_r(K);
+        std::vector<int> params_i(model.num_params_i(), 0);
+        std::vector<double> vars;
+        for (size_t ik = r.begin(); ik != r.end(); ++ik) {
+          const size_t i = ik / K;
+          const size_t k = ik % K;
+          std::stringstream msg;
+          try {
+            for (size_t j = 0; j < K; j++) params_r[j] = upars(i, j);
+            const double h = epsilon * std::max(1.0, std::fabs(upars(i, k)));
+            for (int s = 0; s < order; s++) {
+              params_r[k] = upars(i, k) + perturbations[s] * h;
+              model.write_array(rng, params_r, params_i, vars,
+                                include_tparams, false, &msg);
+              for (size_t p = 0; p < P; p++)
+                jacobian[i](p, k) += coefficients[s] * vars[p];
+            }
+            for (size_t p = 0; p < P; p++) jacobian[i](p, k) /= h;
+          } catch (const std::exception& e) {
+            pair_errors[ik] = e.what();
+          }
+        }
+      });
+    });
+
+    for (size_t i = 0; i < N; i++) {
+      for (size_t k = 0; k < K; k++) {
+        if (pair_errors[i * K + k].empty()) continue;
+        errors[i] = pair_errors[i * K + k];
+        jacobian[i].setConstant(std::numeric_limits<double>::quiet_NaN());
+        break;
+      }
+    }
+  }
+
+}
+#endif
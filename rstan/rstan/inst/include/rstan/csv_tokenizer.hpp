@@ -0,0 +1,180 @@
+#ifndef RSTAN_CSV_TOKENIZER_HPP
+#define RSTAN_CSV_TOKENIZER_HPP
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace rstan {
+
+  /**
+   * The contents of a file, read only: mapped into memory where mmap
+   * is available and read into a buffer otherwise.
+   */
+  class mapped_file {
+  private:
+    const char* data_;
+    size_t size_;
+    bool mapped_;
+    std::vector<char> buffer_;
+
+    mapped_file(const mapped_file&);
+    mapped_file& operator=(const mapped_file&);
+
+  public:
+    explicit mapped_file(const std::string& path)
+      : data_(0), size_(0), mapped_(false) {
+#ifndef _WIN32
+      int fd = open(path.c_str(), O_RDONLY);
+      if (fd < 0)
+        throw std::runtime_error("failed to open file '" + path + "'");
+      struct stat st;
+      if (fstat(fd, &st) != 0) {
+        close(fd);
+        throw std::runtime_error("failed to open file '" + path + "'");
+      }
+      size_ = st.st_size;
+      if (size_ > 0) {
+        void* p = mmap(NULL, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+          data_ = static_cast<const char*>(p);
+          mapped_ = true;
+        }
+      }
+      close(fd);
+      if (mapped_ || size_ == 0) return;
+#endif
+      std::ifstream in(path.c_str(), std::ios::binary);
+      if (!in)
+        throw std::runtime_error("failed to open file '" + path + "'");
+      buffer_.assign(std::istreambuf_iterator<char>(in),
+                     std::istreambuf_iterator<char>());
+      data_ = buffer_.empty() ? 0 : &buffer_[0];
+      size_ = buffer_.size();
+    }
+
+    ~mapped_file() {
+#ifndef _WIN32
+      if (mapped_) munmap(const_cast<char*>(data_), size_);
+#endif
+    }
+
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+  };
+
+  /**
+   * The offsets at which the lines of data[0, size) start, found by
+   * n_threads threads each scanning a block of the data for newlines.
+   */
+  inline std::vector<size_t> line_starts(const char* data, size_t size,
+                                         int n_threads) {
+    std::vector<size_t> starts;
+    if (size == 0) return starts;
+    if (n_threads < 1) n_threads = 1;
+    const size_t n_blocks = 4 * static_cast<size_t>(n_threads);
+    const size_t block = size / n_blocks + 1;
+    std::vector<std::vector<size_t> > found(n_blocks);
+    tbb::task_arena arena(n_threads);
+    arena.execute([&] {
+      tbb::parallel_for(tbb::blocked_range<size_t>(0, n_blocks),
+                        [&](const tbb::blocked_range<size_t>& r) {
+        for (size_t b = r.begin(); b != r.end(); ++b) {
+          const char* p = data + std::min(size, b * block);
+          const char* end = data + std::min(size, (b + 1) * block);
+          while (p < end) {
+            const char* nl = static_cast<const char*>(
+              std::memchr(p, '\n', end - p));
+            if (!nl) break;
+            if (nl + 1 < data + size) found[b].push_back(nl + 1 - data);
+            p = nl + 1;
+          }
+        }
+      });
+    });
+    starts.push_back(0);
+    for (size_t b = 0; b < n_blocks; ++b)
+      starts.insert(starts.end(), found[b].begin(), found[b].end());
+    return starts;
+  }
+
+  /**
+   * The end of the line starting at <code>starts[i]</code>, without
+   * its newline (or carriage return and newline).
+   */
+  inline const char* line_end(const char* data, size_t size,
+                              const std::vector<size_t>& starts, size_t i) {
+    const char* end = data + (i + 1 < starts.size() ? starts[i + 1] : size);
+    const char* begin = data + starts[i];
+    if (end > begin && end[-1] == '\n') --end;
+    if (end > begin && end[-1] == '\r') --end;
+    return end;
+  }
+
+  /**
+   * Split [begin, end) at commas into at most <code>max</code> doubles
+   * stored in out. Return the number of fields, which is also counted
+   * past max, or -1 if a field is not a number.
+   */
+  inline long parse_csv_doubles(const char* begin, const char* end,
+                                double* out, size_t max) {
+    long n = 0;
+    const char* p = begin;
+    for (;;) {
+      const char* comma = static_cast<const char*>(
+        std::memchr(p, ',', end - p));
+      const char* field_end = comma ? comma : end;
+      if (static_cast<size_t>(n) < max) {
+        // strtod needs a terminated string, and the mapped file is not
+        char buf[64];
+        size_t len = field_end - p;
+        if (len == 0 || len >= sizeof(buf)) return -1;
+        std::memcpy(buf, p, len);
+        buf[len] = '\0';
+        char* parsed_end;
+        out[n] = std::strtod(buf, &parsed_end);
+        while (*parsed_end == ' ') ++parsed_end;
+        if (parsed_end == buf || *parsed_end != '\0') return -1;
+      }
+      ++n;
+      if (!comma) break;
+      p = comma + 1;
+    }
+    return n;
+  }
+
+  /**
+   * Split a header line at commas.
+   */
+  inline std::vector<std::string> split_csv_names(const char* begin,
+                                                  const char* end) {
+    std::vector<std::string> names;
+    const char* p = begin;
+    for (;;) {
+      const char* comma = static_cast<const char*>(
+        std::memchr(p, ',', end - p));
+      const char* field_end = comma ? comma : end;
+      names.push_back(std::string(p, field_end));
+      if (!comma) break;
+      p = comma + 1;
+    }
+    return names;
+  }
+
+}
+#endif
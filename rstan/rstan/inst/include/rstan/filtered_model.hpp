@@ -0,0 +1,221 @@
+#ifndef RSTAN_FILTERED_MODEL_HPP
+#define RSTAN_FILTERED_MODEL_HPP
+
+#include <stan/math/prim/fun/Eigen.hpp>
+#include <boost/random/mixmax.hpp>
+#include <limits>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace rstan {
+
+  /**
+   * A thin wrapper around a model that forwards everything to the
+   * wrapped model except <code>write_array</code>, for which the
+   * transformed parameters and/or generated quantities can be switched
+   * off. The services call <code>write_array</code> with both flags on
+   * for every saved draw; handing them this wrapper instead keeps them
+   * from computing blocks whose values are going to be discarded.
+   *
+   * The output of <code>write_array</code> keeps the layout of the full
+   * model (parameters, transformed parameters, generated quantities),
+   * with the blocks not computed filled with NaN, so the writers see the
+   * same number of columns as for the unfiltered model. Blocks can only
+   * be switched off as a whole; the generated models have no way to
+   * compute part of a block.
+   *
+   * Generated quantities may call <code>_rng</code> functions, so
+   * skipping them would change how far the sampler's PRNG advances and
+   * with it the parameter draws for a given seed. With
+   * <code>use_gq_stream</code>, <code>write_array</code> draws from a PRNG
+   * of its own instead, and the parameter draws do not depend on which
+   * blocks are computed.
+   *
+   * @tparam Model The model type, either a generated model or
+   *  stan::model::model_base.
+   */
+  template <class Model>
+  class filtered_model {
+  private:
+    const Model& model_;
+    bool include_tparams_;
+    bool include_gqs_;
+    size_t num_params_;
+    size_t num_tparams_;
+    size_t num_gqs_;
+    std::unique_ptr<boost::random::mixmax> gq_rng_;
+
+    template <class Vec>
+    void pad(Vec& vars, bool include_tparams, bool include_gqs) const {
+      size_t N = num_params_ + num_tparams_ + num_gqs_;
+      if (static_cast<size_t>(vars.size()) == N)
+        return;
+      Vec full(N);
+      for (size_t n = 0; n < N; n++)
+        full[n] = std::numeric_limits<double>::quiet_NaN();
+      size_t n_head = num_params_ + (include_tparams ? num_tparams_ : 0);
+      for (size_t n = 0; n < n_head && n < static_cast<size_t>(vars.size()); n++)
+        full[n] = vars[n];
+      if (include_gqs) {
+        for (size_t n = 0; n < num_gqs_ && n_head + n < static_cast<size_t>(vars.size()); n++)
+          full[num_params_ + num_tparams_ + n] = vars[n_head + n];
+      }
+      vars = full;
+    }
+
+    void count_params() {
+      std::vector<std::string> names;
+      model_.constrained_param_names(names, false, false);
+      num_params_ = names.size();
+      model_.constrained_param_names(names, true, false);
+      num_tparams_ = names.size() - num_params_;
+      model_.constrained_param_names(names, true, true);
+      num_gqs_ = names.size() - num_params_ - num_tparams_;
+    }
+
+  public:
+    filtered_model(const Model& model, bool include_tparams, bool include_gqs)
+      : model_(model), include_tparams_(include_tparams),
+        include_gqs_(include_gqs) {
+      count_params();
+    }
+
+    /**
+     * Only compute the blocks that contain at least one of the
+     * parameters of interest.
+     *
+     * @param model The model
+     * @param qoi_idx The indexes of the parameters of interest among all
+     *  the constrained parameters, as kept by stan_fit; lp__ is marked by
+     *  an index past the end and ignored
+     * @param include_gqs Set to false to skip the generated quantities
+     *  regardless of <code>qoi_idx</code>
+     */
+    filtered_model(const Model& model, const std::vector<size_t>& qoi_idx,
+                   bool include_gqs = true)
+      : model_(model), include_tparams_(false), include_gqs_(false) {
+      count_params();
+      size_t tparams_end = num_params_ + num_tparams_;
+      size_t gqs_end = tparams_end + num_gqs_;
+      for (size_t n = 0; n < qoi_idx.size(); n++) {
+        if (qoi_idx[n] >= num_params_ && qoi_idx[n] < tparams_end)
+          include_tparams_ = true;
+        else if (qoi_idx[n] >= tparams_end && qoi_idx[n] < gqs_end)
+          include_gqs_ = include_gqs;
+      }
+    }
+
+    /**
+     * Draw the generated quantities from stream 4 of
+     * <code>(seed, chain)</code> rather than from the PRNG the services
+     * pass to <code>write_array</code>, which is the sampler's.
+     */
+    void use_gq_stream(unsigned int seed, unsigned int chain) {
+      gq_rng_.reset(new boost::random::mixmax(seed, chain, 0, 4));
+    }
+
+    const Model& model() const {
+      return model_;
+    }
+
+    bool include_tparams() const {
+      return include_tparams_;
+    }
+
+    bool include_gqs() const {
+      return include_gqs_;
+    }
+
+    std::string model_name() const {
+      return model_.model_name();
+    }
+
+    size_t num_params_r() const {
+      return model_.num_params_r();
+    }
+
+    size_t num_params_i() const {
+      return model_.num_params_i();
+    }
+
+    template <typename... Args>
+    void get_param_names(Args&&... args) const {
+      model_.get_param_names(std::forward<Args>(args)...);
+    }
+
+    template <typename... Args>
+    void get_dims(Args&&... args) const {
+      model_.get_dims(std::forward<Args>(args)...);
+    }
+
+    template <typename... Args>
+    void constrained_param_names(Args&&... args) const {
+      model_.constrained_param_names(std::forward<Args>(args)...);
+    }
+
+    template <typename... Args>
+    void unconstrained_param_names(Args&&... args) const {
+      model_.unconstrained_param_names(std::forward<Args>(args)...);
+    }
+
+    template <typename... Args>
+    void transform_inits(Args&&... args) const {
+      model_.transform_inits(std::forward<Args>(args)...);
+    }
+
+    template <typename... Args>
+    void unconstrain_array(Args&&... args) const {
+      model_.unconstrain_array(std::forward<Args>(args)...);
+    }
+
+    template <bool propto, bool jacobian, typename T>
+    T log_prob(Eigen::Matrix<T, Eigen::Dynamic, 1>& params_r,
+               std::ostream* msgs = 0) const {
+      return model_.template log_prob<propto, jacobian>(params_r, msgs);
+    }
+
+    template <bool propto, bool jacobian, typename T>
+    T log_prob(std::vector<T>& params_r, std::vector<int>& params_i,
+               std::ostream* msgs = 0) const {
+      return model_.template log_prob<propto, jacobian>(params_r, params_i,
+                                                        msgs);
+    }
+
+    template <typename RNG>
+    void write_array(RNG& rng, Eigen::VectorXd& params_r,
+                     Eigen::VectorXd& vars,
+                     bool include_tparams = true, bool include_gqs = true,
+                     std::ostream* msgs = 0) const {
+      include_tparams = include_tparams && include_tparams_;
+      include_gqs = include_gqs && include_gqs_;
+      if (gq_rng_)
+        model_.write_array(*gq_rng_, params_r, vars, include_tparams,
+                           include_gqs, msgs);
+      else
+        model_.write_array(rng, params_r, vars, include_tparams, include_gqs,
+                           msgs);
+      pad(vars, include_tparams, include_gqs);
+    }
+
+    template <typename RNG>
+    void write_array(RNG& rng, std::vector<double>& params_r,
+                     std::vector<int>& params_i, std::vector<double>& vars,
+                     bool include_tparams = true, bool include_gqs = true,
+                     std::ostream* msgs = 0) const {
+      include_tparams = include_tparams && include_tparams_;
+      include_gqs = include_gqs && include_gqs_;
+      if (gq_rng_)
+        model_.write_array(*gq_rng_, params_r, params_i, vars, include_tparams,
+                           include_gqs, msgs);
+      else
+        model_.write_array(rng, params_r, params_i, vars, include_tparams,
+                           include_gqs, msgs);
+      pad(vars, include_tparams, include_gqs);
+    }
+  };
+
+}
+#endif
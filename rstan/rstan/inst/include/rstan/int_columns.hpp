@@ -0,0 +1,165 @@
+#ifndef RSTAN_INT_COLUMNS_HPP
+#define RSTAN_INT_COLUMNS_HPP
+
+#include <cctype>
+#include <cstddef>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace rstan {
+
+  namespace {
+    /**
+     * Just enough of JSON to read what the models generated by stanc
+     * return from get_constrained_sizedtypes(): objects, arrays and
+     * strings are kept, other values only skipped.
+     */
+    struct sizedtypes_json {
+      enum kind_t { OBJECT, ARRAY, STRING, OTHER };
+      kind_t kind;
+      std::string str;
+      std::vector<std::string> keys;
+      std::vector<sizedtypes_json> values;
+
+      const sizedtypes_json* member(const std::string& key) const {
+        for (size_t i = 0; i < keys.size(); ++i)
+          if (keys[i] == key) return &values[i];
+        return 0;
+      }
+    };
+
+    void skip_json_ws(const std::string& s, size_t& i) {
+      while (i < s.size() && std::isspace(static_cast<unsigned char>(s[i])))
+        ++i;
+    }
+
+    void expect_json_char(const std::string& s, size_t& i, char c) {
+      skip_json_ws(s, i);
+      if (i >= s.size() || s[i] != c)
+        throw std::invalid_argument(std::string("expected '") + c + "'");
+      ++i;
+    }
+
+    std::string parse_json_string(const std::string& s, size_t& i) {
+      expect_json_char(s, i, '"');
+      std::string x;
+      while (i < s.size() && s[i] != '"') {
+        if (s[i] == '\\' && i + 1 < s.size()) ++i;
+        x += s[i++];
+      }
+      expect_json_char(s, i, '"');
+      return x;
+    }
+
+    void parse_json(const std::string& s, size_t& i, sizedtypes_json& x) {
+      skip_json_ws(s, i);
+      if (i >= s.size())
+        throw std::invalid_argument("unexpected end of JSON");
+      if (s[i] == '{') {
+        x.kind = sizedtypes_json::OBJECT;
+        ++i;
+        skip_json_ws(s, i);
+        if (i < s.size() && s[i] == '}') {
+          ++i;
+          return;
+        }
+        for (;;) {
+          x.keys.push_back(parse_json_string(s, i));
+          expect_json_char(s, i, ':');
+          x.values.push_back(sizedtypes_json());
+          parse_json(s, i, x.values.back());
+          skip_json_ws(s, i);
+          if (i >= s.size() || s[i] != ',') break;
+          ++i;
+        }
+        expect_json_char(s, i, '}');
+      } else if (s[i] == '[') {
+        x.kind = sizedtypes_json::ARRAY;
+        ++i;
+        skip_json_ws(s, i);
+        if (i < s.size() && s[i] == ']') {
+          ++i;
+          return;
+        }
+        for (;;) {
+          x.values.push_back(sizedtypes_json());
+          parse_json(s, i, x.values.back());
+          skip_json_ws(s, i);
+          if (i >= s.size() || s[i] != ',') break;
+          ++i;
+        }
+        expect_json_char(s, i, ']');
+      } else if (s[i] == '"') {
+        x.kind = sizedtypes_json::STRING;
+        x.str = parse_json_string(s, i);
+      } else {
+        x.kind = sizedtypes_json::OTHER;
+        while (i < s.size() && s[i] != ',' && s[i] != '}' && s[i] != ']')
+          ++i;
+      }
+    }
+
+    /**
+     * True for int and for (nested) arrays of int; tuples, even of
+     * ints, are left as reals.
+     */
+    bool sizedtype_is_int(const sizedtypes_json* type) {
+      while (type && type->kind == sizedtypes_json::OBJECT) {
+        const sizedtypes_json* name = type->member("name");
+        if (!name || name->kind != sizedtypes_json::STRING) return false;
+        if (name->str == "int") return true;
+        if (name->str != "array") return false;
+        type = type->member("element_type");
+      }
+      return false;
+    }
+  }
+
+  /**
+   * Which of the columns named by constrained_param_names() hold
+   * integers, from the JSON of get_constrained_sizedtypes(). A name
+   * such as "y.2.1" belongs to the variable "y". All columns are taken
+   * as reals if the JSON cannot be read.
+   */
+  inline std::vector<bool>
+  int_columns(const std::string& sizedtypes,
+              const std::vector<std::string>& names) {
+    std::vector<bool> is_int(names.size(), false);
+    std::map<std::string, bool> var_is_int;
+    try {
+      sizedtypes_json vars;
+      size_t i = 0;
+      parse_json(sizedtypes, i, vars);
+      if (vars.kind != sizedtypes_json::ARRAY) return is_int;
+      for (size_t k = 0; k < vars.values.size(); ++k) {
+        const sizedtypes_json* name = vars.values[k].member("name");
+        if (name && name->kind == sizedtypes_json::STRING)
+          var_is_int[name->str]
+            = sizedtype_is_int(vars.values[k].member("type"));
+      }
+    } catch (const std::exception& e) {
+      return is_int;
+    }
+    for (size_t n = 0; n < names.size(); ++n) {
+      std::map<std::string, bool>::const_iterator it
+        = var_is_int.find(names[n].substr(0, names[n].find_first_of(".[")));
+      is_int[n] = it != var_is_int.end() && it->second;
+    }
+    return is_int;
+  }
+
+  /**
+   * int_columns() for the constrained parameters, transformed
+   * parameters and generated quantities of a model generated by stanc.
+   */
+  template <class Model>
+  std::vector<bool> model_int_columns(const Model& model) {
+    std::vector<std::string> names;
+    model.constrained_param_names(names, true, true);
+    return int_columns(model.get_constrained_sizedtypes(), names);
+  }
+
+}
+#endif
@@ -0,0 +1,421 @@
+#ifndef RSTAN_LOWRANK_E_NUTS_HPP
+#define RSTAN_LOWRANK_E_NUTS_HPP
+
+#include <stan/callbacks/interrupt.hpp>
+#include <stan/callbacks/logger.hpp>
+#include <stan/callbacks/writer.hpp>
+#include <stan/io/var_context.hpp>
+#include <stan/mcmc/base_adapter.hpp>
+#include <stan/mcmc/hmc/hamiltonians/base_hamiltonian.hpp>
+#include <stan/mcmc/hmc/hamiltonians/ps_point.hpp>
+#include <stan/mcmc/hmc/integrators/expl_leapfrog.hpp>
+#include <stan/mcmc/hmc/nuts/base_nuts.hpp>
+#include <stan/mcmc/sample.hpp>
+#include <stan/mcmc/stepsize_adaptation.hpp>
+#include <stan/mcmc/windowed_adaptation.hpp>
+#include <stan/services/error_codes.hpp>
+#include <stan/services/util/create_rng.hpp>
+#include <stan/services/util/initialize.hpp>
+#include <stan/services/util/read_diag_inv_metric.hpp>
+#include <stan/services/util/run_adaptive_sampler.hpp>
+#include <stan/services/util/validate_diag_inv_metric.hpp>
+#include <boost/random/mixmax.hpp>
+#include <boost/random/normal_distribution.hpp>
+#include <boost/random/variate_generator.hpp>
+#include <Eigen/Dense>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace rstan {
+
+  /**
+   * A phase space point with the inverse metric
+   * <code>diag(inv_e_metric_) + low_rank_ * low_rank_^T</code>, where
+   * <code>low_rank_</code> is D x k. Products with the inverse metric
+   * and (by the Woodbury identity) with the metric cost O(Dk), after an
+   * O(Dk^2) factorization each time the metric is set.
+   */
+  class lowrank_e_point : public stan::mcmc::ps_point {
+  public:
+    explicit lowrank_e_point(int n)
+      : stan::mcmc::ps_point(n), inv_e_metric_(n), low_rank_(n, 0) {
+      inv_e_metric_.setOnes();
+      factorize();
+    }
+
+    Eigen::VectorXd inv_e_metric_;
+    Eigen::MatrixXd low_rank_;
+
+    using stan::mcmc::ps_point::set_metric;
+
+    void set_metric(const Eigen::VectorXd& inv_e_metric) {
+      inv_e_metric_ = inv_e_metric;
+      low_rank_.resize(inv_e_metric.size(), 0);
+      factorize();
+    }
+
+    void set_metric(const Eigen::VectorXd& inv_e_metric,
+                    const Eigen::MatrixXd& low_rank) {
+      inv_e_metric_ = inv_e_metric;
+      low_rank_ = low_rank;
+      factorize();
+    }
+
+    /**
+     * The inverse metric times <code>x</code>.
+     */
+    Eigen::VectorXd inv_metric_times(const Eigen::VectorXd& x) const {
+      Eigen::VectorXd y = inv_e_metric_.cwiseProduct(x);
+      if (low_rank_.cols() > 0)
+        y.noalias() += low_rank_ * (low_rank_.transpose() * x);
+      return y;
+    }
+
+    /**
+     * The metric times <code>x</code>, that is, the inverse metric
+     * solved for <code>x</code>.
+     */
+    Eigen::VectorXd metric_times(const Eigen::VectorXd& x) const {
+      Eigen::VectorXd y = inv_diag_.cwiseProduct(x);
+      if (low_rank_.cols() > 0)
+        y.noalias() -= scaled_low_rank_
+                       * capacitance_.solve(scaled_low_rank_.transpose() * x);
+      return y;
+    }
+
+    void write_metric(stan::callbacks::writer& writer) {
+      writer("Diagonal elements of inverse mass matrix:");
+      std::stringstream diag_ss;
+      diag_ss << inv_e_metric_(0);
+      for (int i = 1; i < inv_e_metric_.size(); ++i)
+        diag_ss << ", " << inv_e_metric_(i);
+      writer(diag_ss.str());
+      std::stringstream rank_ss;
+      rank_ss << "Low-rank correction to inverse mass matrix, "
+              << low_rank_.cols() << " columns:";
+      writer(rank_ss.str());
+      for (int j = 0; j < low_rank_.cols(); ++j) {
+        std::stringstream col_ss;
+        col_ss << low_rank_(0, j);
+        for (int i = 1; i < low_rank_.rows(); ++i)
+          col_ss << ", " << low_rank_(i, j);
+        writer(col_ss.str());
+      }
+    }
+
+  private:
+    Eigen::VectorXd inv_diag_;
+    Eigen::MatrixXd scaled_low_rank_;  // diag^-1 * low_rank_
+    Eigen::LLT<Eigen::MatrixXd> capacitance_;  // of I + U^T diag^-1 U
+
+    void factorize() {
+      inv_diag_ = inv_e_metric_.cwiseInverse();
+      if (low_rank_.cols() == 0) return;
+      scaled_low_rank_ = inv_diag_.asDiagonal() * low_rank_;
+      Eigen::MatrixXd capacitance
+        = Eigen::MatrixXd::Identity(low_rank_.cols(), low_rank_.cols());
+      capacitance.noalias() += low_rank_.transpose() * scaled_low_rank_;
+      capacitance_.compute(capacitance);
+    }
+  };
+
+  /**
+   * The Euclidean metric of lowrank_e_point, as
+   * stan::mcmc::diag_e_metric is for the diagonal metric.
+   */
+  template <class Model, class BaseRNG>
+  class lowrank_e_metric
+    : public stan::mcmc::base_hamiltonian<Model, lowrank_e_point, BaseRNG> {
+  public:
+    explicit lowrank_e_metric(const Model& model)
+      : stan::mcmc::base_hamiltonian<Model, lowrank_e_point, BaseRNG>(model) {}
+
+    double T(lowrank_e_point& z) {
+      return 0.5 * z.p.dot(z.inv_metric_times(z.p));
+    }
+
+    double tau(lowrank_e_point& z) { return T(z); }
+
+    double phi(lowrank_e_point& z) { return this->V(z); }
+
+    double dG_dt(lowrank_e_point& z, stan::callbacks::logger& logger) {
+      return 2 * T(z) - z.q.dot(z.g);
+    }
+
+    Eigen::VectorXd dtau_dq(lowrank_e_point& z,
+                            stan::callbacks::logger& logger) {
+      return Eigen::VectorXd::Zero(this->model_.num_params_r());
+    }
+
+    Eigen::VectorXd dtau_dp(lowrank_e_point& z) {
+      return z.inv_metric_times(z.p);
+    }
+
+    Eigen::VectorXd dphi_dq(lowrank_e_point& z,
+                            stan::callbacks::logger& logger) {
+      return z.g;
+    }
+
+    void sample_p(lowrank_e_point& z, BaseRNG& rng) {
+      boost::variate_generator<BaseRNG&, boost::normal_distribution<> >
+        rand_gaus(rng, boost::normal_distribution<>());
+      // v ~ N(0, inverse metric), so the metric times v ~ N(0, metric)
+      Eigen::VectorXd v(z.p.size());
+      for (int i = 0; i < v.size(); ++i)
+        v(i) = rand_gaus() * std::sqrt(z.inv_e_metric_(i));
+      if (z.low_rank_.cols() > 0) {
+        Eigen::VectorXd u(z.low_rank_.cols());
+        for (int j = 0; j < u.size(); ++j)
+          u(j) = rand_gaus();
+        v.noalias() += z.low_rank_ * u;
+      }
+      z.p = z.metric_times(v);
+    }
+  };
+
+  template <class Model, class BaseRNG>
+  class lowrank_e_nuts
+    : public stan::mcmc::base_nuts<Model, lowrank_e_metric,
+                                   stan::mcmc::expl_leapfrog, BaseRNG> {
+  public:
+    lowrank_e_nuts(const Model& model, BaseRNG& rng)
+      : stan::mcmc::base_nuts<Model, lowrank_e_metric,
+                              stan::mcmc::expl_leapfrog, BaseRNG>(model, rng) {}
+  };
+
+  /**
+   * The windowed adaptation of stan::mcmc::windowed_var_adaptation, but
+   * estimating a diagonal plus rank <code>rank</code> inverse metric.
+   *
+   * At the end of a window, with marginal variances S and correlation
+   * matrix C of the window's draws, the inverse metric is
+   * <code>S + U U^T</code> where U holds the leading eigenvectors v of C
+   * with eigenvalue l > 1, scaled to <code>S^(1/2) v (l - 1)^(1/2)</code>;
+   * that is, C is approximated by the identity plus its leading
+   * directions. Both parts are regularized towards 1e-3 times the
+   * identity the way windowed_var_adaptation regularizes the variances.
+   * The eigenvectors come from the n x n Gram matrix of the window's
+   * draws when there are fewer draws than parameters, so no D x D
+   * matrix is formed; the draws of the window are kept, O(nD) memory.
+   */
+  class windowed_lowrank_adaptation : public stan::mcmc::windowed_adaptation {
+  public:
+    windowed_lowrank_adaptation(int n, int rank)
+      : stan::mcmc::windowed_adaptation("low-rank metric"),
+        num_params_(n), rank_(rank) {}
+
+    bool learn_metric(Eigen::VectorXd& inv_e_metric, Eigen::MatrixXd& low_rank,
+                      const Eigen::VectorXd& q) {
+      if (adaptation_window())
+        draws_.push_back(q);
+
+      if (end_adaptation_window()) {
+        compute_next_window();
+        estimate(inv_e_metric, low_rank);
+        if (!inv_e_metric.allFinite() || !low_rank.allFinite())
+          throw std::runtime_error(
+            "Numerical overflow in metric adaptation. "
+            "This occurs when the sampler encounters extreme values on the "
+            "unconstrained space; this may happen when the posterior density "
+            "function is too wide or improper. "
+            "There may be problems with your model specification.");
+        draws_.clear();
+        ++adapt_window_counter_;
+        return true;
+      }
+
+      ++adapt_window_counter_;
+      return false;
+    }
+
+  protected:
+    int num_params_;
+    int rank_;
+    std::vector<Eigen::VectorXd> draws_;
+
+    void estimate(Eigen::VectorXd& inv_e_metric, Eigen::MatrixXd& low_rank) {
+      const int n = draws_.size();
+      Eigen::MatrixXd y(n, num_params_);
+      for (int i = 0; i < n; ++i)
+        y.row(i) = draws_[i].transpose();
+      Eigen::RowVectorXd mean = y.colwise().mean();
+      y.rowwise() -= mean;
+      Eigen::VectorXd var = y.colwise().squaredNorm().transpose() / (n - 1.0);
+      Eigen::VectorXd sd = var.cwiseSqrt();
+
+      const double w = n / (n + 5.0);
+      inv_e_metric = w * var
+                     + 1e-3 * (5.0 / (n + 5.0))
+                       * Eigen::VectorXd::Ones(num_params_);
+
+      // scaled so that y^T y is the correlation matrix of the draws
+      for (int j = 0; j < num_params_; ++j) {
+        if (sd(j) > 0) y.col(j) /= sd(j) * std::sqrt(n - 1.0);
+        else y.col(j).setZero();
+      }
+      Eigen::VectorXd eigenvalues;
+      Eigen::MatrixXd eigenvectors;
+      if (n < num_params_) {
+        Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd>
+          es(y * y.transpose());
+        eigenvalues = es.eigenvalues();
+        eigenvectors = y.transpose() * es.eigenvectors();
+        for (int i = 0; i < eigenvalues.size(); ++i)
+          if (eigenvalues(i) > 0)
+            eigenvectors.col(i) /= std::sqrt(eigenvalues(i));
+      } else {
+        Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd>
+          es(y.transpose() * y);
+        eigenvalues = es.eigenvalues();
+        eigenvectors = es.eigenvectors();
+      }
+
+      // the eigenvalues are in increasing order; those within roundoff
+      // of 1 (as for uncorrelated draws) add nothing to the metric
+      int k = 0;
+      for (int i = eigenvalues.size() - 1;
+           i >= 0 && k < rank_ && eigenvalues(i) > 1 + 1e-8; --i)
+        ++k;
+      low_rank.resize(num_params_, k);
+      for (int j = 0; j < k; ++j) {
+        int i = eigenvalues.size() - 1 - j;
+        low_rank.col(j) = sd.cwiseProduct(eigenvectors.col(i))
+                          * std::sqrt(w * (eigenvalues(i) - 1));
+      }
+    }
+  };
+
+  class stepsize_lowrank_adapter : public stan::mcmc::base_adapter {
+  public:
+    stepsize_lowrank_adapter(int n, int rank) : lowrank_adaptation_(n, rank) {}
+
+    stan::mcmc::stepsize_adaptation& get_stepsize_adaptation() {
+      return stepsize_adaptation_;
+    }
+
+    windowed_lowrank_adaptation& get_lowrank_adaptation() {
+      return lowrank_adaptation_;
+    }
+
+    void set_window_params(unsigned int num_warmup, unsigned int init_buffer,
+                           unsigned int term_buffer, unsigned int base_window,
+                           stan::callbacks::logger& logger) {
+      lowrank_adaptation_.set_window_params(num_warmup, init_buffer,
+                                            term_buffer, base_window, logger);
+    }
+
+  protected:
+    stan::mcmc::stepsize_adaptation stepsize_adaptation_;
+    windowed_lowrank_adaptation lowrank_adaptation_;
+  };
+
+  /**
+   * lowrank_e_nuts with step size and metric adaptation, as
+   * stan::mcmc::adapt_diag_e_nuts is for the diagonal metric.
+   */
+  template <class Model, class BaseRNG>
+  class adapt_lowrank_e_nuts : public lowrank_e_nuts<Model, BaseRNG>,
+                               public stepsize_lowrank_adapter {
+  public:
+    adapt_lowrank_e_nuts(const Model& model, BaseRNG& rng, int rank)
+      : lowrank_e_nuts<Model, BaseRNG>(model, rng),
+        stepsize_lowrank_adapter(model.num_params_r(), rank) {}
+
+    stan::mcmc::sample transition(stan::mcmc::sample& init_sample,
+                                  stan::callbacks::logger& logger) {
+      stan::mcmc::sample s
+        = lowrank_e_nuts<Model, BaseRNG>::transition(init_sample, logger);
+
+      if (this->adapt_flag_) {
+        this->stepsize_adaptation_.learn_stepsize(this->nom_epsilon_,
+                                                  s.accept_stat());
+
+        Eigen::VectorXd inv_e_metric;
+        Eigen::MatrixXd low_rank;
+        bool update = this->lowrank_adaptation_.learn_metric(inv_e_metric,
+                                                             low_rank,
+                                                             this->z_.q);
+        if (update) {
+          this->z_.set_metric(inv_e_metric, low_rank);
+          this->init_stepsize(logger);
+
+          this->stepsize_adaptation_.set_mu(std::log(10 * this->nom_epsilon_));
+          this->stepsize_adaptation_.restart();
+        }
+      }
+      return s;
+    }
+
+    void disengage_adaptation() {
+      stan::mcmc::base_adapter::disengage_adaptation();
+      this->stepsize_adaptation_.complete_adaptation(this->nom_epsilon_);
+    }
+  };
+
+  /**
+   * stan::services::sample::hmc_nuts_diag_e_adapt with the low-rank plus
+   * diagonal metric of adapt_lowrank_e_nuts. The metric starts as the
+   * diagonal <code>init_inv_metric</code>; each adaptation window adds
+   * a correction of rank at most <code>rank</code>.
+   */
+  template <class Model>
+  int hmc_nuts_lowrank_e_adapt(Model& model, const stan::io::var_context& init,
+                               const stan::io::var_context& init_inv_metric,
+                               unsigned int random_seed, unsigned int chain,
+                               double init_radius, int num_warmup,
+                               int num_samples, int num_thin, bool save_warmup,
+                               int refresh, double stepsize,
+                               double stepsize_jitter, int max_depth,
+                               double delta, double gamma, double kappa,
+                               double t0, unsigned int init_buffer,
+                               unsigned int term_buffer, unsigned int window,
+                               int rank,
+                               stan::callbacks::interrupt& interrupt,
+                               stan::callbacks::logger& logger,
+                               stan::callbacks::writer& init_writer,
+                               stan::callbacks::writer& sample_writer,
+                               stan::callbacks::writer& diagnostic_writer) {
+    boost::random::mixmax rng = stan::services::util::create_rng(random_seed,
+                                                                 chain);
+    std::vector<double> cont_vector
+      = stan::services::util::initialize(model, init, rng, init_radius, true,
+                                         logger, init_writer);
+
+    Eigen::VectorXd inv_metric;
+    try {
+      inv_metric = stan::services::util::read_diag_inv_metric(
+        init_inv_metric, model.num_params_r(), logger);
+      stan::services::util::validate_diag_inv_metric(inv_metric, logger);
+    } catch (const std::domain_error& e) {
+      return stan::services::error_codes::CONFIG;
+    }
+
+    adapt_lowrank_e_nuts<Model, boost::random::mixmax> sampler(model, rng,
+                                                               rank);
+    sampler.set_metric(inv_metric);
+    sampler.set_nominal_stepsize(stepsize);
+    sampler.set_stepsize_jitter(stepsize_jitter);
+    sampler.set_max_depth(max_depth);
+
+    sampler.get_stepsize_adaptation().set_mu(std::log(10 * stepsize));
+    sampler.get_stepsize_adaptation().set_delta(delta);
+    sampler.get_stepsize_adaptation().set_gamma(gamma);
+    sampler.get_stepsize_adaptation().set_kappa(kappa);
+    sampler.get_stepsize_adaptation().set_t0(t0);
+    sampler.set_window_params(num_warmup, init_buffer, term_buffer, window,
+                              logger);
+
+    stan::services::util::run_adaptive_sampler(sampler, model, cont_vector,
+                                               num_warmup, num_samples,
+                                               num_thin, refresh, save_warmup,
+                                               rng, interrupt, logger,
+                                               sample_writer,
+                                               diagnostic_writer);
+    return stan::services::error_codes::OK;
+  }
+
+}
+#endif
@@ -0,0 +1,121 @@
+#ifndef RSTAN_MODEL_REF_HPP
+#define RSTAN_MODEL_REF_HPP
+
+#include <stan/io/var_context.hpp>
+#include <stan/math/prim/fun/Eigen.hpp>
+#include <stan/model/model_base.hpp>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace rstan {
+
+  /**
+   * A model built in another translation unit and used through
+   * stan::model::model_base. When stan_model() compiles a model in
+   * split units (see cxxfunctionplus in R/cxxfunplus.R), the generated
+   * class and a factory for it are compiled in one unit and the Rcpp
+   * module in another, which instantiates stan_fit and the services with
+   * this type. The templates of the generated class (log_prob,
+   * write_array, transform_inits, ...) are then only instantiated with
+   * the model's virtual functions, in the model's own unit, and the two
+   * units can be compiled at the same time.
+   *
+   * Everything is forwarded to the model, as filtered_model does, so the
+   * services see the same interface as with the generated class.
+   *
+   * @tparam Factory A class with a static function
+   *  <code>new_model(stan::io::var_context&, unsigned int, std::ostream*)</code>
+   *  returning a new model. It should be in an unnamed namespace, so
+   *  that every model gets its own stan_fit type (and its own Rcpp class)
+   *  even when several models are loaded in the same R session.
+   */
+  template <class Factory>
+  class model_ref {
+  private:
+    std::unique_ptr<stan::model::model_base> model_;
+
+    model_ref(const model_ref&);
+    model_ref& operator=(const model_ref&);
+
+  public:
+    model_ref(stan::io::var_context& data, unsigned int seed,
+              std::ostream* msgs)
+      : model_(Factory::new_model(data, seed, msgs)) { }
+
+    model_ref(stan::io::var_context& data, std::ostream* msgs)
+      : model_(Factory::new_model(data, 0, msgs)) { }
+
+    const stan::model::model_base& model() const {
+      return *model_;
+    }
+
+    std::string model_name() const {
+      return model_->model_name();
+    }
+
+    size_t num_params_r() const {
+      return model_->num_params_r();
+    }
+
+    size_t num_params_i() const {
+      return model_->num_params_i();
+    }
+
+    std::string get_constrained_sizedtypes() const {
+      return model_->get_constrained_sizedtypes();
+    }
+
+    template <typename... Args>
+    void get_param_names(Args&&... args) const {
+      model_->get_param_names(std::forward<Args>(args)...);
+    }
+
+    template <typename... Args>
+    void get_dims(Args&&... args) const {
+      model_->get_dims(std::forward<Args>(args)...);
+    }
+
+    template <typename... Args>
+    void constrained_param_names(Args&&... args) const {
+      model_->constrained_param_names(std::forward<Args>(args)...);
+    }
+
+    template <typename... Args>
+    void unconstrained_param_names(Args&&... args) const {
+      model_->unconstrained_param_names(std::forward<Args>(args)...);
+    }
+
+    template <typename... Args>
+    void transform_inits(Args&&... args) const {
+      model_->transform_inits(std::forward<Args>(args)...);
+    }
+
+    template <typename... Args>
+    void unconstrain_array(Args&&... args) const {
+      model_->unconstrain_array(std::forward<Args>(args)...);
+    }
+
+    template <typename... Args>
+    void write_array(Args&&... args) const {
+      model_->write_array(std::forward<Args>(args)...);
+    }
+
+    template <bool propto, bool jacobian, typename T>
+    T log_prob(Eigen::Matrix<T, Eigen::Dynamic, 1>& params_r,
+               std::ostream* msgs = 0) const {
+      return model_->template log_prob<propto, jacobian>(params_r, msgs);
+    }
+
+    template <bool propto, bool jacobian, typename T>
+    T log_prob(std::vector<T>& params_r, std::vector<int>& params_i,
+               std::ostream* msgs = 0) const {
+      return model_->template log_prob<propto, jacobian>(params_r, params_i,
+                                                         msgs);
+    }
+  };
+
+}
+#endif
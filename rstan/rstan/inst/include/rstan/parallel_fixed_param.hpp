@@ -0,0 +1,157 @@
+#ifndef RSTAN_PARALLEL_FIXED_PARAM_HPP
+#define RSTAN_PARALLEL_FIXED_PARAM_HPP
+
+#include <stan/callbacks/interrupt.hpp>
+#include <stan/callbacks/logger.hpp>
+#include <stan/callbacks/writer.hpp>
+#include <stan/io/var_context.hpp>
+#include <stan/math/rev/core/chainablestack.hpp>
+#include <stan/mcmc/fixed_param_sampler.hpp>
+#include <stan/mcmc/sample.hpp>
+#include <stan/services/error_codes.hpp>
+#include <stan/services/util/create_rng.hpp>
+#include <stan/services/util/initialize.hpp>
+#include <stan/services/util/mcmc_writer.hpp>
+#include <boost/random/mixmax.hpp>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace rstan {
+
+  /**
+   * stan::services::sample::fixed_param with the draws computed
+   * <code>n_threads</code> at a time.
+   *
+   * The m-th saved draw (counting the saved draws only, not the
+   * thinned-out iterations) calls <code>write_array</code> with its own
+   * PRNG, determined by <code>(random_seed, chain, m)</code>, so the
+   * draws do not depend on the number of threads, and iterations that
+   * are thinned out are not computed at all. As m skips the thinned-out
+   * iterations, the draws for a seed do depend on <code>num_thin</code>.
+   *
+   * The draws are computed in blocks into a buffer allocated once and
+   * passed to <code>sample_writer</code> in order on the calling
+   * thread, between blocks, together with the messages of
+   * <code>write_array</code>; <code>interrupt</code> and the progress
+   * are also handled there. The output has the same layout as that of
+   * fixed_param, but the draws differ from it, as fixed_param uses one
+   * PRNG for all draws.
+   */
+  template <class Model>
+  int fixed_param_parallel(Model& model, const stan::io::var_context& init,
+                           unsigned int random_seed, unsigned int chain,
+                           double init_radius, int num_samples, int num_thin,
+                           int refresh, int n_threads,
+                           stan::callbacks::interrupt& interrupt,
+                           stan::callbacks::logger& logger,
+                           stan::callbacks::writer& init_writer,
+                           stan::callbacks::writer& sample_writer,
+                           stan::callbacks::writer& diagnostic_writer) {
+    boost::random::mixmax rng = stan::services::util::create_rng(random_seed,
+                                                                 chain);
+    std::vector<double> cont_vector
+      = stan::services::util::initialize(model, init, rng, init_radius, false,
+                                         logger, init_writer);
+    if (n_threads < 1) n_threads = 1;
+    if (num_thin < 1) num_thin = 1;
+
+    stan::mcmc::fixed_param_sampler sampler;
+    stan::services::util::mcmc_writer writer(sample_writer, diagnostic_writer,
+                                             logger);
+    Eigen::VectorXd cont_params = Eigen::Map<Eigen::VectorXd>(
+      cont_vector.data(), cont_vector.size());
+    stan::mcmc::sample s(cont_params, 0, 0);
+    writer.write_sample_names(s, sampler, model);
+    writer.write_diagnostic_names(s, sampler, model);
+
+    std::vector<std::string> names;
+    model.constrained_param_names(names, true, true);
+    const size_t num_values = names.size();
+    std::vector<double> sample_values;
+    s.get_sample_params(sample_values);
+
+    const int num_draws = num_samples > 0 ? 1 + (num_samples - 1) / num_thin : 0;
+    const int block_size = std::min(num_draws, 256 * n_threads);
+    std::vector<double> block(static_cast<size_t>(block_size) * num_values);
+    std::vector<std::string> messages(block_size);
+    std::vector<double> values;
+    values.reserve(sample_values.size() + num_values);
+    const int it_print_width = std::ceil(std::log10(static_cast<double>(
+                                 std::max(num_samples, 2))));
+
+    auto start = std::chrono::steady_clock::now();
+    tbb::task_arena arena(n_threads);
+    for (int first = 0; first < num_draws; first += block_size) {
+      interrupt();
+      const int n = std::min(block_size, num_draws - first);
+      arena.execute([&] {
+        tbb::parallel_for(tbb::blocked_range<int>(0, n),
+                          [&](const tbb::blocked_range<int>& r) {
+          // for nested autodiff in generated quantities
+          stan::math::ChainableStack ad_tape;
+          std::vector<double> params_r(cont_vector);
+          std::vector<int> params_i;
+          std::vector<double> draw;
+          for (int j = r.begin(); j != r.end(); ++j) {
+            boost::random::mixmax draw_rng(random_seed, chain, first + j, 1);
+            std::stringstream msg;
+            draw.clear();
+            try {
+              model.write_array(draw_rng, params_r, params_i, draw,
+                                true, true, &msg);
+            } catch (const std::exception& e) {
+              msg << e.what() << std::endl;
+            }
+            draw.resize(num_values, std::numeric_limits<double>::quiet_NaN());
+            std::copy(draw.begin(), draw.end(),
+                      block.begin() + static_cast<size_t>(j) * num_values);
+            messages[j] = msg.str();
+          }
+        });
+      });
+
+      for (int j = 0; j < n; ++j) {
+        if (!messages[j].empty()) logger.info(messages[j]);
+        values = sample_values;
+        values.insert(values.end(),
+                      block.begin() + static_cast<size_t>(j) * num_values,
+                      block.begin() + static_cast<size_t>(j + 1) * num_values);
+        sample_writer(values);
+        writer.write_diagnostic_params(s, sampler);
+      }
+
+      // report the iterations done once per block that passes a multiple
+      // of refresh, and at the end
+      int done_before = std::min(num_samples, first * num_thin);
+      int done = std::min(num_samples, (first + n) * num_thin);
+      if (refresh > 0
+          && (first + n == num_draws
+              || done / refresh != done_before / refresh)) {
+        int m = done - 1;
+        std::stringstream message;
+        message << "Iteration: ";
+        message << std::setw(it_print_width) << m + 1 << " / " << num_samples;
+        message << " [" << std::setw(3)
+                << static_cast<int>((100.0 * (m + 1)) / num_samples) << "%] ";
+        message << " (Sampling)";
+        logger.info(message);
+      }
+    }
+    auto end = std::chrono::steady_clock::now();
+    double sample_delta_t = std::chrono::duration_cast<std::chrono::milliseconds>(
+                              end - start).count() / 1000.0;
+    writer.write_timing(0.0, sample_delta_t);
+    return stan::services::error_codes::OK;
+  }
+
+}
+#endif
@@ -0,0 +1,115 @@
+#ifndef RSTAN_PARALLEL_GQS_HPP
+#define RSTAN_PARALLEL_GQS_HPP
+
+#include <stan/math/prim/fun/Eigen.hpp>
+#include <stan/services/util/create_rng.hpp>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
+#include <limits>
+#include <ostream>
+#include <stdexcept>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace rstan {
+
+  /**
+   * Evaluate the generated quantities block for every row of
+   * <code>draws</code>, splitting the rows over <code>n_threads</code>
+   * threads. This does the same work as
+   * stan::services::standalone_generate, but each draw gets its own
+   * PRNG created from <code>(seed, row + 1)</code>, so that the result
+   * does not depend on how the rows are scheduled on the threads.
+   *
+   * Nothing in here touches R; the caller copies the result into R
+   * objects after the threads have finished.
+   *
+   * @tparam Model The model type
+   * @param model The model
+   * @param draws A matrix of draws of the parameters on the constrained
+   *   scale, one draw per row, columns in the order of
+   *   <code>constrained_param_names(names, false, false)</code>
+   * @param seed The seed for the PRNGs
+   * @param n_threads The number of threads to use
+   * @param gqs[out] A matrix with a row for each draw and a column for
+   *   each generated quantity; rows for which the generated quantities
+   *   block threw are filled with NaN
+   * @param errors[out] The error messages, empty if a row succeeded
+   */
+  template <class Model>
+  void parallel_generate_gqs(const Model& model,
+                             const Eigen::Ref<const Eigen::MatrixXd>& draws,
+                             unsigned int seed, int n_threads,
+                             Eigen::MatrixXd& gqs,
+                             std::vector<std::string>& errors) {
+    std::vector<std::string> names;
+    model.constrained_param_names(names, false, false);
+    const size_t num_params = names.size();
+    model.constrained_param_names(names, false, true);
+    const size_t num_gqs = names.size() - num_params;
+    if (static_cast<size_t>(draws.cols()) != num_params) {
+      std::stringstream msg;
+      msg << "Wrong number of parameter values in draws from fitted model. "
+          << "Expecting " << num_params << " columns, found "
+          << draws.cols() << " columns.";
+      throw std::domain_error(msg.str());
+    }
+
+    const size_t N = draws.rows();
+    gqs.setConstant(N, num_gqs, std::numeric_limits<double>::quiet_NaN());
+    errors.assign(N, std::string());
+    if (n_threads < 1) n_threads = 1;
+
+    tbb::task_arena arena(n_threads);
+    arena.execute([&] {
+      tbb::parallel_for(tbb::blocked_range<size_t>(0, N),
+                        [&](const tbb::blocked_range<size_t>& r) {
+        std::vector<double> constrained(num_params);
+        std::vector<double> unconstrained;
+        std::vector<int> params_i;
+        std::vector<double> vars;
+        for (size_t i = r.begin(); i != r.end(); ++i) {
+          std::stringstream msg;
+          try {
+            for (size_t k = 0; k < num_params; k++)
+              constrained[k] = draws(i, k);
+            model.unconstrain_array(constrained, unconstrained, &msg);
+            boost::random::mixmax rng
+              = stan::services::util::create_rng(seed, i + 1);
+            model.write_array(rng, unconstrained, params_i, vars,
+                              false, true, &msg);
+            for (size_t k = 0; k < num_gqs; k++)
+              gqs(i, k) = vars[num_params + k];
+          } catch (const std::exception& e) {
+            errors[i] = e.what();
+          }
+        }
+      });
+    });
+  }
+
+  /**
+   * Write the first error collected by parallel_generate_gqs and the
+   * number of draws that failed to <code>o</code>. Called on the main
+   * thread once the workers are done.
+   */
+  inline void report_gqs_errors(const std::vector<std::string>& errors,
+                                std::ostream& o) {
+    size_t num_failed = 0;
+    const std::string* first = 0;
+    for (size_t i = 0; i < errors.size(); i++) {
+      if (errors[i].empty()) continue;
+      if (!first) first = &errors[i];
+      num_failed++;
+    }
+    if (!num_failed) return;
+    o << *first << std::endl;
+    o << "Generated quantities could not be computed for " << num_failed
+      << " of " << errors.size() << " draws; they are set to NaN."
+      << std::endl;
+  }
+
+}
+#endif
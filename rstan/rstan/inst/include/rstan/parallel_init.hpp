@@ -0,0 +1,113 @@
+#ifndef RSTAN_PARALLEL_INIT_HPP
+#define RSTAN_PARALLEL_INIT_HPP
+
+#include <stan/io/array_var_context.hpp>
+#include <stan/math/rev/core/chainablestack.hpp>
+#include <stan/model/log_prob_grad.hpp>
+#include <boost/random/mixmax.hpp>
+#include <boost/random/uniform_real_distribution.hpp>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace rstan {
+
+  /**
+   * Search for random initial values the way
+   * stan::services::util::initialize does for <code>init = "random"</code>
+   * (uniform on <code>(-init_radius, init_radius)</code> on the
+   * unconstrained scale, accepted if the log density and its gradient
+   * are finite), but with <code>n_threads</code> candidates evaluated
+   * at the same time.
+   *
+   * Candidate k draws from its own PRNG stream, determined by
+   * <code>(seed, chain_id, k)</code>, and the accepted candidate is the
+   * valid one with the lowest k, so the result does not depend on the
+   * number of threads or on how the candidates are scheduled.
+   *
+   * @param[out] params_r The accepted point on the unconstrained scale
+   * @return true if a valid candidate was found within
+   *   <code>max_tries</code> candidates
+   */
+  template <class Model>
+  bool parallel_random_init(const Model& model, unsigned int seed,
+                            unsigned int chain_id, double init_radius,
+                            int n_threads, int max_tries,
+                            std::vector<double>& params_r) {
+    if (n_threads < 1) n_threads = 1;
+    const size_t num_params = model.num_params_r();
+    std::vector<std::vector<double> > candidates(n_threads);
+    std::vector<char> valid(n_threads);
+
+    tbb::task_arena arena(n_threads);
+    for (int first = 0; first < max_tries; first += n_threads) {
+      const int n = std::min(n_threads, max_tries - first);
+      arena.execute([&] {
+        tbb::parallel_for(tbb::blocked_range<int>(0, n, 1),
+                          [&](const tbb::blocked_range<int>& r) {
+          stan::math::ChainableStack ad_tape;
+          for (int j = r.begin(); j != r.end(); ++j) {
+            boost::random::mixmax rng(seed, chain_id, first + j, 0);
+            boost::random::uniform_real_distribution<double>
+              unif(-init_radius, init_radius);
+            std::vector<double>& x = candidates[j];
+            x.resize(num_params);
+            for (size_t i = 0; i < num_params; i++)
+              x[i] = unif(rng);
+            valid[j] = false;
+            std::vector<int> params_i;
+            std::vector<double> gradient;
+            std::stringstream msg;
+            try {
+              double lp = stan::model::log_prob_grad<true, true>(model, x,
+                                                                 params_i,
+                                                                 gradient,
+                                                                 &msg);
+              if (!std::isfinite(lp)) continue;
+              bool ok = true;
+              for (size_t i = 0; i < gradient.size(); i++)
+                ok = ok && std::isfinite(gradient[i]);
+              valid[j] = ok;
+            } catch (const std::exception& e) {
+              // not a valid candidate
+            }
+          }
+        });
+      });
+      for (int j = 0; j < n; j++) {
+        if (valid[j]) {
+          params_r.swap(candidates[j]);
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+
+  /**
+   * The constrained values of the parameters at <code>params_r</code>
+   * as a var_context, to be passed to the services as the initial
+   * values.
+   */
+  template <class Model, class RNG>
+  stan::io::var_context*
+  make_init_context(const Model& model, RNG& rng,
+                    std::vector<double>& params_r) {
+    std::vector<std::string> names;
+    std::vector<std::vector<size_t> > dims;
+    model.get_param_names(names, false, false);
+    model.get_dims(dims, false, false);
+    std::vector<int> params_i;
+    std::vector<double> constrained;
+    model.write_array(rng, params_r, params_i, constrained, false, false);
+    return new stan::io::array_var_context(names, constrained, dims);
+  }
+
+}
+#endif
@@ -0,0 +1,508 @@
+#ifndef RSTAN_PARALLEL_TEMPERING_HPP
+#define RSTAN_PARALLEL_TEMPERING_HPP
+
+#include <stan/callbacks/interrupt.hpp>
+#include <stan/callbacks/logger.hpp>
+#include <stan/callbacks/writer.hpp>
+#include <stan/io/var_context.hpp>
+#include <stan/math/prim/fun/Eigen.hpp>
+#include <stan/math/rev/core/chainablestack.hpp>
+#include <stan/mcmc/sample.hpp>
+#include <stan/services/error_codes.hpp>
+#include <stan/services/util/create_rng.hpp>
+#include <stan/services/util/initialize.hpp>
+#include <stan/services/util/mcmc_writer.hpp>
+#include <rstan/adaptive_warmup.hpp>
+#include <boost/random/mixmax.hpp>
+#include <boost/random/uniform_01.hpp>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <memory>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace rstan {
+
+  /**
+   * A wrapper around a model whose log density is that of the wrapped
+   * model times the inverse temperature <code>beta</code>; everything
+   * else is forwarded. The inverse temperature can be changed between
+   * transitions of a sampler holding the wrapper.
+   */
+  template <class Model>
+  class tempered_model {
+  private:
+    const Model& model_;
+    double beta_;
+
+  public:
+    tempered_model(const Model& model, double beta)
+      : model_(model), beta_(beta) {}
+
+    double beta() const {
+      return beta_;
+    }
+
+    void set_beta(double beta) {
+      beta_ = beta;
+    }
+
+    std::string model_name() const {
+      return model_.model_name();
+    }
+
+    size_t num_params_r() const {
+      return model_.num_params_r();
+    }
+
+    size_t num_params_i() const {
+      return model_.num_params_i();
+    }
+
+    template <typename... Args>
+    void get_param_names(Args&&... args) const {
+      model_.get_param_names(std::forward<Args>(args)...);
+    }
+
+    template <typename... Args>
+    void get_dims(Args&&... args) const {
+      model_.get_dims(std::forward<Args>(args)...);
+    }
+
+    template <typename... Args>
+    void constrained_param_names(Args&&... args) const {
+      model_.constrained_param_names(std::forward<Args>(args)...);
+    }
+
+    template <typename... Args>
+    void unconstrained_param_names(Args&&... args) const {
+      model_.unconstrained_param_names(std::forward<Args>(args)...);
+    }
+
+    template <typename... Args>
+    void transform_inits(Args&&... args) const {
+      model_.transform_inits(std::forward<Args>(args)...);
+    }
+
+    template <typename... Args>
+    void unconstrain_array(Args&&... args) const {
+      model_.unconstrain_array(std::forward<Args>(args)...);
+    }
+
+    template <typename... Args>
+    void write_array(Args&&... args) const {
+      model_.write_array(std::forward<Args>(args)...);
+    }
+
+    template <bool propto, bool jacobian, typename T>
+    T log_prob(Eigen::Matrix<T, Eigen::Dynamic, 1>& params_r,
+               std::ostream* msgs = 0) const {
+      return beta_ * model_.template log_prob<propto, jacobian>(params_r, msgs);
+    }
+
+    template <bool propto, bool jacobian, typename T>
+    T log_prob(std::vector<T>& params_r, std::vector<int>& params_i,
+               std::ostream* msgs = 0) const {
+      return beta_ * model_.template log_prob<propto, jacobian>(params_r,
+                                                                params_i,
+                                                                msgs);
+    }
+  };
+
+  /**
+   * A writer that keeps what it is given, to be passed on to another
+   * writer later, on another thread.
+   */
+  class buffer_writer : public stan::callbacks::writer {
+  private:
+    enum entry_t { NAMES, VALUES, MESSAGE, BLANK };
+    std::vector<entry_t> entries_;
+    std::vector<std::vector<std::string> > names_;
+    std::vector<std::vector<double> > values_;
+    std::vector<std::string> messages_;
+
+  public:
+    using stan::callbacks::writer::operator();
+
+    void operator()(const std::vector<std::string>& names) {
+      entries_.push_back(NAMES);
+      names_.push_back(names);
+    }
+
+    void operator()(const std::vector<double>& state) {
+      entries_.push_back(VALUES);
+      values_.push_back(state);
+    }
+
+    void operator()() {
+      entries_.push_back(BLANK);
+    }
+
+    void operator()(const std::string& message) {
+      entries_.push_back(MESSAGE);
+      messages_.push_back(message);
+    }
+
+    /**
+     * Pass everything kept, in order, to <code>writer</code> and
+     * forget it.
+     */
+    void flush(stan::callbacks::writer& writer) {
+      size_t n = 0, v = 0, m = 0;
+      for (size_t i = 0; i < entries_.size(); i++) {
+        switch (entries_[i]) {
+          case NAMES: writer(names_[n++]); break;
+          case VALUES: writer(values_[v++]); break;
+          case MESSAGE: writer(messages_[m++]); break;
+          case BLANK: writer(); break;
+        }
+      }
+      entries_.clear();
+      names_.clear();
+      values_.clear();
+      messages_.clear();
+    }
+  };
+
+  /**
+   * A logger that keeps the messages it is given, to be passed on to
+   * another logger later, on another thread.
+   */
+  class buffer_logger : public stan::callbacks::logger {
+  private:
+    std::vector<std::pair<int, std::string> > messages_;
+
+  public:
+    void debug(const std::string& message) { messages_.push_back(std::make_pair(0, message)); }
+    void debug(const std::stringstream& message) { debug(message.str()); }
+    void info(const std::string& message) { messages_.push_back(std::make_pair(1, message)); }
+    void info(const std::stringstream& message) { info(message.str()); }
+    void warn(const std::string& message) { messages_.push_back(std::make_pair(2, message)); }
+    void warn(const std::stringstream& message) { warn(message.str()); }
+    void error(const std::string& message) { messages_.push_back(std::make_pair(3, message)); }
+    void error(const std::stringstream& message) { error(message.str()); }
+    void fatal(const std::string& message) { messages_.push_back(std::make_pair(4, message)); }
+    void fatal(const std::stringstream& message) { fatal(message.str()); }
+
+    void flush(stan::callbacks::logger& logger) {
+      for (size_t i = 0; i < messages_.size(); i++) {
+        switch (messages_[i].first) {
+          case 0: logger.debug(messages_[i].second); break;
+          case 1: logger.info(messages_[i].second); break;
+          case 2: logger.warn(messages_[i].second); break;
+          case 3: logger.error(messages_[i].second); break;
+          default: logger.fatal(messages_[i].second); break;
+        }
+      }
+      messages_.clear();
+    }
+  };
+
+  namespace {
+    /**
+     * Place the inverse temperatures so that the rejection rates of the
+     * swaps between neighbours are the same, keeping the first (1) and
+     * the last: the cumulative rejection rate is interpolated linearly
+     * in log beta along the current ladder and inverted at equally
+     * spaced levels (Syed et al., 2021, "Non-reversible parallel
+     * tempering").
+     */
+    void equalize_ladder(std::vector<double>& betas,
+                         const std::vector<double>& rejection) {
+      const size_t K = betas.size();
+      std::vector<double> cum(K, 0);
+      for (size_t k = 0; k + 1 < K; k++)
+        cum[k + 1] = cum[k] + rejection[k];
+      if (!(cum[K - 1] > 0)) return;
+      std::vector<double> new_betas(betas);
+      size_t k = 0;
+      for (size_t j = 1; j + 1 < K; j++) {
+        double level = cum[K - 1] * j / (K - 1);
+        while (k + 2 < K && cum[k + 1] < level) k++;
+        double width = cum[k + 1] - cum[k];
+        double w = width > 0 ? (level - cum[k]) / width : 0;
+        new_betas[j] = std::exp((1 - w) * std::log(betas[k])
+                                + w * std::log(betas[k + 1]));
+      }
+      betas.swap(new_betas);
+    }
+
+    /**
+     * The Metropolis acceptance probability of swapping the states of
+     * the replicas at inverse temperatures <code>beta_k</code> and
+     * <code>beta_k1</code>, given the untempered log densities
+     * <code>lp_k</code> and <code>lp_k1</code> of their states:
+     * exp((beta_k - beta_k1) (lp_k1 - lp_k)), capped at 1, and 0 if it
+     * is not a number.
+     */
+    double swap_acceptance(double beta_k, double beta_k1, double lp_k,
+                           double lp_k1) {
+      double log_alpha = (beta_k - beta_k1) * (lp_k1 - lp_k);
+      if (std::isnan(log_alpha)) return 0;
+      return log_alpha >= 0 ? 1 : std::exp(log_alpha);
+    }
+
+    void report_pt_progress(int m, int num_warmup, int finish, int refresh,
+                            stan::callbacks::logger& logger) {
+      if (refresh <= 0 || !(m == 0 || m + 1 == finish || (m + 1) % refresh == 0))
+        return;
+      int it_print_width = std::ceil(std::log10(static_cast<double>(finish)));
+      std::stringstream message;
+      message << "Iteration: ";
+      message << std::setw(it_print_width) << m + 1 << " / " << finish;
+      message << " [" << std::setw(3)
+              << static_cast<int>((100.0 * (m + 1)) / finish) << "%] ";
+      message << (m < num_warmup ? " (Warmup)" : " (Sampling)");
+      logger.info(message);
+    }
+
+    std::string join_values(const std::string& label,
+                            const std::vector<double>& x) {
+      std::stringstream ss;
+      ss << label;
+      for (size_t i = 0; i < x.size(); i++)
+        ss << (i ? ", " : "") << x[i];
+      return ss.str();
+    }
+  }
+
+  /**
+   * Parallel tempering with NUTS: <code>num_temps</code> replicas of
+   * the model, replica k with its log density multiplied by an inverse
+   * temperature beta_k (1 = beta_0 > ... > beta_{K-1} =
+   * <code>beta_min</code>, geometric at first), each sampled by its own
+   * <code>Sampler</code> (stan::mcmc::adapt_diag_e_nuts or
+   * stan::mcmc::adapt_dense_e_nuts) on its own thread, up to the number
+   * of threads of the current task arena. As each replica has its own
+   * PRNG and the swaps are made on the calling thread, the draws do not
+   * depend on the number of threads.
+   *
+   * Every <code>swap_interval</code> iterations the replicas stop and
+   * swaps of the states of neighbouring replicas are proposed, for the
+   * even and the odd pairs in turn (the deterministic even-odd scheme),
+   * and accepted with the usual Metropolis probability. Only the
+   * untempered replica is written, through the same mcmc_writer calls as
+   * in stan::services::util::run_adaptive_sampler, so the output has the
+   * layout of NUTS; what it writes is kept on its thread and passed on
+   * to <code>sample_writer</code> and <code>logger</code> between
+   * rounds. The other replicas log nothing.
+   *
+   * During warmup each replica adapts its step size and metric as NUTS
+   * would on its own, and, with <code>adapt_temps</code>, the inner
+   * inverse temperatures are moved after 50, 100, 200, ... iterations
+   * (while the metric adaptation goes on) to equalize the swap rejection
+   * rates. The final inverse temperatures are written after the
+   * adaptation info, and the swap acceptance rates of the sampling
+   * iterations at the end.
+   */
+  template <template <class, class> class Sampler, class Model>
+  int hmc_nuts_pt(Model& model, const stan::io::var_context& init,
+                  const stan::io::var_context& init_inv_metric,
+                  unsigned int random_seed, unsigned int chain,
+                  double init_radius, int num_warmup, int num_samples,
+                  int num_thin, bool save_warmup, int refresh,
+                  double stepsize, double stepsize_jitter, int max_depth,
+                  bool adapt_engaged, double delta, double gamma,
+                  double kappa, double t0, unsigned int init_buffer,
+                  unsigned int term_buffer, unsigned int window,
+                  int num_temps, double beta_min, int swap_interval,
+                  bool adapt_temps,
+                  stan::callbacks::interrupt& interrupt,
+                  stan::callbacks::logger& logger,
+                  stan::callbacks::writer& init_writer,
+                  stan::callbacks::writer& sample_writer,
+                  stan::callbacks::writer& diagnostic_writer) {
+    typedef tempered_model<Model> tempered_t;
+    typedef Sampler<tempered_t, boost::random::mixmax> sampler_t;
+
+    boost::random::mixmax rng = stan::services::util::create_rng(random_seed,
+                                                                 chain);
+    std::vector<double> cont_vector
+      = stan::services::util::initialize(model, init, rng, init_radius, true,
+                                         logger, init_writer);
+    if (num_temps < 2) num_temps = 2;
+    if (swap_interval < 1) swap_interval = 1;
+    if (num_thin < 1) num_thin = 1;
+
+    std::vector<double> betas(num_temps);
+    for (int k = 0; k < num_temps; k++)
+      betas[k] = std::pow(beta_min, k / (num_temps - 1.0));
+
+    // the replicas keep references to their model and PRNG
+    std::vector<std::unique_ptr<tempered_t> > models;
+    std::vector<std::unique_ptr<boost::random::mixmax> > rngs;
+    std::vector<std::unique_ptr<sampler_t> > samplers;
+    std::vector<std::unique_ptr<stan::callbacks::logger> > loggers;
+    buffer_logger* cold_logger = nullptr;
+    for (int k = 0; k < num_temps; k++) {
+      models.emplace_back(std::make_unique<tempered_t>(model, betas[k]));
+      rngs.emplace_back(k == 0 ? std::make_unique<boost::random::mixmax>(rng)
+                        : std::make_unique<boost::random::mixmax>(random_seed,
+                                                                  chain, k, 2));
+      samplers.emplace_back(std::make_unique<sampler_t>(*models[k], *rngs[k]));
+      if (k == 0) {
+        std::unique_ptr<buffer_logger> cold = std::make_unique<buffer_logger>();
+        cold_logger = cold.get();
+        loggers.emplace_back(std::move(cold));
+      } else {
+        loggers.emplace_back(std::make_unique<stan::callbacks::logger>());
+      }
+      sampler_t& sampler = *samplers[k];
+      if (!configure_adapt_sampler(sampler, init_inv_metric,
+                                   model.num_params_r(), stepsize,
+                                   stepsize_jitter, max_depth, delta, gamma,
+                                   kappa, t0, logger))
+        return stan::services::error_codes::CONFIG;
+      sampler.set_window_params(num_warmup, init_buffer, term_buffer, window,
+                                logger);
+    }
+    boost::random::mixmax swap_rng(random_seed, chain, 0, 3);
+    boost::random::uniform_01<double> unif;
+
+    Eigen::Map<Eigen::VectorXd> cont_params(cont_vector.data(),
+                                            cont_vector.size());
+    std::vector<stan::mcmc::sample> states(num_temps,
+                                           stan::mcmc::sample(cont_params, 0, 0));
+    if (adapt_engaged && num_warmup > 0) {
+      for (int k = 0; k < num_temps; k++) {
+        samplers[k]->engage_adaptation();
+        try {
+          samplers[k]->z().q = cont_params;
+          samplers[k]->init_stepsize(logger);
+        } catch (const std::exception& e) {
+          logger.info("Exception initializing step size.");
+          logger.info(e.what());
+          return stan::services::error_codes::SOFTWARE;
+        }
+      }
+    }
+
+    buffer_writer cold_sample_buffer;
+    buffer_writer cold_diagnostic_buffer;
+    stan::services::util::mcmc_writer writer(cold_sample_buffer,
+                                             cold_diagnostic_buffer,
+                                             *cold_logger);
+    writer.write_sample_names(states[0], *samplers[0], *models[0]);
+    writer.write_diagnostic_names(states[0], *samplers[0], *models[0]);
+    cold_sample_buffer.flush(sample_writer);
+    cold_diagnostic_buffer.flush(diagnostic_writer);
+
+    std::vector<double> accept_sum(num_temps - 1, 0);
+    std::vector<double> accept_count(num_temps - 1, 0);
+    int next_ladder_update = 50;
+
+    auto start_warm = std::chrono::steady_clock::now();
+    auto start_sample = start_warm;
+    double warm_delta_t = 0;
+    auto finish_warmup = [&]() {
+      if (adapt_engaged && num_warmup > 0) {
+        for (int k = 0; k < num_temps; k++)
+          samplers[k]->disengage_adaptation();
+        writer.write_adapt_finish(*samplers[0]);
+        samplers[0]->write_sampler_state(cold_sample_buffer);
+      }
+      cold_sample_buffer(join_values("Inverse temperatures = ", betas));
+      cold_sample_buffer.flush(sample_writer);
+      std::fill(accept_sum.begin(), accept_sum.end(), 0);
+      std::fill(accept_count.begin(), accept_count.end(), 0);
+      start_sample = std::chrono::steady_clock::now();
+      warm_delta_t = std::chrono::duration_cast<std::chrono::milliseconds>(
+                       start_sample - start_warm).count() / 1000.0;
+    };
+    if (num_warmup == 0) finish_warmup();
+
+    const int num_iter = num_warmup + num_samples;
+    // at most one thread per replica, and no more than the current
+    // arena allows (see RcppParallel::setThreadOptions)
+    tbb::task_arena arena(std::min(num_temps,
+                                   tbb::this_task_arena::max_concurrency()));
+    for (int m = 0, round = 0; m < num_iter; round++) {
+      interrupt();
+      const bool warmup = m < num_warmup;
+      const int end = std::min(m + swap_interval,
+                               warmup ? num_warmup : num_iter);
+      arena.execute([&] {
+        tbb::parallel_for(tbb::blocked_range<int>(0, num_temps, 1),
+                          [&](const tbb::blocked_range<int>& r) {
+          stan::math::ChainableStack ad_tape;
+          for (int k = r.begin(); k != r.end(); ++k) {
+            for (int i = m; i < end; ++i) {
+              states[k] = samplers[k]->transition(states[k], *loggers[k]);
+              if (k > 0) continue;
+              int it = warmup ? i : i - num_warmup;
+              if ((warmup ? save_warmup : true) && it % num_thin == 0) {
+                writer.write_sample_params(*rngs[0], states[0], *samplers[0],
+                                           *models[0]);
+                writer.write_diagnostic_params(states[0], *samplers[0]);
+              }
+            }
+          }
+        });
+      });
+      cold_logger->flush(logger);
+      for (int i = m; i < end; ++i)
+        report_pt_progress(i, num_warmup, num_iter, refresh, logger);
+      cold_sample_buffer.flush(sample_writer);
+      cold_diagnostic_buffer.flush(diagnostic_writer);
+      m = end;
+
+      for (int k = round % 2; k + 1 < num_temps; k += 2) {
+        double lp_k = states[k].log_prob() / betas[k];
+        double lp_k1 = states[k + 1].log_prob() / betas[k + 1];
+        double alpha = swap_acceptance(betas[k], betas[k + 1], lp_k, lp_k1);
+        accept_sum[k] += alpha;
+        accept_count[k] += 1;
+        if (unif(swap_rng) < alpha) {
+          stan::mcmc::sample s_k(states[k + 1].cont_params(), betas[k] * lp_k1,
+                                 states[k].accept_stat());
+          stan::mcmc::sample s_k1(states[k].cont_params(), betas[k + 1] * lp_k,
+                                  states[k + 1].accept_stat());
+          states[k] = s_k;
+          states[k + 1] = s_k1;
+        }
+      }
+
+      if (warmup && adapt_engaged && adapt_temps && num_temps > 2
+          && m >= next_ladder_update
+          && m + static_cast<int>(term_buffer) <= num_warmup) {
+        std::vector<double> rejection(num_temps - 1);
+        for (int k = 0; k + 1 < num_temps; k++)
+          rejection[k] = accept_count[k] > 0
+                         ? 1 - accept_sum[k] / accept_count[k] : 0;
+        equalize_ladder(betas, rejection);
+        for (int k = 0; k < num_temps; k++)
+          models[k]->set_beta(betas[k]);
+        std::fill(accept_sum.begin(), accept_sum.end(), 0);
+        std::fill(accept_count.begin(), accept_count.end(), 0);
+        next_ladder_update *= 2;
+      }
+      if (warmup && m == num_warmup) finish_warmup();
+    }
+    auto end_sample = std::chrono::steady_clock::now();
+    double sample_delta_t = std::chrono::duration_cast<std::chrono::milliseconds>(
+                              end_sample - start_sample).count() / 1000.0;
+
+    std::vector<double> accept_rate(num_temps - 1);
+    for (int k = 0; k + 1 < num_temps; k++)
+      accept_rate[k] = accept_count[k] > 0 ? accept_sum[k] / accept_count[k] : 0;
+    std::string rates = join_values("Swap acceptance rates = ", accept_rate);
+    logger.info(rates);
+    cold_sample_buffer(rates);
+    writer.write_timing(warm_delta_t, sample_delta_t);
+    cold_logger->flush(logger);
+    cold_sample_buffer.flush(sample_writer);
+    cold_diagnostic_buffer.flush(diagnostic_writer);
+    return stan::services::error_codes::OK;
+  }
+
+}
+#endif
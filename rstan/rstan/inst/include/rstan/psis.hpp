@@ -0,0 +1,175 @@
+#ifndef RSTAN_PSIS_HPP
+#define RSTAN_PSIS_HPP
+
+#include <stan/math/prim/fun/Eigen.hpp>
+#include <stan/math/rev/core/chainablestack.hpp>
+#include <stan/model/log_prob_propto.hpp>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace rstan {
+
+  /**
+   * Evaluate the log density (up to a constant, with the Jacobian of
+   * the constraining transform, as stan_fit::log_prob does) at every
+   * row of <code>upars</code>, splitting the rows over
+   * <code>n_threads</code> threads. Rows at which the model throws get
+   * -inf and their error message in <code>errors</code>.
+   *
+   * Nothing in here touches R.
+   */
+  template <class Model>
+  void parallel_log_prob(const Model& model,
+                         const Eigen::Ref<const Eigen::MatrixXd>& upars,
+                         int n_threads, std::vector<double>& lp,
+                         std::vector<std::string>& errors) {
+    const size_t N = upars.rows();
+    lp.assign(N, -std::numeric_limits<double>::infinity());
+    errors.assign(N, std::string());
+    if (n_threads < 1) n_threads = 1;
+
+    tbb::task_arena arena(n_threads);
+    arena.execute([&] {
+      tbb::parallel_for(tbb::blocked_range<size_t>(0, N),
+                        [&](const tbb::blocked_range<size_t>& r) {
+        stan::math::ChainableStack ad_tape;
+        std::vector<double> params_r(upars.cols());
+        std::vector<int> params_i(model.num_params_i(), 0);
+        for (size_t i = r.begin(); i != r.end(); ++i) {
+          std::stringstream msg;
+          try {
+            for (size_t k = 0; k < params_r.size(); k++)
+              params_r[k] = upars(i, k);
+            lp[i] = stan::model::log_prob_propto<true>(model, params_r,
+                                                       params_i, &msg);
+          } catch (const std::exception& e) {
+            errors[i] = e.what();
+          }
+        }
+      });
+    });
+  }
+
+  namespace {
+    /**
+     * Fit a generalized Pareto distribution to the sorted, positive
+     * <code>x</code> by the empirical Bayes method of Zhang and
+     * Stephens (2009), with k shrunk towards 0.5 as in the loo package.
+     */
+    void gpd_fit(const std::vector<double>& x, double& k, double& sigma) {
+      const size_t n = x.size();
+      const double prior = 3;
+      const size_t m = 30 + static_cast<size_t>(std::sqrt(n));
+      const double x_star = x[static_cast<size_t>(n / 4.0 + 0.5) - 1];
+      std::vector<double> theta(m), l_theta(m);
+      for (size_t j = 0; j < m; j++) {
+        theta[j] = 1 / x[n - 1]
+                   + (1 - std::sqrt(m / (j + 0.5))) / prior / x_star;
+        double kj = 0;
+        for (size_t i = 0; i < n; i++)
+          kj += std::log1p(-theta[j] * x[i]);
+        kj /= n;
+        l_theta[j] = n * (std::log(-theta[j] / kj) - kj - 1);
+      }
+      double l_max = *std::max_element(l_theta.begin(), l_theta.end());
+      double w_sum = 0, theta_hat = 0;
+      for (size_t j = 0; j < m; j++) {
+        double w = std::exp(l_theta[j] - l_max);
+        w_sum += w;
+        theta_hat += theta[j] * w;
+      }
+      theta_hat /= w_sum;
+      k = 0;
+      for (size_t i = 0; i < n; i++)
+        k += std::log1p(-theta_hat * x[i]);
+      k /= n;
+      sigma = -k / theta_hat;
+      k = (n * k + 10 * 0.5) / (n + 10);
+      if (std::isnan(k)) k = std::numeric_limits<double>::infinity();
+    }
+  }
+
+  /**
+   * The fewest importance ratios whose tail, min(S / 5, 3 sqrt(S)) of
+   * them, has the 5 values that the loo package requires for a fit.
+   */
+  const size_t psis_min_draws = 21;
+
+  /**
+   * Pareto smoothed importance sampling (Vehtari et al., 2024): the
+   * largest min(S / 5, 3 sqrt(S)) of the S log importance ratios are
+   * replaced by the expected order statistics of a generalized Pareto
+   * distribution fitted to them, all are truncated at the largest raw
+   * ratio, and the result is normalized so that the weights sum to 1.
+   *
+   * With fewer than psis_min_draws ratios the tail is too short to fit
+   * a distribution to: the weights are only truncated and normalized
+   * and the returned k is NaN, so that the caller can tell this from a
+   * bad fit.
+   *
+   * @param[in,out] log_w The log importance ratios; on output, the
+   *   smoothed log weights
+   * @return The estimated shape k of the tail, the diagnostic of the
+   *   reliability of the weights; infinite if it cannot be estimated,
+   *   NaN if there are too few ratios to estimate it
+   */
+  inline double psis_smooth(std::vector<double>& log_w) {
+    const size_t S = log_w.size();
+    double k = std::numeric_limits<double>::infinity();
+    if (S == 0) return k;
+    const double max_lw = *std::max_element(log_w.begin(), log_w.end());
+    if (!std::isfinite(max_lw)) return k;
+    for (size_t s = 0; s < S; s++) log_w[s] -= max_lw;
+
+    const size_t tail_len = static_cast<size_t>(
+      std::ceil(std::min(0.2 * S, 3 * std::sqrt(static_cast<double>(S)))));
+    if (S < psis_min_draws) {
+      k = std::numeric_limits<double>::quiet_NaN();
+    } else {
+      std::vector<size_t> ord(S);
+      std::iota(ord.begin(), ord.end(), 0);
+      std::nth_element(ord.begin(), ord.begin() + (S - tail_len - 1),
+                       ord.end(), [&](size_t a, size_t b) {
+                         return log_w[a] < log_w[b];
+                       });
+      std::sort(ord.begin() + (S - tail_len), ord.end(),
+                [&](size_t a, size_t b) { return log_w[a] < log_w[b]; });
+      const double cutoff = log_w[ord[S - tail_len - 1]];
+      const double exp_cutoff = std::exp(cutoff);
+      std::vector<double> tail(tail_len);
+      for (size_t i = 0; i < tail_len; i++)
+        tail[i] = std::exp(log_w[ord[S - tail_len + i]]) - exp_cutoff;
+      if (tail.back() - tail.front() > 0) {
+        double sigma;
+        gpd_fit(tail, k, sigma);
+        if (std::isfinite(k) && sigma > 0) {
+          for (size_t i = 0; i < tail_len; i++) {
+            double p = (i + 0.5) / tail_len;
+            double q = k == 0 ? -sigma * std::log1p(-p)
+                       : sigma * std::expm1(-k * std::log1p(-p)) / k;
+            log_w[ord[S - tail_len + i]] = std::log(q + exp_cutoff);
+          }
+        }
+      }
+    }
+
+    double sum = 0;
+    for (size_t s = 0; s < S; s++) {
+      if (log_w[s] > 0) log_w[s] = 0;
+      sum += std::exp(log_w[s]);
+    }
+    const double log_sum = std::log(sum);
+    for (size_t s = 0; s < S; s++) log_w[s] -= log_sum;
+    return k;
+  }
+
+}
+#endif
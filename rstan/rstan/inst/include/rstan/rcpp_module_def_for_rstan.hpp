@@ -25,6 +25,8 @@ RCPP_MODULE(stan_fit4%model_name%_mod){
     .method("unconstrained_param_names", &rstan::stan_fit<stan_model, boost::random::mixmax>::unconstrained_param_names)
     .method("constrained_param_names", &rstan::stan_fit<stan_model, boost::random::mixmax>::constrained_param_names)
     .method("standalone_gqs", &rstan::stan_fit<stan_model, boost::random::mixmax>::standalone_gqs)
+    .method("parallel_gqs", &rstan::stan_fit<stan_model, boost::random::mixmax>::parallel_gqs)
+    .method("sbc", &rstan::stan_fit<stan_model, boost::random::mixmax>::sbc)
   ;
 }
 */
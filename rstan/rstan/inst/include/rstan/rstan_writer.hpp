@@ -7,6 +7,7 @@
 #include <rstan/comment_writer.hpp>
 #include <rstan/filtered_values.hpp>
 #include <rstan/sum_values.hpp>
+#include <rstan/typed_values.hpp>
 
 namespace rstan {
 
@@ -14,13 +15,13 @@ namespace rstan {
   public:
     stan::callbacks::stream_writer csv_;
     comment_writer comment_writer_;
-    filtered_values<Rcpp::NumericVector> values_;
+    typed_filtered_values values_;
     filtered_values<Rcpp::NumericVector> sampler_values_;
     sum_values sum_;
 
     rstan_sample_writer(stan::callbacks::stream_writer csv,
                         comment_writer comment_writer,
-                        filtered_values<Rcpp::NumericVector> values,
+                        typed_filtered_values values,
                         filtered_values<Rcpp::NumericVector> sampler_values,
                         sum_values sum)
       : csv_(csv), comment_writer_(comment_writer),
@@ -81,6 +82,9 @@ namespace rstan {
      @param      N
      @param      M  number of iterations to be saved
      @param      warmup number of warmup iterations to be saved
+     @param      int_columns which constrained parameters are integers,
+                 to be kept as such (see int_columns()); all are doubles
+                 if empty
   */
   inline
   rstan_sample_writer*
@@ -90,7 +94,9 @@ namespace rstan {
                         size_t N_sample_names, size_t N_sampler_names,
                         size_t N_constrained_param_names,
                         size_t N_iter_save, size_t warmup,
-                        const std::vector<size_t>& qoi_idx) {
+                        const std::vector<size_t>& qoi_idx,
+                        const std::vector<bool>& int_columns
+                          = std::vector<bool>()) {
     size_t N = N_sample_names + N_sampler_names + N_constrained_param_names;
     size_t offset = N_sample_names + N_sampler_names;
 
@@ -99,6 +105,11 @@ namespace rstan {
     for (size_t n = 0; n < filter.size(); n++)
       if (filter[n] >= N)
         lp.push_back(n);
+    std::vector<bool> is_int;
+    if (int_columns.size() == N_constrained_param_names)
+      for (size_t n = 0; n < filter.size(); n++)
+        is_int.push_back(filter[n] < N_constrained_param_names
+                         && int_columns[filter[n]]);
     for (size_t n = 0; n < filter.size(); n++)
       filter[n] += offset;
     for (size_t n = 0; n < lp.size(); n++)
@@ -110,7 +121,7 @@ namespace rstan {
 
     stan::callbacks::stream_writer csv(*csv_fstream, prefix);
     comment_writer comments(comment_stream, prefix);
-    filtered_values<Rcpp::NumericVector> values(N, N_iter_save, filter);
+    typed_filtered_values values(N, N_iter_save, filter, is_int);
     filtered_values<Rcpp::NumericVector> sampler_values(N, N_iter_save, filter_sampler_values);
     sum_values sum(N, warmup);
 
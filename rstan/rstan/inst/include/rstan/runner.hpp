@@ -0,0 +1,262 @@
+#ifndef RSTAN_RUNNER_HPP
+#define RSTAN_RUNNER_HPP
+
+// A command-line driver for a model compiled without R; see
+// stan_runner() in R/runner.R, which compiles the C++ code of a
+// stanmodel together with
+//
+//   int main(int argc, const char* argv[]) {
+//     return rstan::runner_main<stan_model>(argc, argv);
+//   }
+//
+// Nothing here may depend on R or Rcpp.
+
+#include <stan/callbacks/interrupt.hpp>
+#include <stan/callbacks/stream_logger.hpp>
+#include <stan/callbacks/stream_writer.hpp>
+#include <stan/io/dump.hpp>
+#include <stan/io/empty_var_context.hpp>
+#include <stan/services/error_codes.hpp>
+#include <stan/services/optimize/bfgs.hpp>
+#include <stan/services/optimize/lbfgs.hpp>
+#include <stan/services/optimize/newton.hpp>
+#include <stan/services/sample/fixed_param.hpp>
+#include <stan/services/sample/hmc_nuts_dense_e.hpp>
+#include <stan/services/sample/hmc_nuts_dense_e_adapt.hpp>
+#include <stan/services/sample/hmc_nuts_diag_e.hpp>
+#include <stan/services/sample/hmc_nuts_diag_e_adapt.hpp>
+#include <stan/services/sample/hmc_nuts_unit_e.hpp>
+#include <stan/services/sample/hmc_nuts_unit_e_adapt.hpp>
+#include <stan/services/util/create_unit_e_dense_inv_metric.hpp>
+#include <stan/services/util/create_unit_e_diag_inv_metric.hpp>
+#include <stan/version.hpp>
+#include <rstan/runner_args.hpp>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace rstan {
+
+  inline std::unique_ptr<stan::io::var_context>
+  read_rdump_file(const std::string& file) {
+    std::ifstream in(file.c_str());
+    if (!in)
+      throw std::invalid_argument("cannot open '" + file + "'");
+    return std::unique_ptr<stan::io::var_context>(new stan::io::dump(in));
+  }
+
+  template <class Model>
+  int runner_run(const runner_args& args) {
+    const std::string method = args.get_string("method", "sampling");
+    const std::string data_file = args.get_string("data", "");
+    const std::string init = args.get_string("init", "random");
+    const std::string output = args.get_string("output", "output.csv");
+    const std::string format = args.get_string("format", "csv");
+    unsigned int seed = args.get_uint("seed", 1234);
+    unsigned int id = args.get_uint("chain_id", 1);
+    int refresh = args.get_int("refresh", 100);
+    int iter = args.get_int("iter", 2000);
+
+    stan::callbacks::interrupt interrupt;
+    stan::callbacks::stream_logger logger(std::cout, std::cout, std::cout,
+                                          std::cerr, std::cerr);
+    stan::callbacks::writer init_writer;
+    stan::callbacks::writer diagnostic_writer;
+
+    std::unique_ptr<stan::io::var_context> data_context;
+    if (data_file.empty())
+      data_context.reset(new stan::io::empty_var_context());
+    else
+      data_context = read_rdump_file(data_file);
+
+    double init_radius = args.get_double("init_r", 2.0);
+    std::unique_ptr<stan::io::var_context> init_context;
+    if (init == "0") {
+      init_radius = 0;
+      init_context.reset(new stan::io::empty_var_context());
+    } else if (init == "random") {
+      init_context.reset(new stan::io::empty_var_context());
+    } else {
+      init_context = read_rdump_file(init);
+    }
+
+    std::ofstream out(output.c_str(), std::ios::out | std::ios::binary);
+    if (!out)
+      throw std::invalid_argument("cannot open '" + output + "'");
+    std::unique_ptr<stan::callbacks::writer> sample_writer;
+    if (format == "csv")
+      sample_writer.reset(new stan::callbacks::stream_writer(out, "# "));
+    else if (format == "binary")
+      sample_writer.reset(new binary_writer(out));
+    else
+      throw std::invalid_argument("format must be \"csv\" or \"binary\"");
+
+    std::stringstream msg;
+    Model model(*data_context, seed, &msg);
+    if (msg.str().length() > 0) logger.info(msg);
+
+    (*sample_writer)("stan_version_major=" + stan::MAJOR_VERSION);
+    (*sample_writer)("stan_version_minor=" + stan::MINOR_VERSION);
+    (*sample_writer)("stan_version_patch=" + stan::PATCH_VERSION);
+    (*sample_writer)("model=" + model.model_name());
+
+    int return_code = stan::services::error_codes::CONFIG;
+    if (method == "optimizing") {
+      const std::string algorithm = args.get_string("algorithm", "LBFGS");
+      bool save_iterations = args.get_bool("save_iterations", false);
+      double init_alpha = args.get_double("init_alpha", 0.001);
+      double tol_obj = args.get_double("tol_obj", 1e-12);
+      double tol_rel_obj = args.get_double("tol_rel_obj", 1e4);
+      double tol_grad = args.get_double("tol_grad", 1e-8);
+      double tol_rel_grad = args.get_double("tol_rel_grad", 1e7);
+      double tol_param = args.get_double("tol_param", 1e-8);
+      int history_size = args.get_int("history_size", 5);
+      args.check_all_used();
+      args.write_as_comment(*sample_writer);
+      if (algorithm == "Newton") {
+        return_code = stan::services::optimize::newton(
+            model, *init_context, seed, id, init_radius, iter,
+            save_iterations, interrupt, logger, init_writer, *sample_writer);
+      } else if (algorithm == "BFGS") {
+        return_code = stan::services::optimize::bfgs(
+            model, *init_context, seed, id, init_radius, init_alpha, tol_obj,
+            tol_rel_obj, tol_grad, tol_rel_grad, tol_param, iter,
+            save_iterations, refresh, interrupt, logger, init_writer,
+            *sample_writer);
+      } else if (algorithm == "LBFGS") {
+        return_code = stan::services::optimize::lbfgs(
+            model, *init_context, seed, id, init_radius, history_size,
+            init_alpha, tol_obj, tol_rel_obj, tol_grad, tol_rel_grad,
+            tol_param, iter, save_iterations, refresh, interrupt, logger,
+            init_writer, *sample_writer);
+      } else {
+        throw std::invalid_argument("algorithm must be \"LBFGS\", \"BFGS\" "
+                                    "or \"Newton\" for optimizing");
+      }
+    } else if (method == "sampling") {
+      const std::string algorithm = args.get_string("algorithm", "NUTS");
+      int num_warmup = args.get_int("warmup", iter / 2);
+      int num_samples = iter - num_warmup;
+      int num_thin = args.get_int("thin", 1);
+      bool save_warmup = args.get_bool("save_warmup", true);
+      if (num_samples < 0 || num_thin < 1)
+        throw std::invalid_argument("warmup must not exceed iter and thin "
+                                    "must be positive");
+      if (algorithm == "Fixed_param") {
+        args.check_all_used();
+        args.write_as_comment(*sample_writer);
+        return_code = stan::services::sample::fixed_param(
+            model, *init_context, seed, id, init_radius, num_samples,
+            num_thin, refresh, interrupt, logger, init_writer,
+            *sample_writer, diagnostic_writer);
+      } else if (algorithm == "NUTS") {
+        const std::string metric = args.get_string("metric", "diag_e");
+        bool adapt_engaged = args.get_bool("adapt_engaged", true);
+        double stepsize = args.get_double("stepsize", 1);
+        double stepsize_jitter = args.get_double("stepsize_jitter", 0);
+        int max_depth = args.get_int("max_treedepth", 10);
+        double delta = args.get_double("adapt_delta", 0.8);
+        double gamma = args.get_double("adapt_gamma", 0.05);
+        double kappa = args.get_double("adapt_kappa", 0.75);
+        double t0 = args.get_double("adapt_t0", 10);
+        unsigned int init_buffer = args.get_uint("adapt_init_buffer", 75);
+        unsigned int term_buffer = args.get_uint("adapt_term_buffer", 50);
+        unsigned int window = args.get_uint("adapt_window", 25);
+        const std::string inv_metric_file = args.get_string("inv_metric", "");
+        args.check_all_used();
+        args.write_as_comment(*sample_writer);
+
+        std::unique_ptr<stan::io::var_context> inv_metric;
+        if (!inv_metric_file.empty())
+          inv_metric = read_rdump_file(inv_metric_file);
+        else if (metric == "dense_e")
+          inv_metric.reset(new stan::io::dump(
+            stan::services::util::create_unit_e_dense_inv_metric(
+              model.num_params_r())));
+        else
+          inv_metric.reset(new stan::io::dump(
+            stan::services::util::create_unit_e_diag_inv_metric(
+              model.num_params_r())));
+
+        if (metric == "dense_e" && adapt_engaged) {
+          return_code = stan::services::sample::hmc_nuts_dense_e_adapt(
+              model, *init_context, *inv_metric, seed, id, init_radius,
+              num_warmup, num_samples, num_thin, save_warmup, refresh,
+              stepsize, stepsize_jitter, max_depth, delta, gamma, kappa, t0,
+              init_buffer, term_buffer, window, interrupt, logger,
+              init_writer, *sample_writer, diagnostic_writer);
+        } else if (metric == "dense_e") {
+          return_code = stan::services::sample::hmc_nuts_dense_e(
+              model, *init_context, *inv_metric, seed, id, init_radius,
+              num_warmup, num_samples, num_thin, save_warmup, refresh,
+              stepsize, stepsize_jitter, max_depth, interrupt, logger,
+              init_writer, *sample_writer, diagnostic_writer);
+        } else if (metric == "diag_e" && adapt_engaged) {
+          return_code = stan::services::sample::hmc_nuts_diag_e_adapt(
+              model, *init_context, *inv_metric, seed, id, init_radius,
+              num_warmup, num_samples, num_thin, save_warmup, refresh,
+              stepsize, stepsize_jitter, max_depth, delta, gamma, kappa, t0,
+              init_buffer, term_buffer, window, interrupt, logger,
+              init_writer, *sample_writer, diagnostic_writer);
+        } else if (metric == "diag_e") {
+          return_code = stan::services::sample::hmc_nuts_diag_e(
+              model, *init_context, *inv_metric, seed, id, init_radius,
+              num_warmup, num_samples, num_thin, save_warmup, refresh,
+              stepsize, stepsize_jitter, max_depth, interrupt, logger,
+              init_writer, *sample_writer, diagnostic_writer);
+        } else if (metric == "unit_e" && adapt_engaged) {
+          return_code = stan::services::sample::hmc_nuts_unit_e_adapt(
+              model, *init_context, seed, id, init_radius,
+              num_warmup, num_samples, num_thin, save_warmup, refresh,
+              stepsize, stepsize_jitter, max_depth, delta, gamma, kappa, t0,
+              interrupt, logger, init_writer, *sample_writer,
+              diagnostic_writer);
+        } else if (metric == "unit_e") {
+          return_code = stan::services::sample::hmc_nuts_unit_e(
+              model, *init_context, seed, id, init_radius,
+              num_warmup, num_samples, num_thin, save_warmup, refresh,
+              stepsize, stepsize_jitter, max_depth, interrupt, logger,
+              init_writer, *sample_writer, diagnostic_writer);
+        } else {
+          throw std::invalid_argument("metric must be \"diag_e\", "
+                                      "\"dense_e\" or \"unit_e\"");
+        }
+      } else {
+        throw std::invalid_argument("algorithm must be \"NUTS\" or "
+                                    "\"Fixed_param\" for sampling");
+      }
+    } else {
+      throw std::invalid_argument("method must be \"sampling\" or "
+                                  "\"optimizing\"");
+    }
+    out.flush();
+    if (!out)
+      throw std::runtime_error("cannot write to '" + output + "'");
+    return return_code;
+  }
+
+  /**
+   * Run the model as the options on the command line say and return
+   * the exit status: that of the service, or
+   * stan::services::error_codes::USAGE if the options are wrong.
+   */
+  template <class Model>
+  int runner_main(int argc, const char* argv[]) {
+    try {
+      runner_args args(argc, argv);
+      return runner_run<Model>(args);
+    } catch (const std::invalid_argument& e) {
+      std::cerr << "Error: " << e.what() << std::endl;
+      return stan::services::error_codes::USAGE;
+    } catch (const std::exception& e) {
+      std::cerr << "Error: " << e.what() << std::endl;
+      return stan::services::error_codes::SOFTWARE;
+    }
+  }
+
+}
+#endif
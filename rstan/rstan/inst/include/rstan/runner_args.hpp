@@ -0,0 +1,143 @@
+#ifndef RSTAN_RUNNER_ARGS_HPP
+#define RSTAN_RUNNER_ARGS_HPP
+
+// The options and the binary output of the runner in runner.hpp, apart
+// from the Stan services so that they can be tested on their own.
+
+#include <stan/callbacks/writer.hpp>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace rstan {
+
+  /**
+   * Writes the names once and then each draw as doubles in the native
+   * byte order, row after row: the 8 bytes "RSTANBIN", the number of
+   * columns as a 32-bit integer, the names each followed by a NUL byte,
+   * then the draws. The number of draws follows from the size of the
+   * file. Comments are dropped. read_stan_bin() reads it.
+   */
+  class binary_writer : public stan::callbacks::writer {
+  private:
+    std::ostream& o_;
+    size_t num_cols_;
+
+  public:
+    explicit binary_writer(std::ostream& o) : o_(o), num_cols_(0) { }
+
+    void operator()(const std::vector<std::string>& names) {
+      if (num_cols_ > 0)
+        throw std::logic_error("binary_writer: names written twice");
+      num_cols_ = names.size();
+      std::uint32_t n = num_cols_;
+      o_.write("RSTANBIN", 8);
+      o_.write(reinterpret_cast<const char*>(&n), sizeof(n));
+      for (size_t i = 0; i < names.size(); ++i)
+        o_.write(names[i].c_str(), names[i].size() + 1);
+    }
+
+    void operator()(const std::vector<double>& state) {
+      if (state.size() != num_cols_)
+        throw std::length_error("binary_writer: a draw does not match "
+                                "the names");
+      o_.write(reinterpret_cast<const char*>(state.data()),
+               state.size() * sizeof(double));
+    }
+
+    void operator()(const std::string& message) { }
+
+    void operator()() { }
+  };
+
+  /**
+   * The options of the runner, given on the command line as
+   * <code>name=value</code> with the names of the arguments of the
+   * sampling and optimizing methods (and of their control lists), plus
+   * data, init (a file, "random" or "0"), output and format ("csv" or
+   * "binary").
+   */
+  class runner_args {
+  private:
+    std::map<std::string, std::string> values_;
+    mutable std::map<std::string, bool> used_;
+
+    template <class T>
+    T get(const std::string& name, const T& def) const {
+      std::map<std::string, std::string>::const_iterator it
+        = values_.find(name);
+      if (it == values_.end()) return def;
+      used_[name] = true;
+      std::istringstream in(it->second);
+      T x;
+      if (!(in >> x) || !(in >> std::ws).eof())
+        throw std::invalid_argument("invalid value '" + it->second
+                                    + "' for " + name);
+      return x;
+    }
+
+  public:
+    runner_args(int argc, const char* argv[]) {
+      for (int i = 1; i < argc; ++i) {
+        const char* eq = std::strchr(argv[i], '=');
+        if (eq == NULL || eq == argv[i])
+          throw std::invalid_argument(std::string("expected name=value, got '")
+                                      + argv[i] + "'");
+        values_[std::string(argv[i], eq)] = std::string(eq + 1);
+      }
+    }
+
+    std::string get_string(const std::string& name,
+                           const std::string& def) const {
+      std::map<std::string, std::string>::const_iterator it
+        = values_.find(name);
+      if (it == values_.end()) return def;
+      used_[name] = true;
+      return it->second;
+    }
+
+    int get_int(const std::string& name, int def) const {
+      return get<int>(name, def);
+    }
+
+    unsigned int get_uint(const std::string& name, unsigned int def) const {
+      return get<unsigned int>(name, def);
+    }
+
+    double get_double(const std::string& name, double def) const {
+      return get<double>(name, def);
+    }
+
+    bool get_bool(const std::string& name, bool def) const {
+      std::string x = get_string(name, def ? "1" : "0");
+      if (x == "1" || x == "TRUE" || x == "true") return true;
+      if (x == "0" || x == "FALSE" || x == "false") return false;
+      throw std::invalid_argument("invalid value '" + x + "' for " + name);
+    }
+
+    /**
+     * Throw if an option was given that nothing asked for, most likely
+     * a misspelling.
+     */
+    void check_all_used() const {
+      for (std::map<std::string, std::string>::const_iterator it
+             = values_.begin(); it != values_.end(); ++it)
+        if (!used_[it->first])
+          throw std::invalid_argument("unknown or unused option '"
+                                      + it->first + "'");
+    }
+
+    void write_as_comment(stan::callbacks::writer& writer) const {
+      for (std::map<std::string, std::string>::const_iterator it
+             = values_.begin(); it != values_.end(); ++it)
+        writer(it->first + "=" + it->second);
+    }
+  };
+
+}
+#endif
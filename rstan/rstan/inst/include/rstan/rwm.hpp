@@ -0,0 +1,269 @@
+#ifndef RSTAN_RWM_HPP
+#define RSTAN_RWM_HPP
+
+#include <stan/callbacks/interrupt.hpp>
+#include <stan/callbacks/logger.hpp>
+#include <stan/callbacks/writer.hpp>
+#include <stan/io/var_context.hpp>
+#include <stan/mcmc/base_adapter.hpp>
+#include <stan/mcmc/base_mcmc.hpp>
+#include <stan/mcmc/covar_adaptation.hpp>
+#include <stan/mcmc/sample.hpp>
+#include <stan/mcmc/stepsize_adaptation.hpp>
+#include <stan/model/log_prob_propto.hpp>
+#include <stan/services/error_codes.hpp>
+#include <stan/services/util/create_rng.hpp>
+#include <stan/services/util/generate_transitions.hpp>
+#include <stan/services/util/initialize.hpp>
+#include <stan/services/util/mcmc_writer.hpp>
+#include <boost/random/mixmax.hpp>
+#include <boost/random/normal_distribution.hpp>
+#include <boost/random/uniform_01.hpp>
+#include <boost/random/variate_generator.hpp>
+#include <Eigen/Dense>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace rstan {
+
+  /**
+   * Random walk Metropolis with a multivariate normal proposal,
+   * <code>q + epsilon * L * z</code> with z standard normal and L the
+   * Cholesky factor of the proposal covariance. Only the log density
+   * is evaluated, not its gradient. It drops the constant terms, so
+   * that lp__ is the same as with the other samplers; this takes
+   * stan::model::log_prob_propto, which evaluates the log density with
+   * autodiff variables (with doubles every term would be dropped) but
+   * without the reverse pass.
+   *
+   * When adaptation is engaged, the proposal covariance is estimated
+   * with the windows of stan::mcmc::covar_adaptation, as the dense
+   * metric of NUTS is, and the scale epsilon is adapted by the dual
+   * averaging of stan::mcmc::stepsize_adaptation towards the
+   * acceptance rate <code>delta</code> (0.234, or 0.44 in one
+   * dimension, being optimal for normal targets); both are restarted
+   * each time the covariance is updated.
+   */
+  template <class Model, class BaseRNG>
+  class adapt_rwm : public stan::mcmc::base_mcmc,
+                    public stan::mcmc::base_adapter {
+  private:
+    const Model& model_;
+    BaseRNG& rand_int_;
+    boost::variate_generator<BaseRNG&, boost::normal_distribution<> >
+      rand_gaus_;
+    boost::uniform_01<BaseRNG&> rand_uniform_;
+    Eigen::VectorXd q_;
+    double lp_;
+    Eigen::MatrixXd covar_;
+    Eigen::MatrixXd chol_;
+    double epsilon_;
+    stan::mcmc::stepsize_adaptation stepsize_adaptation_;
+    stan::mcmc::covar_adaptation covar_adaptation_;
+
+    double log_prob(const Eigen::VectorXd& q, stan::callbacks::logger& logger) {
+      std::vector<double> params_r(q.data(), q.data() + q.size());
+      std::vector<int> params_i;
+      std::stringstream msg;
+      double lp;
+      try {
+        lp = stan::model::log_prob_propto<true>(model_, params_r, params_i,
+                                                &msg);
+      } catch (const std::exception& e) {
+        msg << "Informational Message: The current Metropolis proposal is "
+            << "about to be rejected because of the following issue:"
+            << std::endl << e.what();
+        lp = -std::numeric_limits<double>::infinity();
+      }
+      if (msg.str().length() > 0) logger.info(msg);
+      return std::isnan(lp) ? -std::numeric_limits<double>::infinity() : lp;
+    }
+
+  public:
+    adapt_rwm(const Model& model, BaseRNG& rng)
+      : model_(model), rand_int_(rng),
+        rand_gaus_(rand_int_, boost::normal_distribution<>()),
+        rand_uniform_(rand_int_),
+        q_(model.num_params_r()), lp_(0),
+        covar_(Eigen::MatrixXd::Identity(model.num_params_r(),
+                                         model.num_params_r())),
+        chol_(covar_), epsilon_(1),
+        covar_adaptation_(model.num_params_r()) {
+      q_.setConstant(std::numeric_limits<double>::quiet_NaN());
+    }
+
+    void set_nominal_stepsize(double e) {
+      if (e > 0) epsilon_ = e;
+    }
+
+    double get_nominal_stepsize() const {
+      return epsilon_;
+    }
+
+    stan::mcmc::stepsize_adaptation& get_stepsize_adaptation() {
+      return stepsize_adaptation_;
+    }
+
+    void set_window_params(unsigned int num_warmup, unsigned int init_buffer,
+                           unsigned int term_buffer, unsigned int base_window,
+                           stan::callbacks::logger& logger) {
+      covar_adaptation_.set_window_params(num_warmup, init_buffer,
+                                          term_buffer, base_window, logger);
+    }
+
+    stan::mcmc::sample transition(stan::mcmc::sample& init_sample,
+                                  stan::callbacks::logger& logger) {
+      // the sample passed back is normally the one returned last
+      if (!(init_sample.cont_params().array() == q_.array()).all()) {
+        q_ = init_sample.cont_params();
+        lp_ = log_prob(q_, logger);
+      }
+
+      Eigen::VectorXd z(q_.size());
+      for (int i = 0; i < z.size(); ++i)
+        z(i) = rand_gaus_();
+      Eigen::VectorXd q_new = q_ + epsilon_ * (chol_ * z);
+      double lp_new = log_prob(q_new, logger);
+      double accept_prob = lp_new >= lp_ ? 1 : std::exp(lp_new - lp_);
+      if (rand_uniform_() < accept_prob) {
+        q_ = q_new;
+        lp_ = lp_new;
+      }
+
+      if (this->adapt_flag_) {
+        stepsize_adaptation_.learn_stepsize(epsilon_, accept_prob);
+        if (covar_adaptation_.learn_covariance(covar_, q_)) {
+          chol_ = covar_.llt().matrixL();
+          stepsize_adaptation_.set_mu(std::log(10 * epsilon_));
+          stepsize_adaptation_.restart();
+        }
+      }
+      return stan::mcmc::sample(q_, lp_, accept_prob);
+    }
+
+    void disengage_adaptation() {
+      stan::mcmc::base_adapter::disengage_adaptation();
+      stepsize_adaptation_.complete_adaptation(epsilon_);
+    }
+
+    void get_sampler_param_names(std::vector<std::string>& names) {
+      names.push_back("stepsize__");
+    }
+
+    void get_sampler_params(std::vector<double>& values) {
+      values.push_back(epsilon_);
+    }
+
+    void write_sampler_state(stan::callbacks::writer& writer) {
+      std::stringstream stepsize;
+      stepsize << "Step size = " << epsilon_;
+      writer(stepsize.str());
+      writer("Elements of proposal covariance matrix (before scaling by the "
+             "square of the step size):");
+      for (int i = 0; i < covar_.rows(); ++i) {
+        std::stringstream row;
+        row << covar_(i, 0);
+        for (int j = 1; j < covar_.cols(); ++j)
+          row << ", " << covar_(i, j);
+        writer(row.str());
+      }
+    }
+  };
+
+  /**
+   * The initial scale of adapt_rwm: <code>stepsize * 2.38 / sqrt(D)</code>
+   * for D parameters, optimal for a normal target whose covariance is
+   * the proposal covariance.
+   */
+  inline double rwm_initial_stepsize(double stepsize, size_t num_params) {
+    return stepsize * 2.38 / std::sqrt(static_cast<double>(num_params));
+  }
+
+  /**
+   * The acceptance rate the scale of adapt_rwm is adapted to: 0.234,
+   * or 0.44 in one dimension, optimal for normal targets.
+   */
+  inline double rwm_target_accept(size_t num_params) {
+    return num_params == 1 ? 0.44 : 0.234;
+  }
+
+  /**
+   * Sample with adapt_rwm, laid out as the NUTS services of
+   * stan::services::sample. The initial scale is rwm_initial_stepsize()
+   * and the proposal covariance starts as the identity.
+   */
+  template <class Model>
+  int rwm(Model& model, const stan::io::var_context& init,
+          unsigned int random_seed, unsigned int chain, double init_radius,
+          int num_warmup, int num_samples, int num_thin, bool save_warmup,
+          int refresh, double stepsize, bool adapt_engaged, double gamma,
+          double kappa, double t0, unsigned int init_buffer,
+          unsigned int term_buffer, unsigned int window,
+          stan::callbacks::interrupt& interrupt,
+          stan::callbacks::logger& logger,
+          stan::callbacks::writer& init_writer,
+          stan::callbacks::writer& sample_writer,
+          stan::callbacks::writer& diagnostic_writer) {
+    boost::random::mixmax rng = stan::services::util::create_rng(random_seed,
+                                                                 chain);
+    std::vector<double> cont_vector
+      = stan::services::util::initialize(model, init, rng, init_radius, false,
+                                         logger, init_writer);
+
+    adapt_rwm<Model, boost::random::mixmax> sampler(model, rng);
+    sampler.set_nominal_stepsize(rwm_initial_stepsize(stepsize,
+                                                      model.num_params_r()));
+    sampler.get_stepsize_adaptation().set_mu(
+      std::log(10 * sampler.get_nominal_stepsize()));
+    sampler.get_stepsize_adaptation().set_delta(
+      rwm_target_accept(model.num_params_r()));
+    sampler.get_stepsize_adaptation().set_gamma(gamma);
+    sampler.get_stepsize_adaptation().set_kappa(kappa);
+    sampler.get_stepsize_adaptation().set_t0(t0);
+    sampler.set_window_params(num_warmup, init_buffer, term_buffer, window,
+                              logger);
+
+    stan::services::util::mcmc_writer writer(sample_writer, diagnostic_writer,
+                                             logger);
+    Eigen::Map<Eigen::VectorXd> cont_params(cont_vector.data(),
+                                            cont_vector.size());
+    stan::mcmc::sample s(cont_params, 0, 0);
+    writer.write_sample_names(s, sampler, model);
+    writer.write_diagnostic_names(s, sampler, model);
+
+    if (adapt_engaged) sampler.engage_adaptation();
+    auto start_warm = std::chrono::steady_clock::now();
+    stan::services::util::generate_transitions(sampler, num_warmup, 0,
+                                               num_warmup + num_samples,
+                                               num_thin, refresh, save_warmup,
+                                               true, writer, s, model, rng,
+                                               interrupt, logger);
+    auto end_warm = std::chrono::steady_clock::now();
+    double warm_delta_t = std::chrono::duration_cast<std::chrono::milliseconds>(
+                            end_warm - start_warm).count() / 1000.0;
+    if (adapt_engaged) {
+      sampler.disengage_adaptation();
+      writer.write_adapt_finish(sampler);
+      sampler.write_sampler_state(sample_writer);
+    }
+
+    auto start_sample = std::chrono::steady_clock::now();
+    stan::services::util::generate_transitions(sampler, num_samples,
+                                               num_warmup,
+                                               num_warmup + num_samples,
+                                               num_thin, refresh, true, false,
+                                               writer, s, model, rng,
+                                               interrupt, logger);
+    auto end_sample = std::chrono::steady_clock::now();
+    double sample_delta_t = std::chrono::duration_cast<std::chrono::milliseconds>(
+                              end_sample - start_sample).count() / 1000.0;
+    writer.write_timing(warm_delta_t, sample_delta_t);
+    return stan::services::error_codes::OK;
+  }
+
+}
+#endif
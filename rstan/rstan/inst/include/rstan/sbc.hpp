@@ -0,0 +1,180 @@
+#ifndef RSTAN_SBC_HPP
+#define RSTAN_SBC_HPP
+
+#include <stan/callbacks/interrupt.hpp>
+#include <stan/callbacks/logger.hpp>
+#include <stan/callbacks/writer.hpp>
+#include <stan/io/empty_var_context.hpp>
+#include <stan/math/rev/core/chainablestack.hpp>
+#include <stan/services/sample/hmc_nuts_dense_e_adapt.hpp>
+#include <stan/services/sample/hmc_nuts_diag_e_adapt.hpp>
+#include <rstan/stan_args.hpp>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace rstan {
+
+  /**
+   * The part of one simulation-based calibration run that sbc() keeps:
+   * for each element of <code>ranks_</code>, the number of (thinned)
+   * draws in which it is positive, the values of <code>pars_</code>
+   * and <code>y_</code> (constant over the draws), and the number of
+   * divergent transitions.
+   */
+  struct sbc_result {
+    std::vector<int> rank_counts;
+    std::vector<double> pars;
+    std::vector<double> y;
+    int num_divergent;
+    int return_code;
+    std::string error;
+
+    sbc_result() : num_divergent(0), return_code(-1) { }
+  };
+
+  /**
+   * A sample writer for the sbc runner that reduces the draws to an
+   * sbc_result as they come, so nothing per draw is stored.
+   */
+  class sbc_writer : public stan::callbacks::writer {
+  private:
+    sbc_result& result_;
+    size_t thin_;
+    size_t n_;
+    int divergent_idx_;
+    std::vector<size_t> ranks_idx_;
+    std::vector<size_t> pars_idx_;
+    std::vector<size_t> y_idx_;
+
+    static bool is_block(const std::string& name, const std::string& block) {
+      return name == block || name.compare(0, block.size() + 1, block + ".") == 0;
+    }
+
+  public:
+    sbc_writer(sbc_result& result, size_t thin)
+      : result_(result), thin_(thin), n_(0), divergent_idx_(-1) { }
+
+    using stan::callbacks::writer::operator();
+
+    void operator()(const std::vector<std::string>& names) {
+      for (size_t i = 0; i < names.size(); i++) {
+        if (names[i] == "divergent__") divergent_idx_ = i;
+        else if (is_block(names[i], "ranks_")) ranks_idx_.push_back(i);
+        else if (is_block(names[i], "pars_")) pars_idx_.push_back(i);
+        else if (is_block(names[i], "y_")) y_idx_.push_back(i);
+      }
+      result_.rank_counts.assign(ranks_idx_.size(), 0);
+    }
+
+    void operator()(const std::vector<double>& x) {
+      if (n_ == 0) {
+        for (size_t i = 0; i < pars_idx_.size(); i++)
+          result_.pars.push_back(x[pars_idx_[i]]);
+        for (size_t i = 0; i < y_idx_.size(); i++)
+          result_.y.push_back(x[y_idx_[i]]);
+      }
+      if (divergent_idx_ >= 0 && x[divergent_idx_] > 0)
+        result_.num_divergent++;
+      if (n_ % thin_ == 0) {
+        for (size_t i = 0; i < ranks_idx_.size(); i++)
+          if (x[ranks_idx_[i]] > 0) result_.rank_counts[i]++;
+      }
+      n_++;
+    }
+  };
+
+  /**
+   * Run one chain for each of the models in <code>models</code>,
+   * <code>n_threads</code> at a time, and reduce each to an
+   * sbc_result. The models are built by the caller (on the main
+   * thread, as building them reads the data from R); model m is sampled
+   * with seed <code>seeds[m]</code> and chain id 1, like
+   * <code>sampling(..., chains = 1, seed = seeds[m])</code>. Nothing
+   * here touches R, and the samplers log nothing.
+   *
+   * Only NUTS with adaptation and a diagonal or dense metric is
+   * supported.
+   */
+  template <class Model>
+  void run_sbc(const std::vector<std::unique_ptr<Model> >& models,
+               const std::vector<unsigned int>& seeds, stan_args& args,
+               size_t thin, int n_threads, std::vector<sbc_result>& results) {
+    if (args.get_ctrl_sampling_algorithm() != NUTS
+        || !args.get_ctrl_sampling_adapt_engaged()
+        || (args.get_ctrl_sampling_metric() != DIAG_E
+            && args.get_ctrl_sampling_metric() != DENSE_E))
+      throw std::invalid_argument("the native sbc runner only supports "
+                                  "NUTS with adaptation and the diag_e or "
+                                  "dense_e metric");
+    results.resize(models.size());
+    if (n_threads < 1) n_threads = 1;
+    if (thin < 1) thin = 1;
+    const double init_radius = args.get_init_radius();
+    const int num_warmup = args.get_ctrl_sampling_warmup();
+    const int num_samples = args.get_iter() - num_warmup;
+
+    tbb::task_arena arena(n_threads);
+    arena.execute([&] {
+      tbb::parallel_for(tbb::blocked_range<size_t>(0, models.size(), 1),
+                        [&](const tbb::blocked_range<size_t>& r) {
+        // a tape for this thread unless the thread pool made one already
+        stan::math::ChainableStack ad_tape;
+        for (size_t m = r.begin(); m != r.end(); ++m) {
+          if (!models[m]) continue;
+          sbc_result& result = results[m];
+          try {
+            stan::io::empty_var_context init_context;
+            stan::callbacks::interrupt interrupt;
+            stan::callbacks::logger logger;
+            stan::callbacks::writer init_writer;
+            stan::callbacks::writer diagnostic_writer;
+            sbc_writer sample_writer(result, thin);
+            if (args.get_ctrl_sampling_metric() == DENSE_E) {
+              result.return_code = stan::services::sample
+                ::hmc_nuts_dense_e_adapt(*models[m], init_context,
+                    seeds[m], 1, init_radius, num_warmup, num_samples,
+                    1, false, 0,
+                    args.get_ctrl_sampling_stepsize(),
+                    args.get_ctrl_sampling_stepsize_jitter(),
+                    args.get_ctrl_sampling_max_treedepth(),
+                    args.get_ctrl_sampling_adapt_delta(),
+                    args.get_ctrl_sampling_adapt_gamma(),
+                    args.get_ctrl_sampling_adapt_kappa(),
+                    args.get_ctrl_sampling_adapt_t0(),
+                    args.get_ctrl_sampling_adapt_init_buffer(),
+                    args.get_ctrl_sampling_adapt_term_buffer(),
+                    args.get_ctrl_sampling_adapt_window(),
+                    interrupt, logger, init_writer,
+                    sample_writer, diagnostic_writer);
+            } else {
+              result.return_code = stan::services::sample
+                ::hmc_nuts_diag_e_adapt(*models[m], init_context,
+                    seeds[m], 1, init_radius, num_warmup, num_samples,
+                    1, false, 0,
+                    args.get_ctrl_sampling_stepsize(),
+                    args.get_ctrl_sampling_stepsize_jitter(),
+                    args.get_ctrl_sampling_max_treedepth(),
+                    args.get_ctrl_sampling_adapt_delta(),
+                    args.get_ctrl_sampling_adapt_gamma(),
+                    args.get_ctrl_sampling_adapt_kappa(),
+                    args.get_ctrl_sampling_adapt_t0(),
+                    args.get_ctrl_sampling_adapt_init_buffer(),
+                    args.get_ctrl_sampling_adapt_term_buffer(),
+                    args.get_ctrl_sampling_adapt_window(),
+                    interrupt, logger, init_writer,
+                    sample_writer, diagnostic_writer);
+            }
+          } catch (const std::exception& e) {
+            result.error = e.what();
+          }
+        }
+      });
+    });
+  }
+
+}
+#endif
@@ -77,10 +77,10 @@ namespace rstan {
     }
   }
 
-  enum sampling_algo_t { NUTS = 1, HMC = 2, Metropolis = 3, Fixed_param = 4};
+  enum sampling_algo_t { NUTS = 1, HMC = 2, Metropolis = 3, Fixed_param = 4, PT = 5};
   enum optim_algo_t { Newton = 1, BFGS = 3, LBFGS = 4};
   enum variational_algo_t { MEANFIELD = 1, FULLRANK = 2};
-  enum sampling_metric_t { UNIT_E = 1, DIAG_E = 2, DENSE_E = 3};
+  enum sampling_metric_t { UNIT_E = 1, DIAG_E = 2, DENSE_E = 3, LOWRANK_E = 4};
   enum stan_args_method_t { SAMPLING = 1, OPTIM = 2, TEST_GRADIENT = 3, VARIATIONAL = 4};
 
   /**
@@ -95,6 +95,7 @@ namespace rstan {
     double init_radius;
     // FIXME(syclik): remove `enable_random_init`
     bool enable_random_init; // enable randomly partially specifying inits 
+    int init_threads; // candidates for random inits tried at the same time
     std::string sample_file; // the file for outputting the samples
     bool append_samples;
     bool sample_file_flag; // true: write out to a file; false, do not
@@ -109,6 +110,8 @@ namespace rstan {
         int warmup; // number of warmup
         int thin;
         bool save_warmup; // weather to save warmup samples (true by default)
+        bool defer_gqs; // skip generated quantities while sampling (false by default)
+        int fixed_param_threads; // for Fixed_param, draws computed at the same time
         int iter_save; // number of iterations saved
         int iter_save_wo_warmup; // number of iterations saved wo warmup
         bool adapt_engaged;
@@ -119,10 +122,19 @@ namespace rstan {
         unsigned int adapt_term_buffer;
         unsigned int adapt_window;
         double adapt_t0;
-        sampling_metric_t metric; // UNIT_E, DIAG_E, DENSE_E;
+        bool adapt_metric; // false to adapt only the step size in warmup
+        bool adapt_early_stop; // end warmup once the adaptation is stable
+        double adapt_early_stop_tol;
+        sampling_metric_t metric; // UNIT_E, DIAG_E, DENSE_E, LOWRANK_E;
+        int metric_rank; // for LOWRANK_E, the rank of the correction
+        SEXP inv_metric; // the initial inverse metric; R_NilValue for unit
         double stepsize; // defaut to 1;
         double stepsize_jitter;
-        int max_treedepth; // for NUTS, default to 10.
+        int max_treedepth; // for NUTS and PT, default to 10.
+        int num_temps; // for PT, the number of replicas
+        double beta_min; // for PT, the lowest inverse temperature
+        int swap_interval; // for PT, iterations between swap proposals
+        bool adapt_temps; // for PT, adapt the inverse temperatures
         double int_time; // for HMC, default to 2 * pi
       } sampling;
       struct {
@@ -327,6 +339,8 @@ namespace rstan {
           get_rlist_element(in, "iter", ctrl.sampling.iter, 2000);
           get_rlist_element(in, "warmup", ctrl.sampling.warmup, ctrl.sampling.iter / 2);
           get_rlist_element(in, "save_warmup", ctrl.sampling.save_warmup, true);
+          get_rlist_element(in, "defer_gqs", ctrl.sampling.defer_gqs, false);
+          get_rlist_element(in, "fixed_param_threads", ctrl.sampling.fixed_param_threads, 1);
 
           calculated_thin = (ctrl.sampling.iter - ctrl.sampling.warmup) / 1000;
           if (calculated_thin < 1) calculated_thin = 1;
@@ -352,6 +366,9 @@ namespace rstan {
           get_rlist_element(ctrl_lst, "adapt_init_buffer", ctrl.sampling.adapt_init_buffer, 75U);
           get_rlist_element(ctrl_lst, "adapt_term_buffer", ctrl.sampling.adapt_term_buffer, 50U);
           get_rlist_element(ctrl_lst, "adapt_window", ctrl.sampling.adapt_window, 25U);
+          get_rlist_element(ctrl_lst, "adapt_metric", ctrl.sampling.adapt_metric, true);
+          get_rlist_element(ctrl_lst, "adapt_early_stop", ctrl.sampling.adapt_early_stop, false);
+          get_rlist_element(ctrl_lst, "adapt_early_stop_tol", ctrl.sampling.adapt_early_stop_tol, 0.1);
           get_rlist_element(ctrl_lst, "stepsize", ctrl.sampling.stepsize, 1.0);
           get_rlist_element(ctrl_lst, "stepsize_jitter", ctrl.sampling.stepsize_jitter, 0.0);
 
@@ -359,6 +376,7 @@ namespace rstan {
             if (t_str == "HMC") ctrl.sampling.algorithm = HMC;
             else if (t_str == "Metropolis") ctrl.sampling.algorithm = Metropolis;
             else if (t_str == "NUTS") ctrl.sampling.algorithm = NUTS;
+            else if (t_str == "PT") ctrl.sampling.algorithm = PT;
             else if (t_str == "Fixed_param") {
               ctrl.sampling.algorithm = Fixed_param;
               ctrl.sampling.adapt_engaged = false;
@@ -369,7 +387,7 @@ namespace rstan {
             } else {
               std::stringstream msg;
               msg << "Invalid value for parameter algorithm (found "
-                  << t_str << "; require HMC, Metropolis, Fixed_param, or NUTS).";
+                  << t_str << "; require HMC, Metropolis, Fixed_param, NUTS, or PT).";
               throw std::invalid_argument(msg.str());
             }
           } else {
@@ -380,12 +398,57 @@ namespace rstan {
             if ("unit_e" == t_str) ctrl.sampling.metric = UNIT_E;
             else if ("diag_e" == t_str) ctrl.sampling.metric = DIAG_E;
             else if ("dense_e" == t_str) ctrl.sampling.metric = DENSE_E;
+            else if ("lowrank_e" == t_str) ctrl.sampling.metric = LOWRANK_E;
           } else ctrl.sampling.metric = DIAG_E;
+          get_rlist_element(ctrl_lst, "metric_rank", ctrl.sampling.metric_rank, 10);
+          if (ctrl.sampling.metric == LOWRANK_E) {
+            if (ctrl.sampling.algorithm != NUTS)
+              throw std::invalid_argument("metric lowrank_e is only available "
+                                          "for algorithm NUTS.");
+            if (ctrl.sampling.adapt_early_stop)
+              throw std::invalid_argument("adapt_early_stop is not available "
+                                          "for metric lowrank_e.");
+          }
+          if (ctrl.sampling.algorithm == PT && ctrl.sampling.metric != DIAG_E
+              && ctrl.sampling.metric != DENSE_E)
+            throw std::invalid_argument("algorithm PT requires metric diag_e "
+                                        "or dense_e.");
+          // early stop only applies to NUTS adapting a diag_e or dense_e
+          // metric (see sampling() in R/stanmodel-class.R), and is
+          // switched off otherwise; when it applies, the number of warmup
+          // iterations is not known in advance and they are not saved
+          if (ctrl.sampling.adapt_early_stop
+              && !(ctrl.sampling.algorithm == NUTS
+                   && (ctrl.sampling.metric == DIAG_E
+                       || ctrl.sampling.metric == DENSE_E)
+                   && ctrl.sampling.adapt_engaged
+                   && ctrl.sampling.adapt_metric
+                   && ctrl.sampling.warmup > 0))
+            ctrl.sampling.adapt_early_stop = false;
+          if (ctrl.sampling.adapt_early_stop) {
+            ctrl.sampling.save_warmup = false;
+            ctrl.sampling.iter_save = ctrl.sampling.iter_save_wo_warmup;
+          }
+          ctrl.sampling.inv_metric = R_NilValue;
+          get_rlist_element(ctrl_lst, "inv_metric", ctrl.sampling.inv_metric);
 
           switch (ctrl.sampling.algorithm) {
             case NUTS:
               get_rlist_element(ctrl_lst, "max_treedepth", ctrl.sampling.max_treedepth, 10);
               break;
+            case PT:
+              get_rlist_element(ctrl_lst, "max_treedepth", ctrl.sampling.max_treedepth, 10);
+              get_rlist_element(ctrl_lst, "num_temps", ctrl.sampling.num_temps, 4);
+              get_rlist_element(ctrl_lst, "beta_min", ctrl.sampling.beta_min, 0.01);
+              get_rlist_element(ctrl_lst, "swap_interval", ctrl.sampling.swap_interval, 1);
+              get_rlist_element(ctrl_lst, "adapt_temps", ctrl.sampling.adapt_temps, true);
+              if (ctrl.sampling.num_temps < 2)
+                throw std::invalid_argument("num_temps should be at least 2.");
+              if (!(ctrl.sampling.beta_min > 0 && ctrl.sampling.beta_min < 1))
+                throw std::invalid_argument("beta_min should be in (0, 1).");
+              if (ctrl.sampling.swap_interval < 1)
+                throw std::invalid_argument("swap_interval should be positive.");
+              break;
              case HMC:
               get_rlist_element(ctrl_lst, "int_time", ctrl.sampling.int_time,
                                 6.283185307179586476925286766559005768e+00);
@@ -445,6 +508,7 @@ namespace rstan {
       if (0 >= init_radius)  init = "0";
       if (init == "0") init_radius = 0;
       get_rlist_element(in, "enable_random_init", enable_random_init, true);
+      get_rlist_element(in, "init_threads", init_threads, 1);
       validate_args();
     }
 
@@ -463,6 +527,7 @@ namespace rstan {
       args["init_list"] = init_list;
       args["init_radius"] = Rcpp::wrap(init_radius);
       args["enable_random_init"] = Rcpp::wrap(enable_random_init);
+      args["init_threads"] = Rcpp::wrap(init_threads);
       args["append_samples"] = Rcpp::wrap(append_samples);
       if (sample_file_flag)
         args["sample_file"] = Rcpp::wrap(sample_file);
@@ -495,6 +560,8 @@ namespace rstan {
           args["refresh"] = Rcpp::wrap(ctrl.sampling.refresh);
           args["test_grad"] = Rcpp::wrap(false);
           args["save_warmup"] = Rcpp::wrap(ctrl.sampling.save_warmup);
+          args["defer_gqs"] = Rcpp::wrap(ctrl.sampling.defer_gqs);
+          args["fixed_param_threads"] = Rcpp::wrap(ctrl.sampling.fixed_param_threads);
           ctrl_args["adapt_engaged"] = Rcpp::wrap(ctrl.sampling.adapt_engaged);
           ctrl_args["adapt_gamma"] = Rcpp::wrap(ctrl.sampling.adapt_gamma);
           ctrl_args["adapt_delta"] = Rcpp::wrap(ctrl.sampling.adapt_delta);
@@ -503,13 +570,26 @@ namespace rstan {
           ctrl_args["adapt_init_buffer"] = Rcpp::wrap(ctrl.sampling.adapt_init_buffer);
           ctrl_args["adapt_term_buffer"] = Rcpp::wrap(ctrl.sampling.adapt_term_buffer);
           ctrl_args["adapt_window"] = Rcpp::wrap(ctrl.sampling.adapt_window);
+          ctrl_args["adapt_metric"] = Rcpp::wrap(ctrl.sampling.adapt_metric);
+          ctrl_args["adapt_early_stop"] = Rcpp::wrap(ctrl.sampling.adapt_early_stop);
+          ctrl_args["adapt_early_stop_tol"] = Rcpp::wrap(ctrl.sampling.adapt_early_stop_tol);
           ctrl_args["stepsize"] = Rcpp::wrap(ctrl.sampling.stepsize);
           ctrl_args["stepsize_jitter"] = Rcpp::wrap(ctrl.sampling.stepsize_jitter);
+          if (ctrl.sampling.inv_metric != R_NilValue)
+            ctrl_args["inv_metric"] = ctrl.sampling.inv_metric;
           switch (ctrl.sampling.algorithm) {
             case NUTS:
               ctrl_args["max_treedepth"] = Rcpp::wrap(ctrl.sampling.max_treedepth);
               sampler_t.append("NUTS");
               break;
+            case PT:
+              ctrl_args["max_treedepth"] = Rcpp::wrap(ctrl.sampling.max_treedepth);
+              ctrl_args["num_temps"] = Rcpp::wrap(ctrl.sampling.num_temps);
+              ctrl_args["beta_min"] = Rcpp::wrap(ctrl.sampling.beta_min);
+              ctrl_args["swap_interval"] = Rcpp::wrap(ctrl.sampling.swap_interval);
+              ctrl_args["adapt_temps"] = Rcpp::wrap(ctrl.sampling.adapt_temps);
+              sampler_t.append("PT");
+              break;
             case HMC:
               ctrl_args["int_time"] = Rcpp::wrap(ctrl.sampling.int_time);
               sampler_t.append("HMC");
@@ -533,6 +613,11 @@ namespace rstan {
                 ctrl_args["metric"] = Rcpp::wrap("dense_e");
                 sampler_t.append("(dense_e)");
                 break;
+              case LOWRANK_E:
+                ctrl_args["metric"] = Rcpp::wrap("lowrank_e");
+                ctrl_args["metric_rank"] = Rcpp::wrap(ctrl.sampling.metric_rank);
+                sampler_t.append("(lowrank_e)");
+                break;
             }
           }
           args["sampler_t"] = Rcpp::wrap(sampler_t);
@@ -629,6 +714,9 @@ namespace rstan {
     inline sampling_metric_t get_ctrl_sampling_metric() const {
       return ctrl.sampling.metric;
     }
+    inline int get_ctrl_sampling_metric_rank() const {
+      return ctrl.sampling.metric_rank;
+    }
     inline sampling_algo_t get_ctrl_sampling_algorithm() const {
       return ctrl.sampling.algorithm;
     }
@@ -692,6 +780,18 @@ namespace rstan {
     inline unsigned int get_ctrl_sampling_adapt_window() const {
       return ctrl.sampling.adapt_window;
     }
+    inline bool get_ctrl_sampling_adapt_metric() const {
+      return ctrl.sampling.adapt_metric;
+    }
+    inline bool get_ctrl_sampling_adapt_early_stop() const {
+      return ctrl.sampling.adapt_early_stop;
+    }
+    inline double get_ctrl_sampling_adapt_early_stop_tol() const {
+      return ctrl.sampling.adapt_early_stop_tol;
+    }
+    inline SEXP get_ctrl_sampling_inv_metric() const {
+      return ctrl.sampling.inv_metric;
+    }
     inline double get_ctrl_sampling_stepsize() const {
        return ctrl.sampling.stepsize;
     }
@@ -701,6 +801,18 @@ namespace rstan {
     inline int get_ctrl_sampling_max_treedepth() const {
        return ctrl.sampling.max_treedepth;
     }
+    inline int get_ctrl_sampling_num_temps() const {
+       return ctrl.sampling.num_temps;
+    }
+    inline double get_ctrl_sampling_beta_min() const {
+       return ctrl.sampling.beta_min;
+    }
+    inline int get_ctrl_sampling_swap_interval() const {
+       return ctrl.sampling.swap_interval;
+    }
+    inline bool get_ctrl_sampling_adapt_temps() const {
+       return ctrl.sampling.adapt_temps;
+    }
     inline int get_ctrl_sampling_iter_save_wo_warmup() const {
        return ctrl.sampling.iter_save_wo_warmup;
     }
@@ -710,6 +822,12 @@ namespace rstan {
     inline bool get_ctrl_sampling_save_warmup() const {
        return ctrl.sampling.save_warmup; // was true
     }
+    inline bool get_ctrl_sampling_defer_gqs() const {
+       return ctrl.sampling.defer_gqs;
+    }
+    inline int get_ctrl_sampling_fixed_param_threads() const {
+       return ctrl.sampling.fixed_param_threads;
+    }
     inline optim_algo_t get_ctrl_optim_algorithm() const {
       return ctrl.optim.algorithm;
     }
@@ -755,6 +873,9 @@ namespace rstan {
     inline bool get_enable_random_init() const {
       return enable_random_init;
     }
+    inline int get_init_threads() const {
+      return init_threads;
+    }
     const std::string& get_init() const {
       return init;
     }
@@ -765,6 +886,7 @@ namespace rstan {
     void write_args_as_comment(std::ostream& ostream) const {
       write_comment_property(ostream,"init",init);
       write_comment_property(ostream,"enable_random_init",enable_random_init);
+      write_comment_property(ostream,"init_threads",init_threads);
       write_comment_property(ostream,"seed",random_seed);
       write_comment_property(ostream,"chain_id",chain_id);
       write_comment_property(ostream,"iter",get_iter());
@@ -784,6 +906,7 @@ namespace rstan {
         case SAMPLING:
           write_comment_property(ostream,"warmup",ctrl.sampling.warmup);
           write_comment_property(ostream,"save_warmup",ctrl.sampling.save_warmup);
+          write_comment_property(ostream,"defer_gqs",ctrl.sampling.defer_gqs);
           write_comment_property(ostream,"thin",ctrl.sampling.thin);
           write_comment_property(ostream,"refresh",ctrl.sampling.refresh);
           write_comment_property(ostream,"stepsize",ctrl.sampling.stepsize);
@@ -793,6 +916,11 @@ namespace rstan {
           write_comment_property(ostream,"adapt_delta",ctrl.sampling.adapt_delta);
           write_comment_property(ostream,"adapt_kappa",ctrl.sampling.adapt_kappa);
           write_comment_property(ostream,"adapt_t0",ctrl.sampling.adapt_t0);
+          if (!ctrl.sampling.adapt_metric)
+            write_comment_property(ostream,"adapt_metric",ctrl.sampling.adapt_metric);
+          write_comment_property(ostream,"adapt_early_stop",ctrl.sampling.adapt_early_stop);
+          if (ctrl.sampling.adapt_early_stop)
+            write_comment_property(ostream,"adapt_early_stop_tol",ctrl.sampling.adapt_early_stop_tol);
           switch (ctrl.sampling.algorithm) {
             case NUTS:
               write_comment_property(ostream,"max_treedepth",ctrl.sampling.max_treedepth);
@@ -800,13 +928,27 @@ namespace rstan {
                 case UNIT_E: write_comment_property(ostream,"sampler_t","NUTS(unit_e)"); break;
                 case DIAG_E: write_comment_property(ostream,"sampler_t","NUTS(diag_e)"); break;
                 case DENSE_E: write_comment_property(ostream,"sampler_t","NUTS(dense_e)"); break;
+                case LOWRANK_E: write_comment_property(ostream,"sampler_t","NUTS(lowrank_e)");
+                                write_comment_property(ostream,"metric_rank",ctrl.sampling.metric_rank);
+                                break;
               }
               break;
+            case PT:
+              write_comment_property(ostream,"max_treedepth",ctrl.sampling.max_treedepth);
+              write_comment_property(ostream,"sampler_t",
+                                     ctrl.sampling.metric == DENSE_E ? "PT(dense_e)" : "PT(diag_e)");
+              write_comment_property(ostream,"num_temps",ctrl.sampling.num_temps);
+              write_comment_property(ostream,"beta_min",ctrl.sampling.beta_min);
+              write_comment_property(ostream,"swap_interval",ctrl.sampling.swap_interval);
+              write_comment_property(ostream,"adapt_temps",ctrl.sampling.adapt_temps);
+              break;
             case HMC: write_comment_property(ostream,"sampler_t", "HMC");
                       write_comment_property(ostream,"int_time", ctrl.sampling.int_time);
                       break;
             case Metropolis: write_comment_property(ostream,"sampler_t", "Metropolis"); break;
-            case Fixed_param: write_comment_property(ostream, "sampler_t", "Fixed_param"); break;
+            case Fixed_param: write_comment_property(ostream, "sampler_t", "Fixed_param");
+                              write_comment_property(ostream, "fixed_param_threads", ctrl.sampling.fixed_param_threads);
+                              break;
             default: break;
           }
           break;
@@ -1,6 +1,7 @@
 #ifndef RSTAN__STAN_FIT_HPP
 #define RSTAN__STAN_FIT_HPP
 
+#include <algorithm>
 #include <cstring>
 #include <iomanip>
 #include <fstream>
@@ -20,6 +21,18 @@
 #include <rstan/io/rlist_ref_var_context.hpp>
 #include <rstan/io/r_ostream.hpp>
 #include <rstan/stan_args.hpp>
+#include <rstan/filtered_model.hpp>
+#include <rstan/parallel_gqs.hpp>
+#include <rstan/parallel_init.hpp>
+#include <rstan/parallel_fixed_param.hpp>
+#include <rstan/psis.hpp>
+#include <rstan/constrain_jacobian.hpp>
+#include <rstan/adaptive_warmup.hpp>
+#include <rstan/lowrank_e_nuts.hpp>
+#include <rstan/parallel_tempering.hpp>
+#include <rstan/rwm.hpp>
+#include <rstan/sbc.hpp>
+#include <rstan/int_columns.hpp>
 #include <rstan/filtered_values.hpp>
 #include <rstan/sum_values.hpp>
 #include <rstan/value.hpp>
@@ -66,6 +79,8 @@
 #include <stan/services/sample/hmc_static_unit_e.hpp>
 #include <stan/services/sample/hmc_static_unit_e_adapt.hpp>
 #include <stan/services/sample/standalone_gqs.hpp>
+#include <stan/services/util/create_unit_e_dense_inv_metric.hpp>
+#include <stan/services/util/create_unit_e_diag_inv_metric.hpp>
 
 #include <rstan/filtered_values.hpp>
 #include <rstan/sum_values.hpp>
@@ -334,7 +349,7 @@ void print_vector(const std::vector<T>& v, std::ostream& o,
   o << std::endl;
 }
 
-void write_stan_version_as_comment(std::ostream& output) {
+inline void write_stan_version_as_comment(std::ostream& output) {
   write_comment_property(output,"stan_version_major",stan::MAJOR_VERSION);
   write_comment_property(output,"stan_version_minor",stan::MINOR_VERSION);
   write_comment_property(output,"stan_version_patch",stan::PATCH_VERSION);
@@ -347,7 +362,7 @@ void write_stan_version_as_comment(std::ostream& output) {
 * could not deal with 64bits integers.
 */
 
-std::vector<unsigned int>
+inline std::vector<unsigned int>
 sizet_to_uint(std::vector<size_t> v1) {
   std::vector<unsigned int> v2(v1.size());
   for (size_t i = 0; i < v1.size(); ++i)
@@ -371,6 +386,67 @@ std::vector<std::vector<unsigned int> > get_param_dims(Model& m) {
   return uintdims;
 }
 
+/**
+ * The initial inverse metric of NUTS and PT: control$inv_metric or the
+ * unit metric. The returned context may refer to
+ * <code>inv_metric_lst</code>, which must outlive it.
+ */
+inline std::unique_ptr<stan::io::var_context>
+initial_inv_metric(stan_args& args, size_t num_params,
+                   Rcpp::List& inv_metric_lst) {
+  std::unique_ptr<stan::io::var_context> inv_metric_ptr;
+  if (args.get_ctrl_sampling_inv_metric() != R_NilValue) {
+    inv_metric_lst = Rcpp::List::create(
+      Rcpp::Named("inv_metric") = args.get_ctrl_sampling_inv_metric());
+    inv_metric_ptr.reset(new io::rlist_ref_var_context(inv_metric_lst));
+  } else if (args.get_ctrl_sampling_metric() == DENSE_E) {
+    inv_metric_ptr.reset(new stan::io::dump(
+      stan::services::util::create_unit_e_dense_inv_metric(num_params)));
+  } else {
+    inv_metric_ptr.reset(new stan::io::dump(
+      stan::services::util::create_unit_e_diag_inv_metric(num_params)));
+  }
+  return inv_metric_ptr;
+}
+
+/**
+ * hmc_nuts_pt with the control arguments of <code>args</code>, so that
+ * the runs with the dense and the diagonal metric only differ in the
+ * sampler.
+ */
+template <template <class, class> class Sampler, class Model>
+int hmc_nuts_pt_args(Model& model, stan_args& args,
+                     const stan::io::var_context& init,
+                     const stan::io::var_context& init_inv_metric,
+                     unsigned int random_seed, unsigned int chain,
+                     double init_radius, int num_warmup, int num_samples,
+                     int num_thin, bool save_warmup, int refresh,
+                     stan::callbacks::interrupt& interrupt,
+                     stan::callbacks::logger& logger,
+                     stan::callbacks::writer& init_writer,
+                     stan::callbacks::writer& sample_writer,
+                     stan::callbacks::writer& diagnostic_writer) {
+  return rstan::hmc_nuts_pt<Sampler>(
+      model, init, init_inv_metric, random_seed, chain, init_radius,
+      num_warmup, num_samples, num_thin, save_warmup, refresh,
+      args.get_ctrl_sampling_stepsize(),
+      args.get_ctrl_sampling_stepsize_jitter(),
+      args.get_ctrl_sampling_max_treedepth(),
+      args.get_ctrl_sampling_adapt_engaged(),
+      args.get_ctrl_sampling_adapt_delta(),
+      args.get_ctrl_sampling_adapt_gamma(),
+      args.get_ctrl_sampling_adapt_kappa(),
+      args.get_ctrl_sampling_adapt_t0(),
+      args.get_ctrl_sampling_adapt_init_buffer(),
+      args.get_ctrl_sampling_adapt_term_buffer(),
+      args.get_ctrl_sampling_adapt_window(),
+      args.get_ctrl_sampling_num_temps(),
+      args.get_ctrl_sampling_beta_min(),
+      args.get_ctrl_sampling_swap_interval(),
+      args.get_ctrl_sampling_adapt_temps(),
+      interrupt, logger, init_writer, sample_writer, diagnostic_writer);
+}
+
 struct R_CheckUserInterrupt_Functor : public stan::callbacks::interrupt {
   void operator()() {
     R_CheckUserInterrupt();
@@ -459,8 +535,16 @@ int command(stan_args& args, Model& model, Rcpp::List& holder,
 
   stan::callbacks::stream_writer diagnostic_writer(diagnostic_stream, "# ");
   std::unique_ptr<stan::io::var_context> init_context_ptr;
+  std::vector<double> init_params_r;
   if (args.get_init() == "user")
     init_context_ptr.reset(new io::rlist_ref_var_context(args.get_init_list()));
+  else if (args.get_init() == "random" && args.get_init_threads() > 1
+           && parallel_random_init(model, args.get_random_seed(),
+                                   args.get_chain_id(), args.get_init_radius(),
+                                   args.get_init_threads(), 100,
+                                   init_params_r))
+    // otherwise the services search for random inits themselves
+    init_context_ptr.reset(make_init_context(model, base_rng, init_params_r));
   else
     init_context_ptr.reset(new stan::io::empty_var_context());
 
@@ -560,12 +644,23 @@ int command(stan_args& args, Model& model, Rcpp::List& holder,
 
   }
   if (args.get_method() == SAMPLING) {
+    // transformed parameters and generated quantities not in qoi_idx
+    // are never computed; with defer_gqs the generated quantities are
+    // left as NaN here and filled in afterwards by stan_fit::parallel_gqs
+    filtered_model<Model>
+      sampling_model(model, qoi_idx, !args.get_ctrl_sampling_defer_gqs());
+    // the samplers' PRNG must not depend on whether the generated
+    // quantities are computed (Fixed_param only uses it for them)
+    if (args.get_ctrl_sampling_algorithm() != Fixed_param)
+      sampling_model.use_gq_stream(random_seed, id);
     std::vector<std::string> sample_names;
     stan::mcmc::sample::get_sample_param_names(sample_names);
     std::vector<std::string> sampler_names;
 
     std::unique_ptr<rstan_sample_writer> sample_writer_ptr;
     size_t sample_writer_offset;
+    // integer-valued quantities are returned as R integer vectors
+    std::vector<bool> int_cols = model_int_columns(model);
 
     int num_warmup = args.get_ctrl_sampling_warmup();
     int num_samples = args.get_iter() - num_warmup;
@@ -583,16 +678,30 @@ int command(stan_args& args, Model& model, Rcpp::List& holder,
                                                     constrained_param_names.size(),
                                                     num_iter_save,
                                                     num_warmup_save,
-                                                    qoi_idx));
-      return_code
-        = stan::services::sample::fixed_param(model, *init_context_ptr,
-                                              random_seed, id, init_radius,
-                                              num_samples,
-                                              num_thin,
-                                              refresh,
-                                              interrupt,
-                                              logger, init_writer,
-                                              *sample_writer_ptr, diagnostic_writer);
+                                                    qoi_idx,
+                                                    int_cols));
+      if (args.get_ctrl_sampling_fixed_param_threads() > 1) {
+        return_code
+          = rstan::fixed_param_parallel(sampling_model, *init_context_ptr,
+                                        random_seed, id, init_radius,
+                                        num_samples,
+                                        num_thin,
+                                        refresh,
+                                        args.get_ctrl_sampling_fixed_param_threads(),
+                                        interrupt,
+                                        logger, init_writer,
+                                        *sample_writer_ptr, diagnostic_writer);
+      } else {
+        return_code
+          = stan::services::sample::fixed_param(sampling_model, *init_context_ptr,
+                                                random_seed, id, init_radius,
+                                                num_samples,
+                                                num_thin,
+                                                refresh,
+                                                interrupt,
+                                                logger, init_writer,
+                                                *sample_writer_ptr, diagnostic_writer);
+      }
     } else if (args.get_ctrl_sampling_algorithm() == NUTS) {
       sampler_names.resize(5);
       sampler_names[0] = "stepsize__";
@@ -609,16 +718,22 @@ int command(stan_args& args, Model& model, Rcpp::List& holder,
                                                     constrained_param_names.size(),
                                                     num_iter_save,
                                                     num_warmup_save,
-                                                    qoi_idx));
+                                                    qoi_idx,
+                                                    int_cols));
 
       double stepsize = args.get_ctrl_sampling_stepsize();
       double stepsize_jitter = args.get_ctrl_sampling_stepsize_jitter();
       int max_depth = args.get_ctrl_sampling_max_treedepth();
 
+      Rcpp::List inv_metric_lst;
+      std::unique_ptr<stan::io::var_context> inv_metric_ptr
+        = initial_inv_metric(args, model.num_params_r(), inv_metric_lst);
+
       if (args.get_ctrl_sampling_metric() == DENSE_E) {
         if (!args.get_ctrl_sampling_adapt_engaged()) {
           return_code = stan::services::sample
-          ::hmc_nuts_dense_e(model, *init_context_ptr,
+          ::hmc_nuts_dense_e(sampling_model, *init_context_ptr,
+                             *inv_metric_ptr,
                              random_seed, id, init_radius,
                              num_warmup, num_samples,
                              num_thin, save_warmup, refresh,
@@ -634,21 +749,43 @@ int command(stan_args& args, Model& model, Rcpp::List& holder,
           unsigned int term_buffer = args.get_ctrl_sampling_adapt_term_buffer();
           unsigned int window = args.get_ctrl_sampling_adapt_window();
 
-          return_code = stan::services::sample
-            ::hmc_nuts_dense_e_adapt(model, *init_context_ptr,
-                                     random_seed, id, init_radius,
-                                     num_warmup, num_samples,
-                                     num_thin, save_warmup, refresh,
-                                     stepsize, stepsize_jitter, max_depth,
-                                     delta, gamma, kappa,
-                                     t0, init_buffer, term_buffer, window,
-                                     interrupt, logger, init_writer,
-                                     *sample_writer_ptr, diagnostic_writer);
+          if (args.get_ctrl_sampling_adapt_early_stop()) {
+            return_code = rstan::hmc_nuts_adapt_early_stop<stan::mcmc::adapt_dense_e_nuts>(
+                sampling_model, *init_context_ptr, *inv_metric_ptr,
+                random_seed, id, init_radius,
+                num_warmup, num_samples, num_thin, refresh,
+                stepsize, stepsize_jitter, max_depth, delta, gamma, kappa,
+                t0, init_buffer, term_buffer, window,
+                args.get_ctrl_sampling_adapt_early_stop_tol(),
+                interrupt, logger, init_writer,
+                *sample_writer_ptr, diagnostic_writer);
+          } else if (!args.get_ctrl_sampling_adapt_metric()) {
+            return_code = rstan::hmc_nuts_stepsize_adapt<stan::mcmc::adapt_dense_e_nuts>(
+                sampling_model, *init_context_ptr, *inv_metric_ptr,
+                random_seed, id, init_radius,
+                num_warmup, num_samples, num_thin, save_warmup, refresh,
+                stepsize, stepsize_jitter, max_depth, delta, gamma, kappa,
+                t0, interrupt, logger, init_writer,
+                *sample_writer_ptr, diagnostic_writer);
+          } else {
+            return_code = stan::services::sample
+              ::hmc_nuts_dense_e_adapt(sampling_model, *init_context_ptr,
+                                       *inv_metric_ptr,
+                                       random_seed, id, init_radius,
+                                       num_warmup, num_samples,
+                                       num_thin, save_warmup, refresh,
+                                       stepsize, stepsize_jitter, max_depth,
+                                       delta, gamma, kappa,
+                                       t0, init_buffer, term_buffer, window,
+                                       interrupt, logger, init_writer,
+                                       *sample_writer_ptr, diagnostic_writer);
+          }
         }
       } else if (args.get_ctrl_sampling_metric() == DIAG_E) {
         if (!args.get_ctrl_sampling_adapt_engaged()) {
           return_code = stan::services::sample
-          ::hmc_nuts_diag_e(model, *init_context_ptr,
+          ::hmc_nuts_diag_e(sampling_model, *init_context_ptr,
+                            *inv_metric_ptr,
                             random_seed, id, init_radius,
                             num_warmup, num_samples,
                             num_thin, save_warmup, refresh,
@@ -664,21 +801,76 @@ int command(stan_args& args, Model& model, Rcpp::List& holder,
           unsigned int term_buffer = args.get_ctrl_sampling_adapt_term_buffer();
           unsigned int window = args.get_ctrl_sampling_adapt_window();
 
+          if (args.get_ctrl_sampling_adapt_early_stop()) {
+            return_code = rstan::hmc_nuts_adapt_early_stop<stan::mcmc::adapt_diag_e_nuts>(
+                sampling_model, *init_context_ptr, *inv_metric_ptr,
+                random_seed, id, init_radius,
+                num_warmup, num_samples, num_thin, refresh,
+                stepsize, stepsize_jitter, max_depth, delta, gamma, kappa,
+                t0, init_buffer, term_buffer, window,
+                args.get_ctrl_sampling_adapt_early_stop_tol(),
+                interrupt, logger, init_writer,
+                *sample_writer_ptr, diagnostic_writer);
+          } else if (!args.get_ctrl_sampling_adapt_metric()) {
+            return_code = rstan::hmc_nuts_stepsize_adapt<stan::mcmc::adapt_diag_e_nuts>(
+                sampling_model, *init_context_ptr, *inv_metric_ptr,
+                random_seed, id, init_radius,
+                num_warmup, num_samples, num_thin, save_warmup, refresh,
+                stepsize, stepsize_jitter, max_depth, delta, gamma, kappa,
+                t0, interrupt, logger, init_writer,
+                *sample_writer_ptr, diagnostic_writer);
+          } else {
+            return_code = stan::services::sample
+              ::hmc_nuts_diag_e_adapt(sampling_model, *init_context_ptr,
+                                      *inv_metric_ptr,
+                                      random_seed, id, init_radius,
+                                      num_warmup, num_samples,
+                                      num_thin, save_warmup, refresh,
+                                      stepsize, stepsize_jitter, max_depth,
+                                      delta, gamma, kappa,
+                                      t0, init_buffer, term_buffer, window,
+                                      interrupt, logger, init_writer,
+                                      *sample_writer_ptr, diagnostic_writer);
+          }
+        }
+      } else if (args.get_ctrl_sampling_metric() == LOWRANK_E) {
+        if (!args.get_ctrl_sampling_adapt_engaged()) {
+          // without adaptation there is no low-rank part to use
           return_code = stan::services::sample
-            ::hmc_nuts_diag_e_adapt(model, *init_context_ptr,
-                                    random_seed, id, init_radius,
-                                    num_warmup, num_samples,
-                                    num_thin, save_warmup, refresh,
-                                    stepsize, stepsize_jitter, max_depth,
-                                    delta, gamma, kappa,
-                                    t0, init_buffer, term_buffer, window,
-                                    interrupt, logger, init_writer,
-                                    *sample_writer_ptr, diagnostic_writer);
+          ::hmc_nuts_diag_e(sampling_model, *init_context_ptr,
+                            *inv_metric_ptr,
+                            random_seed, id, init_radius,
+                            num_warmup, num_samples,
+                            num_thin, save_warmup, refresh,
+                            stepsize, stepsize_jitter, max_depth,
+                            interrupt, logger, init_writer,
+                            *sample_writer_ptr, diagnostic_writer);
+        } else {
+          double delta = args.get_ctrl_sampling_adapt_delta();
+          double gamma = args.get_ctrl_sampling_adapt_gamma();
+          double kappa = args.get_ctrl_sampling_adapt_kappa();
+          double t0 = args.get_ctrl_sampling_adapt_t0();
+          unsigned int init_buffer = args.get_ctrl_sampling_adapt_init_buffer();
+          unsigned int term_buffer = args.get_ctrl_sampling_adapt_term_buffer();
+          unsigned int window = args.get_ctrl_sampling_adapt_window();
+
+          return_code = rstan::hmc_nuts_lowrank_e_adapt(sampling_model,
+                                                        *init_context_ptr,
+                                                        *inv_metric_ptr,
+                                                        random_seed, id, init_radius,
+                                                        num_warmup, num_samples,
+                                                        num_thin, save_warmup, refresh,
+                                                        stepsize, stepsize_jitter, max_depth,
+                                                        delta, gamma, kappa,
+                                                        t0, init_buffer, term_buffer, window,
+                                                        args.get_ctrl_sampling_metric_rank(),
+                                                        interrupt, logger, init_writer,
+                                                        *sample_writer_ptr, diagnostic_writer);
         }
       } else if (args.get_ctrl_sampling_metric() == UNIT_E) {
         if (!args.get_ctrl_sampling_adapt_engaged()) {
           return_code = stan::services::sample
-          ::hmc_nuts_unit_e(model, *init_context_ptr,
+          ::hmc_nuts_unit_e(sampling_model, *init_context_ptr,
                             random_seed, id, init_radius,
                             num_warmup, num_samples,
                             num_thin, save_warmup, refresh,
@@ -692,7 +884,7 @@ int command(stan_args& args, Model& model, Rcpp::List& holder,
           double t0 = args.get_ctrl_sampling_adapt_t0();
 
           return_code = stan::services::sample
-            ::hmc_nuts_unit_e_adapt(model, *init_context_ptr,
+            ::hmc_nuts_unit_e_adapt(sampling_model, *init_context_ptr,
                                     random_seed, id, init_radius,
                                     num_warmup, num_samples,
                                     num_thin, save_warmup, refresh,
@@ -702,6 +894,72 @@ int command(stan_args& args, Model& model, Rcpp::List& holder,
                                     *sample_writer_ptr, diagnostic_writer);
         }
       }
+    } else if (args.get_ctrl_sampling_algorithm() == PT) {
+      sampler_names.resize(5);
+      sampler_names[0] = "stepsize__";
+      sampler_names[1] = "treedepth__";
+      sampler_names[2] = "n_leapfrog__";
+      sampler_names[3] = "divergent__";
+      sampler_names[4] = "energy__";
+      sample_writer_offset = sample_names.size() + sampler_names.size();
+
+      sample_writer_ptr.reset(sample_writer_factory(&sample_stream,
+                                                    comment_stream, "# ",
+                                                    sample_names.size(),
+                                                    sampler_names.size(),
+                                                    constrained_param_names.size(),
+                                                    num_iter_save,
+                                                    num_warmup_save,
+                                                    qoi_idx,
+                                                    int_cols));
+
+      Rcpp::List inv_metric_lst;
+      std::unique_ptr<stan::io::var_context> inv_metric_ptr
+        = initial_inv_metric(args, model.num_params_r(), inv_metric_lst);
+
+      // the replicas run on their own threads and only the untempered
+      // one is written
+      if (args.get_ctrl_sampling_metric() == DENSE_E)
+        return_code = hmc_nuts_pt_args<stan::mcmc::adapt_dense_e_nuts>(
+            sampling_model, args, *init_context_ptr, *inv_metric_ptr,
+            random_seed, id, init_radius, num_warmup, num_samples, num_thin,
+            save_warmup, refresh, interrupt, logger, init_writer,
+            *sample_writer_ptr, diagnostic_writer);
+      else
+        return_code = hmc_nuts_pt_args<stan::mcmc::adapt_diag_e_nuts>(
+            sampling_model, args, *init_context_ptr, *inv_metric_ptr,
+            random_seed, id, init_radius, num_warmup, num_samples, num_thin,
+            save_warmup, refresh, interrupt, logger, init_writer,
+            *sample_writer_ptr, diagnostic_writer);
+    } else if (args.get_ctrl_sampling_algorithm() == Metropolis) {
+      sampler_names.resize(1);
+      sampler_names[0] = "stepsize__";
+      sample_writer_offset = sample_names.size() + sampler_names.size();
+
+      sample_writer_ptr.reset(sample_writer_factory(&sample_stream,
+                                                    comment_stream, "# ",
+                                                    sample_names.size(),
+                                                    sampler_names.size(),
+                                                    constrained_param_names.size(),
+                                                    num_iter_save,
+                                                    num_warmup_save,
+                                                    qoi_idx,
+                                                    int_cols));
+
+      return_code = rstan::rwm(sampling_model, *init_context_ptr,
+                               random_seed, id, init_radius,
+                               num_warmup, num_samples,
+                               num_thin, save_warmup, refresh,
+                               args.get_ctrl_sampling_stepsize(),
+                               args.get_ctrl_sampling_adapt_engaged(),
+                               args.get_ctrl_sampling_adapt_gamma(),
+                               args.get_ctrl_sampling_adapt_kappa(),
+                               args.get_ctrl_sampling_adapt_t0(),
+                               args.get_ctrl_sampling_adapt_init_buffer(),
+                               args.get_ctrl_sampling_adapt_term_buffer(),
+                               args.get_ctrl_sampling_adapt_window(),
+                               interrupt, logger, init_writer,
+                               *sample_writer_ptr, diagnostic_writer);
     } else if (args.get_ctrl_sampling_algorithm() == HMC) {
       sampler_names.resize(3);
       sampler_names[0] = "stepsize__";
@@ -716,7 +974,8 @@ int command(stan_args& args, Model& model, Rcpp::List& holder,
                                                     constrained_param_names.size(),
                                                     num_iter_save,
                                                     num_warmup_save,
-                                                    qoi_idx));
+                                                    qoi_idx,
+                                                    int_cols));
 
       double stepsize = args.get_ctrl_sampling_stepsize();
       double stepsize_jitter = args.get_ctrl_sampling_stepsize_jitter();
@@ -725,7 +984,7 @@ int command(stan_args& args, Model& model, Rcpp::List& holder,
       if (args.get_ctrl_sampling_metric() == DENSE_E) {
         if (!args.get_ctrl_sampling_adapt_engaged()) {
           return_code = stan::services::sample
-          ::hmc_static_dense_e(model, *init_context_ptr,
+          ::hmc_static_dense_e(sampling_model, *init_context_ptr,
                                random_seed, id, init_radius,
                                num_warmup, num_samples,
                                num_thin, save_warmup, refresh,
@@ -742,7 +1001,7 @@ int command(stan_args& args, Model& model, Rcpp::List& holder,
           unsigned int window = args.get_ctrl_sampling_adapt_window();
 
           return_code = stan::services::sample
-            ::hmc_static_dense_e_adapt(model, *init_context_ptr,
+            ::hmc_static_dense_e_adapt(sampling_model, *init_context_ptr,
                                        random_seed, id, init_radius,
                                        num_warmup, num_samples,
                                        num_thin, save_warmup, refresh,
@@ -756,7 +1015,7 @@ int command(stan_args& args, Model& model, Rcpp::List& holder,
       } else if (args.get_ctrl_sampling_metric() == DIAG_E) {
         if (!args.get_ctrl_sampling_adapt_engaged()) {
           return_code = stan::services::sample
-          ::hmc_static_diag_e(model, *init_context_ptr,
+          ::hmc_static_diag_e(sampling_model, *init_context_ptr,
                               random_seed, id, init_radius,
                               num_warmup, num_samples,
                               num_thin, save_warmup, refresh,
@@ -774,7 +1033,7 @@ int command(stan_args& args, Model& model, Rcpp::List& holder,
           unsigned int window = args.get_ctrl_sampling_adapt_window();
 
           return_code = stan::services::sample
-            ::hmc_static_diag_e_adapt(model, *init_context_ptr,
+            ::hmc_static_diag_e_adapt(sampling_model, *init_context_ptr,
                                       random_seed, id, init_radius,
                                       num_warmup, num_samples,
                                       num_thin, save_warmup, refresh,
@@ -787,7 +1046,7 @@ int command(stan_args& args, Model& model, Rcpp::List& holder,
       } else if (args.get_ctrl_sampling_metric() == UNIT_E) {
         if (args.get_ctrl_sampling_adapt_engaged()) {
           return_code = stan::services::sample
-          ::hmc_static_unit_e(model, *init_context_ptr,
+          ::hmc_static_unit_e(sampling_model, *init_context_ptr,
                               random_seed, id, init_radius,
                               num_warmup, num_samples,
                               num_thin, save_warmup, refresh,
@@ -802,7 +1061,7 @@ int command(stan_args& args, Model& model, Rcpp::List& holder,
           double t0 = args.get_ctrl_sampling_adapt_t0();
 
           return_code = stan::services::sample
-            ::hmc_static_unit_e_adapt(model, *init_context_ptr,
+            ::hmc_static_unit_e_adapt(sampling_model, *init_context_ptr,
                                       random_seed, id, init_radius,
                                       num_warmup, num_samples,
                                       num_thin, save_warmup, refresh,
@@ -1242,12 +1501,14 @@ public:
     int gq_size = all_names.size() - some_names.size();
     std::vector<size_t> gq_idx(gq_size);
     for (int i = 0; i < gq_size; i++) gq_idx[i] = i;
+    std::vector<bool> int_cols = model_int_columns(model_);
+    int_cols.erase(int_cols.begin(), int_cols.begin() + some_names.size());
     sample_writer_ptr.reset(sample_writer_factory(&sample_stream,
                                                   comment_stream, "# ",
                                                   0, 0,
                                                   gq_size,
                                                   draws.rows(), 0,
-                                                  gq_idx));
+                                                  gq_idx, int_cols));
 
     int ret = stan::services::error_codes::CONFIG;
     ret = stan::services::standalone_generate(model_, draws,
@@ -1263,6 +1524,201 @@ public:
     END_RCPP
   }
 
+  /**
+  * Like standalone_gqs, but the draws are split over n_threads
+  * threads and each draw uses its own PRNG, so the result does not
+  * depend on the number of threads. Used to fill in the generated
+  * quantities of a fit that was sampled with defer_gqs = TRUE.
+  */
+  SEXP parallel_gqs(SEXP pars, SEXP seed, SEXP n_threads) {
+    BEGIN_RCPP
+    const Eigen::Map<Eigen::MatrixXd> draws(Rcpp::as<Eigen::Map<Eigen::MatrixXd> >(pars));
+    Eigen::MatrixXd gqs;
+    std::vector<std::string> errors;
+    parallel_generate_gqs(model_, draws, Rcpp::as<unsigned int>(seed),
+                          Rcpp::as<int>(n_threads), gqs, errors);
+    report_gqs_errors(errors, rstan::io::rcerr);
+    std::vector<bool> int_cols = model_int_columns(model_);
+    int_cols.erase(int_cols.begin(), int_cols.end() - gqs.cols());
+    Rcpp::List holder(gqs.cols());
+    for (int k = 0; k < gqs.cols(); k++)
+      holder[k] = typed_column(gqs.col(k).data(), gqs.rows(), int_cols[k]);
+    SEXP __sexp_result;
+    PROTECT(__sexp_result = Rcpp::wrap(holder));
+    UNPROTECT(1);
+    return __sexp_result;
+    END_RCPP
+  }
+
+  /**
+  * Pareto smoothed importance weights for draws (the rows of upars, on
+  * the unconstrained space) from an approximation with log density
+  * log_g, as in optimizing(importance_resampling = TRUE). The log
+  * density of the model is evaluated for the draws on n_threads
+  * threads; draws at which it fails get a weight of zero.
+  */
+  SEXP importance_weights(SEXP upars, SEXP log_g, SEXP n_threads) {
+    BEGIN_RCPP
+    const Eigen::Map<Eigen::MatrixXd> draws(Rcpp::as<Eigen::Map<Eigen::MatrixXd> >(upars));
+    std::vector<double> lg = Rcpp::as<std::vector<double> >(log_g);
+    if (static_cast<size_t>(draws.cols()) != model_.num_params_r()) {
+      std::stringstream msg;
+      msg << "Number of unconstrained parameters does not match "
+      "that of the model ("
+      << draws.cols() << " vs "
+      << model_.num_params_r()
+      << ").";
+      throw std::domain_error(msg.str());
+    }
+    if (lg.size() != static_cast<size_t>(draws.rows()))
+      throw std::domain_error("log_g should have one element for each draw");
+    std::vector<double> lp;
+    std::vector<std::string> errors;
+    parallel_log_prob(model_, draws, Rcpp::as<int>(n_threads), lp, errors);
+    size_t num_failed = 0;
+    for (size_t i = 0; i < errors.size(); i++) {
+      if (errors[i].empty()) continue;
+      if (!num_failed) rstan::io::rcerr << errors[i] << std::endl;
+      num_failed++;
+    }
+    if (num_failed)
+      rstan::io::rcerr << "The log density could not be evaluated for "
+                       << num_failed << " of " << errors.size()
+                       << " draws; their weights are set to zero." << std::endl;
+    std::vector<double> log_w(lp.size());
+    for (size_t i = 0; i < lp.size(); i++) {
+      log_w[i] = lp[i] - lg[i];
+      if (std::isnan(log_w[i]))
+        log_w[i] = -std::numeric_limits<double>::infinity();
+    }
+    double k = psis_smooth(log_w);
+    Rcpp::List holder = Rcpp::List::create(Rcpp::Named("log_p") = lp,
+                                           Rcpp::Named("log_weights") = log_w,
+                                           Rcpp::Named("pareto_k") = k);
+    SEXP __sexp_result;
+    PROTECT(__sexp_result = Rcpp::wrap(holder));
+    UNPROTECT(1);
+    return __sexp_result;
+    END_RCPP
+  }
+
+  /**
+  * The Jacobian of constrain_pars (without the generated quantities)
+  * at each row of upars, on n_threads threads: an array with a row for
+  * each constrained value, a column for each unconstrained parameter
+  * and a slice for each draw. Draws at which the transform fails are
+  * reported and set to NaN.
+  */
+  SEXP constrain_jacobian(SEXP upars, SEXP include_tparams, SEXP n_threads) {
+    BEGIN_RCPP
+    const Eigen::Map<Eigen::MatrixXd> draws(Rcpp::as<Eigen::Map<Eigen::MatrixXd> >(upars));
+    if (static_cast<size_t>(draws.cols()) != model_.num_params_r()) {
+      std::stringstream msg;
+      msg << "Number of unconstrained parameters does not match "
+      "that of the model ("
+      << draws.cols() << " vs "
+      << model_.num_params_r()
+      << ").";
+      throw std::domain_error(msg.str());
+    }
+    std::vector<Eigen::MatrixXd> jacobian;
+    std::vector<std::string> errors;
+    parallel_constrain_jacobian(model_, draws, Rcpp::as<bool>(include_tparams),
+                                Rcpp::as<int>(n_threads), jacobian, errors);
+    size_t num_failed = 0;
+    for (size_t i = 0; i < errors.size(); i++) {
+      if (errors[i].empty()) continue;
+      if (!num_failed) rstan::io::rcerr << errors[i] << std::endl;
+      num_failed++;
+    }
+    if (num_failed)
+      rstan::io::rcerr << "The parameters could not be constrained around "
+                       << num_failed << " of " << errors.size()
+                       << " draws; their Jacobians are set to NaN." << std::endl;
+    const size_t P = jacobian.empty() ? 0 : jacobian[0].rows();
+    const size_t K = draws.cols();
+    Rcpp::NumericVector holder(P * K * jacobian.size());
+    for (size_t i = 0; i < jacobian.size(); i++)
+      std::copy(jacobian[i].data(), jacobian[i].data() + P * K,
+                holder.begin() + i * P * K);
+    holder.attr("dim") = Rcpp::IntegerVector::create(static_cast<int>(P),
+                                                     static_cast<int>(K),
+                                                     static_cast<int>(jacobian.size()));
+    SEXP __sexp_result;
+    PROTECT(__sexp_result = Rcpp::wrap(holder));
+    UNPROTECT(1);
+    return __sexp_result;
+    END_RCPP
+  }
+
+  /**
+   * Simulation-based calibration: one chain for each seed, with a model
+   * instance built from the data of this object and that seed, run
+   * n_threads at a time. Only the reductions of sbc_result are kept.
+   */
+  SEXP sbc(SEXP args_, SEXP seeds_, SEXP thin_, SEXP n_threads_) {
+    BEGIN_RCPP
+    Rcpp::List lst_args(args_);
+    stan_args args(lst_args);
+    std::vector<unsigned int> seeds = Rcpp::as<std::vector<unsigned int> >(seeds_);
+    // checked before it becomes a size_t, where -1 would be huge
+    int thin = Rcpp::as<int>(thin_);
+    if (thin < 1)
+      throw std::domain_error("rank_thin must be a positive integer");
+    size_t M = seeds.size();
+    std::vector<std::unique_ptr<Model> > models(M);
+    std::vector<std::string> model_errors(M);
+    for (size_t m = 0; m < M; m++) {
+      try {
+        models[m].reset(new Model(data_, seeds[m], &rstan::io::rcout));
+      } catch (const std::exception& e) {
+        model_errors[m] = e.what();
+      }
+    }
+    std::vector<sbc_result> results;
+    run_sbc(models, seeds, args, thin,
+            Rcpp::as<int>(n_threads_), results);
+
+    size_t n_ranks = 0, n_pars = 0, n_y = 0;
+    for (size_t m = 0; m < M; m++) {
+      if (results[m].return_code != 0) continue;
+      n_ranks = results[m].rank_counts.size();
+      n_pars = results[m].pars.size();
+      n_y = results[m].y.size();
+      break;
+    }
+    Rcpp::IntegerMatrix rank_counts(n_ranks, M);
+    Rcpp::NumericMatrix pars(n_pars, M), y(n_y, M);
+    Rcpp::IntegerVector num_divergent(M), return_code(M);
+    Rcpp::CharacterVector error(M);
+    for (size_t m = 0; m < M; m++) {
+      const sbc_result& r = results[m];
+      bool ok = r.return_code == 0 && r.rank_counts.size() == n_ranks
+                && r.pars.size() == n_pars && r.y.size() == n_y;
+      for (size_t i = 0; i < n_ranks; i++)
+        rank_counts(i, m) = ok ? r.rank_counts[i] : NA_INTEGER;
+      for (size_t i = 0; i < n_pars; i++)
+        pars(i, m) = ok ? r.pars[i] : NA_REAL;
+      for (size_t i = 0; i < n_y; i++)
+        y(i, m) = ok ? r.y[i] : NA_REAL;
+      num_divergent[m] = r.num_divergent;
+      return_code[m] = ok ? r.return_code : (r.return_code == 0 ? -1 : r.return_code);
+      error[m] = model_errors[m].empty() ? r.error : model_errors[m];
+    }
+    Rcpp::List holder = Rcpp::List::create(
+      Rcpp::Named("rank_counts") = rank_counts,
+      Rcpp::Named("pars") = pars,
+      Rcpp::Named("y") = y,
+      Rcpp::Named("num_divergent") = num_divergent,
+      Rcpp::Named("return_code") = return_code,
+      Rcpp::Named("error") = error);
+    SEXP __sexp_result;
+    PROTECT(__sexp_result = Rcpp::wrap(holder));
+    UNPROTECT(1);
+    return __sexp_result;
+    END_RCPP
+  }
+
    SEXP param_names() const {
     BEGIN_RCPP
     SEXP __sexp_result;
@@ -0,0 +1,119 @@
+#ifndef RSTAN_TYPED_VALUES_HPP
+#define RSTAN_TYPED_VALUES_HPP
+
+#include <Rcpp.h>
+#include <stan/callbacks/writer.hpp>
+#include <climits>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace rstan {
+
+  /**
+   * Whether x can be kept in an R integer vector: NaN (which becomes
+   * NA) or an integer other than INT_MIN, which is NA_INTEGER in R.
+   */
+  inline bool fits_r_integer(double x) {
+    return std::isnan(x)
+           || (x > INT_MIN && x <= INT_MAX && x == std::floor(x));
+  }
+
+  /**
+   * The n values at x as an R integer vector if is_int and they all
+   * fit (see fits_r_integer()), else as a double vector.
+   */
+  inline Rcpp::RObject typed_column(const double* x, size_t n, bool is_int) {
+    for (size_t m = 0; is_int && m < n; m++)
+      is_int = fits_r_integer(x[m]);
+    if (!is_int)
+      return Rcpp::NumericVector(x, x + n);
+    Rcpp::IntegerVector v(n);
+    for (size_t m = 0; m < n; m++)
+      v[m] = std::isnan(x[m]) ? NA_INTEGER : static_cast<int>(x[m]);
+    return v;
+  }
+
+  /**
+   * Like filtered_values<Rcpp::NumericVector>, but the columns marked
+   * in is_int (which is indexed as filter) are kept in R integer
+   * vectors, half the size of the double ones; NaN (e.g. a generated
+   * quantity that is not computed) becomes NA. A column falls back to
+   * doubles, with the values written so far, as soon as a value does
+   * not fit (see fits_r_integer()), so nothing is lost. With an empty
+   * is_int all columns are doubles.
+   */
+  class typed_filtered_values : public stan::callbacks::writer {
+  private:
+    size_t N_, M_, m_;
+    std::vector<size_t> filter_;
+    std::vector<Rcpp::RObject> x_;
+    std::vector<double*> real_;
+    std::vector<int*> int_;
+
+    void to_real(size_t n) {
+      Rcpp::NumericVector v(M_);
+      for (size_t m = 0; m < m_; m++)
+        v[m] = int_[n][m] == NA_INTEGER
+               ? std::numeric_limits<double>::quiet_NaN() : int_[n][m];
+      real_[n] = v.begin();
+      int_[n] = 0;
+      x_[n] = v;
+    }
+
+  public:
+    typed_filtered_values(const size_t N,
+                          const size_t M,
+                          const std::vector<size_t>& filter,
+                          const std::vector<bool>& is_int)
+      : N_(N), M_(M), m_(0), filter_(filter),
+        real_(filter.size(), 0), int_(filter.size(), 0) {
+      if (!is_int.empty() && is_int.size() != filter.size())
+        throw std::length_error("is_int does not match the filter");
+      x_.reserve(filter_.size());
+      for (size_t n = 0; n < filter_.size(); n++) {
+        if (filter_[n] >= N_)
+          throw std::out_of_range("filter is looking for "
+                                  "elements out of range");
+        if (!is_int.empty() && is_int[n]) {
+          Rcpp::IntegerVector v(M_);
+          int_[n] = v.begin();
+          x_.push_back(v);
+        } else {
+          Rcpp::NumericVector v(M_);
+          real_[n] = v.begin();
+          x_.push_back(v);
+        }
+      }
+    }
+
+    // To deal with C++ name hiding
+    using stan::callbacks::writer::operator();
+
+    void operator()(const std::vector<double>& state) {
+      if (state.size() != N_)
+        throw std::length_error("vector provided does not "
+                                "match the parameter length");
+      if (m_ == M_)
+        throw std::out_of_range("");
+      for (size_t n = 0; n < filter_.size(); n++) {
+        double x = state[filter_[n]];
+        if (int_[n] && !fits_r_integer(x))
+          to_real(n);
+        if (real_[n])
+          real_[n][m_] = x;
+        else
+          int_[n][m_] = std::isnan(x) ? NA_INTEGER : static_cast<int>(x);
+      }
+      m_++;
+    }
+
+    const std::vector<Rcpp::RObject>& x() const {
+      return x_;
+    }
+  };
+
+}
+#endif
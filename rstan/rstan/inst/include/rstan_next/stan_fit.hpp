@@ -134,6 +134,18 @@ public:
   Rcpp::List standalone_gqs(const Eigen::Map<Eigen::MatrixXd> draws, 
                             unsigned int seed);
   
+  /**
+   * Drive the generated quantities in parallel, with a PRNG per draw
+   * 
+   * @param draws A matrix of posterior draws
+   * @param seed An unsigned integer to seed the PRNGs
+   * @param n_threads The number of threads to use
+   * @return A R(cpp) list of realizations from generated quantities
+   */
+  
+  Rcpp::List parallel_gqs(const Eigen::Map<Eigen::MatrixXd> draws, 
+                          unsigned int seed, int n_threads);
+  
   /**
    * Return names (of interest)
    * 
@@ -28,6 +28,8 @@ class stan_fit_base {
   virtual Rcpp::List call_sampler(Rcpp::List args_) = 0;
   virtual Rcpp::List standalone_gqs(const Eigen::Map<Eigen::MatrixXd> draws,
                                     unsigned int seed) = 0;
+  virtual Rcpp::List parallel_gqs(const Eigen::Map<Eigen::MatrixXd> draws,
+                                  unsigned int seed, int n_threads) = 0;
   virtual std::vector<std::string> param_names() const = 0;
   virtual std::vector<std::string> param_names_oi() const = 0;
   virtual Rcpp::List param_oi_tidx(std::vector<std::string> names) = 0;
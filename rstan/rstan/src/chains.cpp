@@ -26,6 +26,7 @@
 #include <fstream>
 
 #include <Rcpp.h>
+#include <Rversion.h>
 
 namespace rstan {
 
@@ -160,6 +161,37 @@ unsigned int num_params(SEXP sim) {
   Rcpp::List lst(sim);
   return Rcpp::as<unsigned int>(lst["n_flatnames"]);
 }
+/**
+* Read-only access to a column of draws. Unlike Rcpp::NumericVector,
+* this does not ask R for a writable pointer, so draws kept in a native
+* store (see draws_altrep.cpp) are read in place instead of copied.
+*/
+class draws_column {
+private:
+  Rcpp::NumericVector coerced_;
+  const double* p_;
+  R_xlen_t n_;
+
+public:
+  explicit draws_column(SEXP x) {
+    if (TYPEOF(x) == REALSXP) {
+#if defined(R_VERSION) && R_VERSION >= R_Version(3, 5, 0)
+      p_ = REAL_RO(x);
+#else
+      p_ = REAL(x);
+#endif
+      n_ = XLENGTH(x);
+    } else {
+      coerced_ = Rcpp::NumericVector(x);
+      p_ = coerced_.begin();
+      n_ = coerced_.size();
+    }
+  }
+  double operator[](R_xlen_t i) const { return p_[i]; }
+  const double* begin() const { return p_; }
+  const double* end() const { return p_ + n_; }
+};
+
 /**
 *
 * @param k Chain index starting from 0
@@ -173,7 +205,7 @@ void get_kept_samples(SEXP sim, const size_t k, const size_t n,
   Rcpp::IntegerVector warmup2(static_cast<SEXP>(lst["warmup2"]));
 
   Rcpp::List slst(static_cast<SEXP>(allsamples[k]));  // chain k
-  Rcpp::NumericVector nv(static_cast<SEXP>(slst[n])); // parameter n
+  draws_column nv(static_cast<SEXP>(slst[n])); // parameter n
   samples.assign(warmup2[k] + nv.begin(), nv.end());
 }
 
@@ -207,7 +239,7 @@ void apply_kept_samples(SEXP sim, size_t k,
   Rcpp::IntegerVector warmup2(static_cast<SEXP>(lst["warmup2"]));
 
   Rcpp::List slst(static_cast<SEXP>(allsamples[k]));  // chain k
-  Rcpp::NumericVector nv(static_cast<SEXP>(slst[n])); // parameter n
+  draws_column nv(static_cast<SEXP>(slst[n])); // parameter n
   // use int instead of size_t since these are R integers.
   for (int i = warmup2[k]; i < n_save[k]; i++) {
     f(nv[i]);
@@ -273,6 +305,50 @@ void read_comments0(const std::string& filename, size_t n,
   }
   fs.close();
 }
+
+/**
+* View of draws given as an R array of # iter * # chains * # params
+* (or # iter * # params for one chain): the draws of chain c are rows
+* c * n_iter, ..., (c + 1) * n_iter - 1 of a matrix with a column per
+* parameter, in place.
+*/
+class draws_array {
+public:
+  size_t n_iter, n_chains, n_params;
+  Rcpp::NumericVector x;
+
+  explicit draws_array(SEXP sims) : x(sims) {
+    Rcpp::IntegerVector dims = x.attr("dim");
+    if (dims.size() == 2) {
+      n_iter = dims[0];
+      n_chains = 1;
+      n_params = dims[1];
+    } else if (dims.size() == 3) {
+      n_iter = dims[0];
+      n_chains = dims[1];
+      n_params = dims[2];
+    } else {
+      throw std::domain_error("sims must be an array of # iter * # chains "
+                              "* # params");
+    }
+  }
+
+  Eigen::Map<const Eigen::MatrixXd> matrix() const {
+    return Eigen::Map<const Eigen::MatrixXd>(x.begin(), n_iter * n_chains,
+                                             n_params);
+  }
+};
+
+/**
+* Log determinant of a symmetric positive definite matrix of which only
+* the lower triangle is set; NaN if it is not positive definite.
+*/
+double log_det_spd(const Eigen::MatrixXd& a) {
+  Eigen::LLT<Eigen::MatrixXd, Eigen::Lower> llt(a);
+  if (llt.info() != Eigen::Success)
+    return std::numeric_limits<double>::quiet_NaN();
+  return 2 * llt.matrixLLT().diagonal().array().log().sum();
+}
 }
 }
 
@@ -283,6 +359,8 @@ RcppExport SEXP split_potential_scale_reduction2(SEXP sims_);
 RcppExport SEXP CPP_read_comments(SEXP file, SEXP n);
 
 RcppExport SEXP stan_prob_autocovariance(SEXP v);
+RcppExport SEXP multivariate_effective_sample_size(SEXP sims, SEXP batch_size);
+RcppExport SEXP multivariate_potential_scale_reduction(SEXP sims);
 
 /**
 * Returns the effective sample size for the specified parameter
@@ -602,3 +680,117 @@ SEXP CPP_read_comments(SEXP file, SEXP n) {
   return __sexp_result;
   END_RCPP
 }
+
+/**
+* Multivariate effective sample size of Vats, Flegal and Jones (2019),
+* n * (det(Lambda) / det(Sigma))^(1 / p), for all parameters at once.
+* Lambda is the covariance of all draws and Sigma the estimate of the
+* asymptotic covariance of their mean by (replicated) batch means: the
+* means of batches of batch_size consecutive draws of each chain, the
+* last draws of a chain that do not fill a batch being left out. The
+* covariances are cross products of the centered draws, so the work
+* is done by matrix-matrix products.
+*
+* @param sims An array of # iter * # chains * # params _without_ warmup
+* @param batch_size The batch size; floor(sqrt(# iter)) if NULL
+* @return The effective sample size, NA if there are too few draws or
+*  batches for the number of parameters.
+*/
+SEXP multivariate_effective_sample_size(SEXP sims, SEXP batch_size) {
+  BEGIN_RCPP
+  rstan::draws_array d(sims);
+  const size_t N = d.n_iter * d.n_chains, p = d.n_params;
+  size_t b = Rf_isNull(batch_size)
+             ? static_cast<size_t>(std::floor(std::sqrt(static_cast<double>(d.n_iter))))
+             : static_cast<size_t>(Rcpp::as<int>(batch_size));
+  if (b < 1) b = 1;
+  const size_t a = d.n_iter / b;  // batches per chain
+  if (p == 0 || N <= p || a * d.n_chains <= p)
+    return Rcpp::wrap(NA_REAL);
+
+  Eigen::Map<const Eigen::MatrixXd> y = d.matrix();
+  Eigen::RowVectorXd mu = y.colwise().mean();
+
+  Eigen::MatrixXd centered = y.rowwise() - mu;
+  Eigen::MatrixXd lambda = Eigen::MatrixXd::Zero(p, p);
+  lambda.selfadjointView<Eigen::Lower>()
+    .rankUpdate(centered.transpose(), 1.0 / (N - 1));
+
+  Eigen::MatrixXd batch_means(a * d.n_chains, p);
+  for (size_t c = 0; c < d.n_chains; c++)
+    for (size_t k = 0; k < a; k++)
+      batch_means.row(c * a + k)
+        = y.middleRows(c * d.n_iter + k * b, b).colwise().mean() - mu;
+  Eigen::MatrixXd sigma = Eigen::MatrixXd::Zero(p, p);
+  sigma.selfadjointView<Eigen::Lower>()
+    .rankUpdate(batch_means.transpose(),
+                static_cast<double>(b) / (a * d.n_chains - 1));
+
+  double ess = N * std::exp((rstan::log_det_spd(lambda)
+                             - rstan::log_det_spd(sigma)) / p);
+  SEXP __sexp_result;
+  PROTECT(__sexp_result = Rcpp::wrap(std::isnan(ess) ? NA_REAL : ess));
+  UNPROTECT(1);
+  return __sexp_result;
+  END_RCPP
+}
+
+/**
+* Multivariate potential scale reduction factor of Brooks and Gelman
+* (1998) on split chains: the square root of
+* (n - 1) / n + (m + 1) / m * lambda_max, where lambda_max is the
+* largest eigenvalue of W^-1 B / n, W the mean within-chain covariance
+* and B / n the covariance of the chain means, for m split chains of
+* n draws. It bounds from above the split R hat of every linear
+* combination of the parameters.
+*
+* @param sims An array of # iter * # chains * # params _without_ warmup
+* @return The multivariate split R hat, NA if there are fewer draws
+*  than parameters.
+*/
+SEXP multivariate_potential_scale_reduction(SEXP sims) {
+  BEGIN_RCPP
+  rstan::draws_array d(sims);
+  const size_t n = d.n_iter / 2, m = 2 * d.n_chains, p = d.n_params;
+  if (p == 0 || n < 2 || m * (n - 1) <= p)
+    return Rcpp::wrap(NA_REAL);
+
+  Eigen::Map<const Eigen::MatrixXd> y = d.matrix();
+  // split chain j is made of rows starts[j], ..., starts[j] + n - 1
+  std::vector<size_t> starts(m);
+  for (size_t c = 0; c < d.n_chains; c++) {
+    starts[2 * c] = c * d.n_iter;
+    starts[2 * c + 1] = (c + 1) * d.n_iter - n;
+  }
+
+  Eigen::MatrixXd chain_means(m, p);
+  Eigen::MatrixXd centered(m * n, p);
+  for (size_t j = 0; j < m; j++) {
+    chain_means.row(j) = y.middleRows(starts[j], n).colwise().mean();
+    centered.middleRows(j * n, n)
+      = y.middleRows(starts[j], n).rowwise() - chain_means.row(j);
+  }
+  Eigen::MatrixXd w = Eigen::MatrixXd::Zero(p, p);
+  w.selfadjointView<Eigen::Lower>()
+    .rankUpdate(centered.transpose(), 1.0 / (m * (n - 1)));
+  w.triangularView<Eigen::StrictlyUpper>() = w.transpose();
+
+  Eigen::MatrixXd between = chain_means.rowwise()
+                            - chain_means.colwise().mean();
+  Eigen::MatrixXd b_n = Eigen::MatrixXd::Zero(p, p);
+  b_n.selfadjointView<Eigen::Lower>()
+    .rankUpdate(between.transpose(), 1.0 / (m - 1));
+  b_n.triangularView<Eigen::StrictlyUpper>() = b_n.transpose();
+
+  Eigen::GeneralizedSelfAdjointEigenSolver<Eigen::MatrixXd>
+    es(b_n, w, Eigen::EigenvaluesOnly | Eigen::Ax_lBx);
+  if (es.info() != Eigen::Success)
+    return Rcpp::wrap(NA_REAL);
+  double lambda_max = es.eigenvalues().maxCoeff();
+  double rhat = std::sqrt((n - 1.0) / n + (m + 1.0) / m * lambda_max);
+  SEXP __sexp_result;
+  PROTECT(__sexp_result = Rcpp::wrap(rhat));
+  UNPROTECT(1);
+  return __sexp_result;
+  END_RCPP
+}
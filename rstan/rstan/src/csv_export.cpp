@@ -0,0 +1,233 @@
+// This file is part of RStan
+// Copyright (C) 2012, 2013, 2014, 2015, 2016, 2017 Trustees of Columbia University
+//
+// RStan is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 3
+// of the License, or (at your option) any later version.
+//
+// RStan is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+/*
+ * Writer of the draws of a stanfit to CSV files laid out as the
+ * sample_file of command() and of CmdStan (see write_stan_csv in
+ * R/stan_csv.R): for each chain, the comments given by R, the header,
+ * the warmup draws, the adaptation comments, the other draws and the
+ * timing comments.
+ *
+ * The chains are written in parallel, and the draws of each chain are
+ * formatted in blocks of rows in parallel and then written in order.
+ */
+
+#include <Rcpp.h>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined(__has_include)
+#if __has_include(<charconv>)
+#include <charconv>
+#endif
+#endif
+
+RcppExport SEXP write_draws_csv(SEXP files, SEXP headers, SEXP names,
+                                SEXP columns, SEXP n_warmup,
+                                SEXP adaptation, SEXP footers,
+                                SEXP sig_figs, SEXP n_threads);
+
+namespace {
+  /**
+   * A column of draws, either double or integer; pointers are taken
+   * before the threads start, as R may not be called from them.
+   */
+  struct draws_column {
+    const double* real;
+    const int* integer;
+  };
+
+  char* format_double(char* p, char* end, double x, int sig_figs) {
+    if (std::isnan(x)) {
+      std::memcpy(p, "nan", 3);
+      return p + 3;
+    }
+    if (std::isinf(x)) {
+      if (x > 0) {
+        std::memcpy(p, "inf", 3);
+        return p + 3;
+      }
+      std::memcpy(p, "-inf", 4);
+      return p + 4;
+    }
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+    return std::to_chars(p, end, x, std::chars_format::general,
+                         sig_figs).ptr;
+#else
+    return p + std::snprintf(p, end - p, "%.*g", sig_figs, x);
+#endif
+  }
+
+  char* format_int(char* p, char* end, int x) {
+    if (x == NA_INTEGER) {
+      std::memcpy(p, "nan", 3);
+      return p + 3;
+    }
+#if defined(__cpp_lib_to_chars)
+    return std::to_chars(p, end, x).ptr;
+#else
+    return p + std::snprintf(p, end - p, "%d", x);
+#endif
+  }
+
+  void format_rows(const std::vector<draws_column>& cols, size_t from,
+                   size_t to, int sig_figs, std::string& out) {
+    char buf[48];
+    out.clear();
+    out.reserve((to - from) * cols.size() * 12);
+    for (size_t m = from; m < to; m++) {
+      for (size_t j = 0; j < cols.size(); j++) {
+        char* p = buf;
+        if (j) *p++ = ',';
+        p = cols[j].real
+            ? format_double(p, buf + sizeof(buf), cols[j].real[m], sig_figs)
+            : format_int(p, buf + sizeof(buf), cols[j].integer[m]);
+        out.append(buf, p);
+      }
+      out += '\n';
+    }
+  }
+
+  /**
+   * Format rows [from, to) in blocks on the threads of the current
+   * arena and write them to o in order.
+   */
+  void write_rows(std::ostream& o, const std::vector<draws_column>& cols,
+                  size_t from, size_t to, int sig_figs) {
+    const size_t block = 256;
+    const size_t n_blocks = (to - from + block - 1) / block;
+    // a bounded number of blocks is held in memory at a time
+    const size_t batch = 64;
+    std::vector<std::string> text(std::min(n_blocks, batch));
+    for (size_t b0 = 0; b0 < n_blocks; b0 += batch) {
+      size_t b1 = std::min(n_blocks, b0 + batch);
+      tbb::parallel_for(tbb::blocked_range<size_t>(b0, b1),
+                        [&](const tbb::blocked_range<size_t>& r) {
+        for (size_t b = r.begin(); b != r.end(); ++b)
+          format_rows(cols, from + b * block,
+                      std::min(to, from + (b + 1) * block), sig_figs,
+                      text[b - b0]);
+      });
+      for (size_t b = b0; b < b1; b++) o << text[b - b0];
+    }
+  }
+}
+
+/**
+ * Write one CSV file for each chain. columns is a list, for each
+ * chain, of the (double or integer) columns of draws in the order of
+ * names; the first n_warmup draws are written before the adaptation
+ * comments. headers, adaptation and footers are written as given.
+ * Return files; an error names every file that could
+ * not be written.
+ */
+SEXP write_draws_csv(SEXP files_, SEXP headers_, SEXP names_,
+                     SEXP columns_, SEXP n_warmup_, SEXP adaptation_,
+                     SEXP footers_, SEXP sig_figs_, SEXP n_threads_) {
+  BEGIN_RCPP
+  std::vector<std::string> files = Rcpp::as<std::vector<std::string> >(files_);
+  std::vector<std::string> headers = Rcpp::as<std::vector<std::string> >(headers_);
+  std::vector<std::string> names = Rcpp::as<std::vector<std::string> >(names_);
+  std::vector<std::string> adaptation = Rcpp::as<std::vector<std::string> >(adaptation_);
+  std::vector<std::string> footers = Rcpp::as<std::vector<std::string> >(footers_);
+  std::vector<int> n_warmup = Rcpp::as<std::vector<int> >(n_warmup_);
+  Rcpp::List columns(columns_);
+  int sig_figs = Rcpp::as<int>(sig_figs_);
+  int n_threads = Rcpp::as<int>(n_threads_);
+  const size_t n_chains = files.size();
+  if (headers.size() != n_chains || adaptation.size() != n_chains
+      || footers.size() != n_chains || n_warmup.size() != n_chains
+      || static_cast<size_t>(columns.size()) != n_chains)
+    throw std::domain_error("one element of each argument is needed for each chain");
+  if (sig_figs < 1 || sig_figs > 18)
+    throw std::domain_error("sig_figs should be between 1 and 18");
+
+  std::vector<std::vector<draws_column> > cols(n_chains);
+  std::vector<size_t> n_rows(n_chains, 0);
+  for (size_t c = 0; c < n_chains; c++) {
+    Rcpp::List chain(columns[c]);
+    if (static_cast<size_t>(chain.size()) != names.size())
+      throw std::domain_error("the draws of chain " + std::to_string(c + 1)
+                              + " do not match the names");
+    for (R_xlen_t j = 0; j < chain.size(); j++) {
+      SEXP x = chain[j];
+      size_t n = Rf_xlength(x);
+      if (j == 0) n_rows[c] = n;
+      if (n != n_rows[c])
+        throw std::domain_error("the columns of chain " + std::to_string(c + 1)
+                                + " differ in length");
+      draws_column col;
+      col.real = 0;
+      col.integer = 0;
+      if (TYPEOF(x) == REALSXP) col.real = REAL(x);
+      else if (TYPEOF(x) == INTSXP || TYPEOF(x) == LGLSXP) col.integer = INTEGER(x);
+      else throw std::domain_error("the draws should be numeric");
+      cols[c].push_back(col);
+    }
+    if (n_warmup[c] < 0 || static_cast<size_t>(n_warmup[c]) > n_rows[c])
+      throw std::domain_error("invalid number of warmup draws");
+  }
+
+  std::string header_line;
+  for (size_t j = 0; j < names.size(); j++) {
+    if (j) header_line += ',';
+    header_line += names[j];
+  }
+  header_line += '\n';
+
+  std::vector<char> failed(n_chains, 0);
+  tbb::task_arena arena(n_threads < 1 ? 1 : n_threads);
+  arena.execute([&] {
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, n_chains, 1),
+                      [&](const tbb::blocked_range<size_t>& r) {
+      for (size_t c = r.begin(); c != r.end(); ++c) {
+        std::ofstream o(files[c].c_str(), std::ios::binary);
+        if (!o) {
+          failed[c] = 1;
+          continue;
+        }
+        o << headers[c] << header_line;
+        write_rows(o, cols[c], 0, n_warmup[c], sig_figs);
+        o << adaptation[c];
+        write_rows(o, cols[c], n_warmup[c], n_rows[c], sig_figs);
+        o << footers[c];
+        o.close();
+        if (!o) failed[c] = 1;
+      }
+    });
+  });
+
+  std::string bad;
+  for (size_t c = 0; c < n_chains; c++) {
+    if (!failed[c]) continue;
+    if (!bad.empty()) bad += "', '";
+    bad += files[c];
+  }
+  if (!bad.empty())
+    throw std::runtime_error("failed to write '" + bad + "'");
+  return files_;
+  END_RCPP
+}
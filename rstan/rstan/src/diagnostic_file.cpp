@@ -0,0 +1,157 @@
+// This file is part of RStan
+// Copyright (C) 2012, 2013, 2014, 2015, 2016, 2017 Trustees of Columbia University
+//
+// RStan is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 3
+// of the License, or (at your option) any later version.
+//
+// RStan is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+/*
+ * Reader for the files written through diagnostic_writer when
+ * sampling with diagnostic_file (see read_stan_diagnostic in
+ * R/stan_csv.R). After the comments, the header names the sampler
+ * parameters (ending in "__"), then the K unconstrained parameters,
+ * their K momenta ("p_") and their K gradients ("g_"); each draw is a
+ * line of numbers, and the adaptation and timing are comments in
+ * between.
+ *
+ * The file is mapped into memory, its lines are found by a parallel
+ * scan for newlines, and the draws are parsed in parallel straight
+ * into the columns of the returned matrices.
+ */
+
+#include <rstan/csv_tokenizer.hpp>
+#include <Rcpp.h>
+#include <sstream>
+#include <string>
+#include <vector>
+
+RcppExport SEXP read_diagnostic_csv(SEXP file, SEXP n_threads);
+
+namespace {
+  bool ends_with(const std::string& x, const std::string& suffix) {
+    return x.size() >= suffix.size()
+      && x.compare(x.size() - suffix.size(), suffix.size(), suffix) == 0;
+  }
+
+  bool all_start_with(const std::vector<std::string>& names, size_t from,
+                      size_t n, const std::string& prefix) {
+    for (size_t j = from; j < from + n; j++)
+      if (names[j].compare(0, prefix.size(), prefix) != 0) return false;
+    return true;
+  }
+
+  Rcpp::NumericMatrix named_matrix(size_t n_rows,
+                                   const std::vector<std::string>& names,
+                                   size_t from, size_t n) {
+    Rcpp::NumericMatrix m(n_rows, n);
+    Rcpp::CharacterVector colnames(n);
+    for (size_t j = 0; j < n; j++) colnames[j] = names[from + j];
+    Rcpp::colnames(m) = colnames;
+    return m;
+  }
+}
+
+/**
+ * Return list(sampler_params, upars, momenta, gradients, comments),
+ * the first four being matrices with one row per draw. If the columns
+ * after the sampler parameters cannot be split into three blocks of
+ * unconstrained parameters, momenta and gradients (e.g., for
+ * Fixed_param), they all go to upars.
+ */
+SEXP read_diagnostic_csv(SEXP file, SEXP n_threads_) {
+  BEGIN_RCPP
+  std::string path = Rcpp::as<std::string>(file);
+  int n_threads = Rcpp::as<int>(n_threads_);
+  rstan::mapped_file f(path);
+  const char* data = f.data();
+  std::vector<size_t> starts = rstan::line_starts(data, f.size(), n_threads);
+
+  std::vector<std::string> comments;
+  std::vector<std::string> names;
+  std::vector<size_t> rows;
+  for (size_t i = 0; i < starts.size(); i++) {
+    const char* begin = data + starts[i];
+    const char* end = rstan::line_end(data, f.size(), starts, i);
+    if (begin == end) continue;
+    if (*begin == '#')
+      comments.push_back(std::string(begin, end));
+    else if (names.empty())
+      names = rstan::split_csv_names(begin, end);
+    else
+      rows.push_back(i);
+  }
+  if (names.empty())
+    throw std::domain_error("no header found in '" + path + "'");
+
+  const size_t n_cols = names.size();
+  size_t n_sampler = 0;
+  while (n_sampler < n_cols && ends_with(names[n_sampler], "__")) n_sampler++;
+  size_t K = (n_cols - n_sampler) / 3;
+  if ((n_cols - n_sampler) % 3 != 0
+      || !all_start_with(names, n_sampler + K, K, "p_")
+      || !all_start_with(names, n_sampler + 2 * K, K, "g_"))
+    K = 0;
+  const size_t n_upars = K ? K : n_cols - n_sampler;
+
+  const size_t N = rows.size();
+  Rcpp::NumericMatrix sampler_params = named_matrix(N, names, 0, n_sampler);
+  Rcpp::NumericMatrix upars = named_matrix(N, names, n_sampler, n_upars);
+  Rcpp::NumericMatrix momenta = named_matrix(N, names, n_sampler + K, K);
+  Rcpp::NumericMatrix gradients = named_matrix(N, names, n_sampler + 2 * K, K);
+
+  // the start of each column in the matrices it goes to
+  std::vector<double*> cols(n_cols);
+  for (size_t j = 0; j < n_sampler; j++)
+    cols[j] = sampler_params.begin() + j * N;
+  for (size_t j = 0; j < n_upars; j++)
+    cols[n_sampler + j] = upars.begin() + j * N;
+  for (size_t j = 0; j < K; j++) {
+    cols[n_sampler + K + j] = momenta.begin() + j * N;
+    cols[n_sampler + 2 * K + j] = gradients.begin() + j * N;
+  }
+
+  std::vector<char> bad(N, 0);
+  tbb::task_arena arena(n_threads < 1 ? 1 : n_threads);
+  arena.execute([&] {
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, N),
+                      [&](const tbb::blocked_range<size_t>& r) {
+      std::vector<double> row(n_cols);
+      for (size_t m = r.begin(); m != r.end(); ++m) {
+        size_t i = rows[m];
+        long n = rstan::parse_csv_doubles(data + starts[i],
+                                          rstan::line_end(data, f.size(),
+                                                          starts, i),
+                                          &row[0], n_cols);
+        if (n != static_cast<long>(n_cols)) {
+          bad[m] = 1;
+          continue;
+        }
+        for (size_t j = 0; j < n_cols; j++) cols[j][m] = row[j];
+      }
+    });
+  });
+  for (size_t m = 0; m < N; m++) {
+    if (!bad[m]) continue;
+    std::stringstream msg;
+    msg << "line " << rows[m] + 1 << " of '" << path
+        << "' does not have " << n_cols << " numbers";
+    throw std::domain_error(msg.str());
+  }
+
+  return Rcpp::List::create(Rcpp::Named("sampler_params") = sampler_params,
+                            Rcpp::Named("upars") = upars,
+                            Rcpp::Named("momenta") = momenta,
+                            Rcpp::Named("gradients") = gradients,
+                            Rcpp::Named("comments") = comments);
+  END_RCPP
+}
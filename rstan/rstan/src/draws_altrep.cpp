@@ -0,0 +1,177 @@
+// This file is part of RStan
+// Copyright (C) 2012, 2013, 2014, 2015, 2016, 2017 Trustees of Columbia University
+//
+// RStan is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 3
+// of the License, or (at your option) any later version.
+//
+// RStan is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+/*
+ * Numeric vectors whose values live in a native store of draws (an
+ * external pointer to a block of doubles, such as the shared region
+ * in shared_draws.cpp) rather than in R's heap. Reading goes straight
+ * to the store; a private R copy is only made when R asks for a
+ * writable pointer. When saved, the vector is written out as an
+ * ordinary numeric vector.
+ *
+ * Without ALTREP (R < 3.6) make_draws_view just copies.
+ */
+
+#include <R.h>
+#include <Rinternals.h>
+#include <R_ext/Rdynload.h>
+#include <Rversion.h>
+#include <cstring>
+
+#if defined(R_VERSION) && R_VERSION >= R_Version(3, 6, 0)
+#define RSTAN_DRAWS_ALTREP
+#include <R_ext/Altrep.h>
+#endif
+
+SEXP make_draws_view(SEXP store, double offset, R_xlen_t n);
+void init_draws_altrep(DllInfo* dll);
+
+static const double* store_ptr(SEXP store, double offset) {
+  const double* base = static_cast<const double*>(R_ExternalPtrAddr(store));
+  if (base == NULL)
+    Rf_error("the native store of the draws is no longer available");
+  return base + static_cast<R_xlen_t>(offset);
+}
+
+#ifdef RSTAN_DRAWS_ALTREP
+
+static R_altrep_class_t draws_view_class;
+
+/*
+ * data1: list(store, c(offset, length))
+ * data2: the private copy once made, R_NilValue before
+ */
+static double* view_info(SEXP x) {
+  return REAL(VECTOR_ELT(R_altrep_data1(x), 1));
+}
+
+static const double* view_ptr(SEXP x) {
+  return store_ptr(VECTOR_ELT(R_altrep_data1(x), 0), view_info(x)[0]);
+}
+
+static R_xlen_t view_length(SEXP x) {
+  return static_cast<R_xlen_t>(view_info(x)[1]);
+}
+
+static SEXP view_materialize(SEXP x) {
+  SEXP copy = R_altrep_data2(x);
+  if (copy == R_NilValue) {
+    R_xlen_t n = view_length(x);
+    PROTECT(copy = Rf_allocVector(REALSXP, n));
+    std::memcpy(REAL(copy), view_ptr(x), n * sizeof(double));
+    R_set_altrep_data2(x, copy);
+    UNPROTECT(1);
+  }
+  return copy;
+}
+
+static const double* view_read_ptr(SEXP x) {
+  SEXP copy = R_altrep_data2(x);
+  return copy == R_NilValue ? view_ptr(x) : REAL(copy);
+}
+
+static R_xlen_t draws_view_Length(SEXP x) {
+  return view_length(x);
+}
+
+static void* draws_view_Dataptr(SEXP x, Rboolean writeable) {
+  if (writeable)
+    return REAL(view_materialize(x));
+  return const_cast<double*>(view_read_ptr(x));
+}
+
+static const void* draws_view_Dataptr_or_null(SEXP x) {
+  return view_read_ptr(x);
+}
+
+static double draws_view_Elt(SEXP x, R_xlen_t i) {
+  return view_read_ptr(x)[i];
+}
+
+static R_xlen_t draws_view_Get_region(SEXP x, R_xlen_t i, R_xlen_t n,
+                                      double* buf) {
+  R_xlen_t len = view_length(x);
+  if (i >= len) return 0;
+  if (n > len - i) n = len - i;
+  std::memcpy(buf, view_read_ptr(x) + i, n * sizeof(double));
+  return n;
+}
+
+static SEXP draws_view_Duplicate(SEXP x, Rboolean deep) {
+  R_xlen_t n = view_length(x);
+  SEXP ans = PROTECT(Rf_allocVector(REALSXP, n));
+  std::memcpy(REAL(ans), view_read_ptr(x), n * sizeof(double));
+  UNPROTECT(1);
+  return ans;
+}
+
+static SEXP draws_view_Serialized_state(SEXP x) {
+  return view_materialize(x);
+}
+
+static SEXP draws_view_Unserialize(SEXP cls, SEXP state) {
+  return state;
+}
+
+static Rboolean draws_view_Inspect(SEXP x, int pre, int deep, int pvec,
+                                   void (*inspect_subtree)(SEXP, int, int, int)) {
+  Rprintf(" rstan draws (len=%lld, materialized=%s)\n",
+          static_cast<long long>(view_length(x)),
+          R_altrep_data2(x) == R_NilValue ? "F" : "T");
+  return TRUE;
+}
+
+void init_draws_altrep(DllInfo* dll) {
+  draws_view_class = R_make_altreal_class("rstan_draws", "rstan", dll);
+  R_set_altrep_Length_method(draws_view_class, draws_view_Length);
+  R_set_altrep_Duplicate_method(draws_view_class, draws_view_Duplicate);
+  R_set_altrep_Serialized_state_method(draws_view_class,
+                                       draws_view_Serialized_state);
+  R_set_altrep_Unserialize_method(draws_view_class, draws_view_Unserialize);
+  R_set_altrep_Inspect_method(draws_view_class, draws_view_Inspect);
+  R_set_altvec_Dataptr_method(draws_view_class, draws_view_Dataptr);
+  R_set_altvec_Dataptr_or_null_method(draws_view_class,
+                                      draws_view_Dataptr_or_null);
+  R_set_altreal_Elt_method(draws_view_class, draws_view_Elt);
+  R_set_altreal_Get_region_method(draws_view_class, draws_view_Get_region);
+}
+
+SEXP make_draws_view(SEXP store, double offset, R_xlen_t n) {
+  store_ptr(store, offset);
+  SEXP info = PROTECT(Rf_allocVector(REALSXP, 2));
+  REAL(info)[0] = offset;
+  REAL(info)[1] = static_cast<double>(n);
+  SEXP data1 = PROTECT(Rf_allocVector(VECSXP, 2));
+  SET_VECTOR_ELT(data1, 0, store);
+  SET_VECTOR_ELT(data1, 1, info);
+  SEXP ans = R_new_altrep(draws_view_class, data1, R_NilValue);
+  UNPROTECT(2);
+  return ans;
+}
+
+#else
+
+void init_draws_altrep(DllInfo* dll) { }
+
+SEXP make_draws_view(SEXP store, double offset, R_xlen_t n) {
+  SEXP ans = PROTECT(Rf_allocVector(REALSXP, n));
+  std::memcpy(REAL(ans), store_ptr(store, offset), n * sizeof(double));
+  UNPROTECT(1);
+  return ans;
+}
+
+#endif
@@ -0,0 +1,667 @@
+// This file is part of RStan
+// Copyright (C) 2012, 2013, 2014, 2015, 2016, 2017 Trustees of Columbia University
+//
+// RStan is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 3
+// of the License, or (at your option) any later version.
+//
+// RStan is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+/*
+ * A compact file format for the draws of a stanfit (see save_stanfit
+ * in R/draws_file.R).
+ *
+ * Each column of draws is cut into chunks of chunk_size values, and
+ * each chunk is encoded on its own, so any chunk can be decoded
+ * without the ones before it. Two codecs are supported:
+ *
+ *   CODEC_XOR_DELTA (lossless): each value is XORed with the previous
+ *     one in the chunk and the result written as bits, as in the
+ *     Gorilla time series format: a 0 bit if the XOR is zero (a
+ *     repeated draw, as after a rejected proposal); otherwise 10 and
+ *     the bits between the leading and trailing zeros of the previous
+ *     XOR written this way, if those zeros are at least as many; or
+ *     11, the number of leading zeros (6 bits), the number of
+ *     significant bits minus one (6 bits) and the significant bits.
+ *     Constant, repeated and integer-valued columns shrink a lot;
+ *     continuous draws, whose low mantissa bits are noise, only lose
+ *     the sign, exponent and leading mantissa bits they share with
+ *     the previous draw.
+ *   CODEC_FLOAT32 (lossy): each value is written as a 4 byte float.
+ *
+ * Layout, in the byte order of the machine that wrote the file:
+ *
+ *   header     magic "RSTANDRW", uint32 0x01020304, uint32 codec,
+ *              uint32 chunk_size, uint32 0, uint64 n_columns,
+ *              uint64 table_offset, uint64 meta_offset,
+ *              uint64 meta_length
+ *   chunks     the encoded chunks of all the columns
+ *   indexes    for each column, (n_chunks + 1) uint64 file offsets of
+ *              the starts of its chunks, the last being the end
+ *   table      for each column, uint64 n_rows, uint64 index_offset
+ *   meta       an R raw vector given by the caller, stored as is
+ *
+ * When the file is opened, it is mapped into memory and each column
+ * becomes an ALTREP vector that decodes chunks on demand.
+ */
+
+#include <R.h>
+#include <Rinternals.h>
+#include <R_ext/Rdynload.h>
+#include <Rversion.h>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#if defined(R_VERSION) && R_VERSION >= R_Version(3, 6, 0)
+#define RSTAN_DRAWS_ALTREP
+#include <R_ext/Altrep.h>
+#endif
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern SEXP draws_file_write(SEXP file, SEXP columns, SEXP codec,
+                             SEXP chunk_size, SEXP meta);
+extern SEXP draws_file_open(SEXP file);
+
+#ifdef __cplusplus
+}
+#endif
+
+void init_draws_file_altrep(DllInfo* dll);
+
+namespace {
+
+const char draws_file_magic[8] = {'R', 'S', 'T', 'A', 'N', 'D', 'R', 'W'};
+const uint32_t draws_file_endian = 0x01020304;
+
+enum draws_codec { CODEC_XOR_DELTA = 0, CODEC_FLOAT32 = 1 };
+
+struct draws_file_header {
+  char magic[8];
+  uint32_t endian;
+  uint32_t codec;
+  uint32_t chunk_size;
+  uint32_t reserved;
+  uint64_t n_columns;
+  uint64_t table_offset;
+  uint64_t meta_offset;
+  uint64_t meta_length;
+};
+
+/*
+ * Bits are written from the most significant bit of each byte on.
+ */
+class bit_writer {
+private:
+  std::vector<unsigned char>& out_;
+  uint64_t acc_;
+  int n_acc_;
+
+public:
+  explicit bit_writer(std::vector<unsigned char>& out)
+    : out_(out), acc_(0), n_acc_(0) { }
+
+  // write the low n (<= 64) bits of x
+  void write(uint64_t x, int n) {
+    while (n > 0) {
+      int take = n < 8 - n_acc_ ? n : 8 - n_acc_;
+      n -= take;
+      uint64_t bits = (x >> n) & ((uint64_t(1) << take) - 1);
+      acc_ = (acc_ << take) | bits;
+      n_acc_ += take;
+      if (n_acc_ == 8) {
+        out_.push_back(static_cast<unsigned char>(acc_));
+        acc_ = 0;
+        n_acc_ = 0;
+      }
+    }
+  }
+
+  void flush() {
+    if (n_acc_ > 0)
+      out_.push_back(static_cast<unsigned char>(acc_ << (8 - n_acc_)));
+    acc_ = 0;
+    n_acc_ = 0;
+  }
+};
+
+class bit_reader {
+private:
+  const unsigned char* p_;
+  const unsigned char* end_;
+  int n_used_;
+
+public:
+  bit_reader(const unsigned char* p, const unsigned char* end)
+    : p_(p), end_(end), n_used_(0) { }
+
+  // read n (<= 64) bits into x; false past the end
+  bool read(uint64_t& x, int n) {
+    x = 0;
+    while (n > 0) {
+      if (p_ >= end_) return false;
+      int take = n < 8 - n_used_ ? n : 8 - n_used_;
+      uint64_t bits = (*p_ >> (8 - n_used_ - take)) & ((1u << take) - 1);
+      x = (x << take) | bits;
+      n -= take;
+      n_used_ += take;
+      if (n_used_ == 8) {
+        ++p_;
+        n_used_ = 0;
+      }
+    }
+    return true;
+  }
+};
+
+int leading_zeros(uint64_t x) {
+  int n = 0;
+  for (uint64_t m = uint64_t(1) << 63; m && !(x & m); m >>= 1) n++;
+  return n;
+}
+
+int trailing_zeros(uint64_t x) {
+  int n = 0;
+  for (; n < 64 && !(x & 1); x >>= 1) n++;
+  return n;
+}
+
+void encode_chunk(const double* x, size_t n, uint32_t codec,
+                  std::vector<unsigned char>& out) {
+  if (codec == CODEC_FLOAT32) {
+    for (size_t i = 0; i < n; i++) {
+      float f = static_cast<float>(x[i]);
+      const unsigned char* b = reinterpret_cast<const unsigned char*>(&f);
+      out.insert(out.end(), b, b + sizeof(float));
+    }
+    return;
+  }
+  bit_writer w(out);
+  uint64_t prev = 0;
+  // no window before the first nonzero XOR
+  int lead = 65, trail = 0;
+  for (size_t i = 0; i < n; i++) {
+    uint64_t bits;
+    std::memcpy(&bits, x + i, sizeof(bits));
+    uint64_t d = bits ^ prev;
+    prev = bits;
+    if (d == 0) {
+      w.write(0, 1);
+      continue;
+    }
+    int l = leading_zeros(d);
+    int t = trailing_zeros(d);
+    if (l >= lead && t >= trail) {
+      w.write(2, 2);
+      w.write(d >> trail, 64 - lead - trail);
+    } else {
+      w.write(3, 2);
+      w.write(l, 6);
+      w.write(63 - l - t, 6);
+      w.write(d >> t, 64 - l - t);
+      lead = l;
+      trail = t;
+    }
+  }
+  w.flush();
+}
+
+/*
+ * Decode n values from [p, end) into x; false if the chunk is
+ * malformed.
+ */
+bool decode_chunk(const unsigned char* p, const unsigned char* end,
+                  size_t n, uint32_t codec, double* x) {
+  if (codec == CODEC_FLOAT32) {
+    if (static_cast<size_t>(end - p) < n * sizeof(float)) return false;
+    for (size_t i = 0; i < n; i++, p += sizeof(float)) {
+      float f;
+      std::memcpy(&f, p, sizeof(float));
+      x[i] = f;
+    }
+    return true;
+  }
+  bit_reader r(p, end);
+  uint64_t prev = 0;
+  int lead = 65, trail = 0;
+  for (size_t i = 0; i < n; i++) {
+    uint64_t control, d;
+    if (!r.read(control, 1)) return false;
+    if (control) {
+      if (!r.read(control, 1)) return false;
+      if (control) {
+        uint64_t l, len;
+        if (!r.read(l, 6) || !r.read(len, 6)) return false;
+        if (l + len + 1 > 64) return false;
+        lead = static_cast<int>(l);
+        trail = 64 - lead - static_cast<int>(len) - 1;
+      } else if (lead > 64) {
+        return false;
+      }
+      if (!r.read(d, 64 - lead - trail)) return false;
+      prev ^= d << trail;
+    }
+    std::memcpy(x + i, &prev, sizeof(prev));
+  }
+  return true;
+}
+
+}
+
+/*
+ * Write the file; the columns must all be numeric vectors. Returns
+ * false on an I/O error. Kept apart from draws_file_write so that no
+ * R error is raised while the stream and buffers are alive.
+ */
+static bool write_draws_file(const char* path, SEXP columns, uint32_t codec,
+                             int chunk_size, SEXP meta) {
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if (!out)
+    return false;
+
+  draws_file_header h;
+  std::memset(&h, 0, sizeof(h));
+  std::memcpy(h.magic, draws_file_magic, sizeof(h.magic));
+  h.endian = draws_file_endian;
+  h.codec = codec;
+  h.chunk_size = static_cast<uint32_t>(chunk_size);
+  h.n_columns = XLENGTH(columns);
+  out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+
+  uint64_t pos = sizeof(h);
+  std::vector<std::vector<uint64_t> > indexes(h.n_columns);
+  std::vector<uint64_t> table(2 * h.n_columns);
+  std::vector<unsigned char> buf;
+  for (R_xlen_t j = 0; j < XLENGTH(columns); j++) {
+    SEXP col = VECTOR_ELT(columns, j);
+    const double* x = REAL(col);
+    R_xlen_t n = XLENGTH(col);
+    table[2 * j] = n;
+    for (R_xlen_t start = 0; start < n; start += chunk_size) {
+      size_t len = static_cast<size_t>(n - start) < static_cast<size_t>(chunk_size)
+        ? n - start : chunk_size;
+      buf.clear();
+      encode_chunk(x + start, len, codec, buf);
+      indexes[j].push_back(pos);
+      out.write(reinterpret_cast<const char*>(buf.data()), buf.size());
+      pos += buf.size();
+    }
+    indexes[j].push_back(pos);
+  }
+  for (size_t j = 0; j < indexes.size(); j++) {
+    table[2 * j + 1] = pos;
+    out.write(reinterpret_cast<const char*>(indexes[j].data()),
+              indexes[j].size() * sizeof(uint64_t));
+    pos += indexes[j].size() * sizeof(uint64_t);
+  }
+  h.table_offset = pos;
+  out.write(reinterpret_cast<const char*>(table.data()),
+            table.size() * sizeof(uint64_t));
+  pos += table.size() * sizeof(uint64_t);
+  h.meta_offset = pos;
+  h.meta_length = XLENGTH(meta);
+  out.write(reinterpret_cast<const char*>(RAW(meta)), XLENGTH(meta));
+  out.seekp(0);
+  out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+  out.close();
+  return static_cast<bool>(out);
+}
+
+SEXP draws_file_write(SEXP file, SEXP columns, SEXP codec_,
+                      SEXP chunk_size_, SEXP meta) {
+  const char* path = CHAR(STRING_ELT(file, 0));
+  uint32_t codec = static_cast<uint32_t>(Rf_asInteger(codec_));
+  int chunk_size = Rf_asInteger(chunk_size_);
+  if (codec != CODEC_XOR_DELTA && codec != CODEC_FLOAT32)
+    Rf_error("unknown codec for the draws file");
+  if (chunk_size < 1)
+    Rf_error("'chunk_size' must be positive");
+  if (TYPEOF(columns) != VECSXP || TYPEOF(meta) != RAWSXP)
+    Rf_error("invalid arguments for writing a draws file");
+  for (R_xlen_t j = 0; j < XLENGTH(columns); j++)
+    if (TYPEOF(VECTOR_ELT(columns, j)) != REALSXP)
+      Rf_error("the columns of a draws file must be numeric vectors");
+  if (!write_draws_file(path, columns, codec, chunk_size, meta))
+    Rf_error("failed to write file '%s'", path);
+  return R_NilValue;
+}
+
+namespace {
+
+/*
+ * The mapped file is held by an external pointer whose protected
+ * slot keeps the length of the mapping.
+ */
+const unsigned char* mapped_file(SEXP store) {
+  const unsigned char* p
+    = static_cast<const unsigned char*>(R_ExternalPtrAddr(store));
+  if (p == NULL)
+    Rf_error("the draws file is no longer mapped");
+  return p;
+}
+
+size_t mapped_size(SEXP store) {
+  return static_cast<size_t>(REAL(R_ExternalPtrProtected(store))[0]);
+}
+
+void unmap_file(SEXP store) {
+  void* p = R_ExternalPtrAddr(store);
+  if (p == NULL) return;
+#ifndef _WIN32
+  munmap(p, mapped_size(store));
+#endif
+  R_ClearExternalPtr(store);
+}
+
+/*
+ * A column of a mapped draws file: where to find its chunk index and
+ * how to decode its chunks.
+ */
+struct packed_column {
+  const unsigned char* file;
+  size_t file_size;
+  R_xlen_t n_rows;
+  uint64_t index_offset;
+  uint32_t codec;
+  uint32_t chunk_size;
+
+  size_t n_chunks() const {
+    return (n_rows + chunk_size - 1) / chunk_size;
+  }
+
+  size_t chunk_length(size_t c) const {
+    return c + 1 < n_chunks() ? chunk_size
+      : n_rows - c * static_cast<size_t>(chunk_size);
+  }
+
+  bool decode(size_t c, double* x) const {
+    // the offsets are not necessarily aligned
+    uint64_t bounds[2];
+    std::memcpy(bounds, file + index_offset + c * sizeof(uint64_t),
+                sizeof(bounds));
+    return bounds[0] <= bounds[1] && bounds[1] <= file_size
+      && decode_chunk(file + bounds[0], file + bounds[1], chunk_length(c),
+                      codec, x);
+  }
+};
+
+bool decode_range_impl(const packed_column& col, R_xlen_t i, R_xlen_t n,
+                       double* x) {
+  std::vector<double> buf(col.chunk_size);
+  R_xlen_t done = 0;
+  while (done < n) {
+    size_t c = (i + done) / col.chunk_size;
+    size_t first = (i + done) - c * col.chunk_size;
+    if (!col.decode(c, buf.data()))
+      return false;
+    size_t take = col.chunk_length(c) - first;
+    if (static_cast<R_xlen_t>(take) > n - done) take = n - done;
+    std::memcpy(x + done, buf.data() + first, take * sizeof(double));
+    done += take;
+  }
+  return true;
+}
+
+void decode_range(const packed_column& col, R_xlen_t i, R_xlen_t n,
+                  double* x) {
+  if (!decode_range_impl(col, i, n, x))
+    Rf_error("the draws file is corrupt");
+}
+
+}
+
+#ifdef RSTAN_DRAWS_ALTREP
+
+static R_altrep_class_t packed_draws_class;
+
+/*
+ * data1: list(store, c(n_rows, index_offset, codec, chunk_size, chunk),
+ *             the decoded chunk 'chunk' (-1 for none) or NULL)
+ * data2: the decoded column once its data pointer has been asked for
+ *
+ * Elements are read one at a time (as by x[1:10]) through the one
+ * decoded chunk, so only the chunks involved are decoded.
+ */
+static packed_column packed_info(SEXP x) {
+  SEXP data1 = R_altrep_data1(x);
+  SEXP store = VECTOR_ELT(data1, 0);
+  const double* info = REAL(VECTOR_ELT(data1, 1));
+  packed_column col;
+  col.file = mapped_file(store);
+  col.file_size = mapped_size(store);
+  col.n_rows = static_cast<R_xlen_t>(info[0]);
+  col.index_offset = static_cast<uint64_t>(info[1]);
+  col.codec = static_cast<uint32_t>(info[2]);
+  col.chunk_size = static_cast<uint32_t>(info[3]);
+  return col;
+}
+
+/*
+ * The column decoded into a new vector (or data2), not kept.
+ */
+static SEXP packed_decoded(SEXP x) {
+  SEXP full = R_altrep_data2(x);
+  if (full == R_NilValue) {
+    packed_column col = packed_info(x);
+    PROTECT(full = Rf_allocVector(REALSXP, col.n_rows));
+    decode_range(col, 0, col.n_rows, REAL(full));
+    UNPROTECT(1);
+  }
+  return full;
+}
+
+static SEXP packed_decode_all(SEXP x) {
+  SEXP full = R_altrep_data2(x);
+  if (full == R_NilValue) {
+    packed_column col = packed_info(x);
+    PROTECT(full = Rf_allocVector(REALSXP, col.n_rows));
+    decode_range(col, 0, col.n_rows, REAL(full));
+    R_set_altrep_data2(x, full);
+    UNPROTECT(1);
+  }
+  return full;
+}
+
+static R_xlen_t packed_draws_Length(SEXP x) {
+  return static_cast<R_xlen_t>(REAL(VECTOR_ELT(R_altrep_data1(x), 1))[0]);
+}
+
+static void* packed_draws_Dataptr(SEXP x, Rboolean writeable) {
+  return REAL(packed_decode_all(x));
+}
+
+static const void* packed_draws_Dataptr_or_null(SEXP x) {
+  SEXP full = R_altrep_data2(x);
+  return full == R_NilValue ? NULL : REAL(full);
+}
+
+static double packed_draws_Elt(SEXP x, R_xlen_t i) {
+  SEXP full = R_altrep_data2(x);
+  if (full != R_NilValue) return REAL(full)[i];
+  packed_column col = packed_info(x);
+  SEXP data1 = R_altrep_data1(x);
+  double* info = REAL(VECTOR_ELT(data1, 1));
+  SEXP chunk = VECTOR_ELT(data1, 2);
+  if (chunk == R_NilValue) {
+    chunk = Rf_allocVector(REALSXP, col.chunk_size);
+    SET_VECTOR_ELT(data1, 2, chunk);
+    info[4] = -1;
+  }
+  size_t c = i / col.chunk_size;
+  if (info[4] != static_cast<double>(c)) {
+    info[4] = -1;
+    if (!col.decode(c, REAL(chunk)))
+      Rf_error("the draws file is corrupt");
+    info[4] = static_cast<double>(c);
+  }
+  return REAL(chunk)[i - c * col.chunk_size];
+}
+
+static R_xlen_t packed_draws_Get_region(SEXP x, R_xlen_t i, R_xlen_t n,
+                                        double* buf) {
+  R_xlen_t len = packed_draws_Length(x);
+  if (i >= len) return 0;
+  if (n > len - i) n = len - i;
+  SEXP full = R_altrep_data2(x);
+  if (full != R_NilValue)
+    std::memcpy(buf, REAL(full) + i, n * sizeof(double));
+  else
+    decode_range(packed_info(x), i, n, buf);
+  return n;
+}
+
+static SEXP packed_draws_Duplicate(SEXP x, Rboolean deep) {
+  SEXP full = R_altrep_data2(x);
+  return full == R_NilValue ? packed_decoded(x) : Rf_duplicate(full);
+}
+
+static SEXP packed_draws_Serialized_state(SEXP x) {
+  return packed_decoded(x);
+}
+
+static SEXP packed_draws_Unserialize(SEXP cls, SEXP state) {
+  return state;
+}
+
+static Rboolean packed_draws_Inspect(SEXP x, int pre, int deep, int pvec,
+                                     void (*inspect_subtree)(SEXP, int, int, int)) {
+  Rprintf(" rstan packed draws (len=%lld, decoded=%s)\n",
+          static_cast<long long>(packed_draws_Length(x)),
+          R_altrep_data2(x) == R_NilValue ? "F" : "T");
+  return TRUE;
+}
+
+void init_draws_file_altrep(DllInfo* dll) {
+  packed_draws_class = R_make_altreal_class("rstan_packed_draws", "rstan", dll);
+  R_set_altrep_Length_method(packed_draws_class, packed_draws_Length);
+  R_set_altrep_Duplicate_method(packed_draws_class, packed_draws_Duplicate);
+  R_set_altrep_Serialized_state_method(packed_draws_class,
+                                       packed_draws_Serialized_state);
+  R_set_altrep_Unserialize_method(packed_draws_class, packed_draws_Unserialize);
+  R_set_altrep_Inspect_method(packed_draws_class, packed_draws_Inspect);
+  R_set_altvec_Dataptr_method(packed_draws_class, packed_draws_Dataptr);
+  R_set_altvec_Dataptr_or_null_method(packed_draws_class,
+                                      packed_draws_Dataptr_or_null);
+  R_set_altreal_Elt_method(packed_draws_class, packed_draws_Elt);
+  R_set_altreal_Get_region_method(packed_draws_class, packed_draws_Get_region);
+}
+
+static SEXP make_packed_column(SEXP store, const packed_column& col) {
+  SEXP info = PROTECT(Rf_allocVector(REALSXP, 5));
+  REAL(info)[0] = static_cast<double>(col.n_rows);
+  REAL(info)[1] = static_cast<double>(col.index_offset);
+  REAL(info)[2] = col.codec;
+  REAL(info)[3] = col.chunk_size;
+  REAL(info)[4] = -1;
+  SEXP data1 = PROTECT(Rf_allocVector(VECSXP, 3));
+  SET_VECTOR_ELT(data1, 0, store);
+  SET_VECTOR_ELT(data1, 1, info);
+  SET_VECTOR_ELT(data1, 2, R_NilValue);
+  SEXP ans = R_new_altrep(packed_draws_class, data1, R_NilValue);
+  UNPROTECT(2);
+  return ans;
+}
+
+#else
+
+void init_draws_file_altrep(DllInfo* dll) { }
+
+static SEXP make_packed_column(SEXP store, const packed_column& col) {
+  SEXP ans = PROTECT(Rf_allocVector(REALSXP, col.n_rows));
+  decode_range(col, 0, col.n_rows, REAL(ans));
+  UNPROTECT(1);
+  return ans;
+}
+
+#endif
+
+/*
+ * Map a draws file and return list(meta = <raw>, columns = <list>),
+ * with the columns decoded lazily where ALTREP is available.
+ */
+SEXP draws_file_open(SEXP file) {
+#ifdef _WIN32
+  Rf_error("reading draws files is not supported on Windows");
+  return R_NilValue;
+#else
+  const char* path = CHAR(STRING_ELT(file, 0));
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    Rf_error("failed to open file '%s'", path);
+  struct stat st;
+  if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(draws_file_header)) {
+    close(fd);
+    Rf_error("'%s' is not a draws file", path);
+  }
+  size_t size = st.st_size;
+  void* p = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED)
+    Rf_error("failed to map file '%s'", path);
+
+  SEXP prot = PROTECT(Rf_ScalarReal(static_cast<double>(size)));
+  SEXP store = PROTECT(R_MakeExternalPtr(p, R_NilValue, prot));
+  R_RegisterCFinalizerEx(store, unmap_file, TRUE);
+
+  draws_file_header h;
+  std::memcpy(&h, p, sizeof(h));
+  if (std::memcmp(h.magic, draws_file_magic, sizeof(h.magic)) != 0)
+    Rf_error("'%s' is not a draws file", path);
+  if (h.endian != draws_file_endian)
+    Rf_error("'%s' was written on a machine with a different byte order", path);
+  if (h.table_offset + 2 * h.n_columns * sizeof(uint64_t) > size
+      || h.meta_offset + h.meta_length > size
+      || h.chunk_size == 0)
+    Rf_error("the draws file '%s' is corrupt", path);
+
+  const unsigned char* base = static_cast<const unsigned char*>(p);
+  SEXP meta = PROTECT(Rf_allocVector(RAWSXP, h.meta_length));
+  std::memcpy(RAW(meta), base + h.meta_offset, h.meta_length);
+
+  SEXP columns = PROTECT(Rf_allocVector(VECSXP, h.n_columns));
+  for (uint64_t j = 0; j < h.n_columns; j++) {
+    uint64_t entry[2];
+    std::memcpy(entry, base + h.table_offset + 2 * j * sizeof(uint64_t),
+                sizeof(entry));
+    packed_column col;
+    col.file = base;
+    col.file_size = size;
+    col.n_rows = static_cast<R_xlen_t>(entry[0]);
+    col.index_offset = entry[1];
+    col.codec = h.codec;
+    col.chunk_size = h.chunk_size;
+    if (col.index_offset + (col.n_chunks() + 1) * sizeof(uint64_t) > size)
+      Rf_error("the draws file '%s' is corrupt", path);
+    SET_VECTOR_ELT(columns, j, make_packed_column(store, col));
+  }
+
+  SEXP ans = PROTECT(Rf_allocVector(VECSXP, 2));
+  SET_VECTOR_ELT(ans, 0, meta);
+  SET_VECTOR_ELT(ans, 1, columns);
+  SEXP names = PROTECT(Rf_allocVector(STRSXP, 2));
+  SET_STRING_ELT(names, 0, Rf_mkChar("meta"));
+  SET_STRING_ELT(names, 1, Rf_mkChar("columns"));
+  Rf_setAttrib(ans, R_NamesSymbol, names);
+  UNPROTECT(6);
+  return ans;
+#endif
+}
@@ -35,6 +35,8 @@ using namespace Rcpp;
 
 RcppExport SEXP _rcpp_module_boot_class_model_base();
 RcppExport SEXP _rcpp_module_boot_class_stan_fit();
+void init_draws_altrep(DllInfo* dll);
+void init_draws_file_altrep(DllInfo* dll);
 
 #ifdef __cplusplus
 extern "C"  {
@@ -43,13 +45,35 @@ SEXP effective_sample_size(SEXP sim, SEXP n_);
 SEXP effective_sample_size2(SEXP sims);
 SEXP split_potential_scale_reduction(SEXP sim, SEXP n_);
 SEXP split_potential_scale_reduction2(SEXP sims_);
+SEXP multivariate_effective_sample_size(SEXP sims, SEXP batch_size);
+SEXP multivariate_potential_scale_reduction(SEXP sims);
 SEXP CPP_read_comments(SEXP file, SEXP n);
 SEXP stan_prob_autocovariance(SEXP v);
 SEXP is_Null_NS(SEXP ns);
+SEXP CPP_as_integer_if_doable(SEXP x);
+SEXP CPP_data_preprocess(SEXP data);
+SEXP CPP_read_rdump(SEXP file);
+SEXP CPP_write_rdump(SEXP file, SEXP values, SEXP append, SEXP width);
 SEXP CPP_stan_version();
 SEXP extract_sparse_components(SEXP A);
 SEXP get_rng_(SEXP seed);
 SEXP get_stream_();
+SEXP CPP_shared_draws_alloc(SEXP n);
+SEXP CPP_shared_draws_write(SEXP shm, SEXP offset, SEXP x);
+SEXP CPP_shared_draws_read(SEXP shm, SEXP offset, SEXP n);
+SEXP draws_file_write(SEXP file, SEXP columns, SEXP codec, SEXP chunk_size,
+                      SEXP meta);
+SEXP draws_file_open(SEXP file);
+SEXP read_diagnostic_csv(SEXP file, SEXP n_threads);
+SEXP write_draws_csv(SEXP files, SEXP headers, SEXP names, SEXP columns,
+                     SEXP n_warmup, SEXP adaptation, SEXP footers,
+                     SEXP sig_figs, SEXP n_threads);
+SEXP unix_socket_listen(SEXP path);
+SEXP unix_socket_accept(SEXP fd, SEXP timeout);
+SEXP unix_socket_connect(SEXP path);
+SEXP unix_socket_read(SEXP fd, SEXP timeout, SEXP max);
+SEXP unix_socket_write(SEXP fd, SEXP x);
+SEXP unix_socket_close(SEXP fd);
 
 #ifdef __cplusplus
 }
@@ -63,13 +87,32 @@ static const R_CallMethodDef CallEntries[] = {
   CALLDEF(effective_sample_size2, 1),
   CALLDEF(split_potential_scale_reduction, 2),
   CALLDEF(split_potential_scale_reduction2, 1),
+  CALLDEF(multivariate_effective_sample_size, 2),
+  CALLDEF(multivariate_potential_scale_reduction, 1),
   CALLDEF(CPP_read_comments, 2),
   CALLDEF(stan_prob_autocovariance, 1),
   CALLDEF(is_Null_NS, 1),
+  CALLDEF(CPP_as_integer_if_doable, 1),
+  CALLDEF(CPP_data_preprocess, 1),
+  CALLDEF(CPP_read_rdump, 1),
+  CALLDEF(CPP_write_rdump, 4),
   CALLDEF(CPP_stan_version, 0),
   CALLDEF(extract_sparse_components, 1),
   CALLDEF(get_rng_, 1),
   CALLDEF(get_stream_, 0),
+  CALLDEF(CPP_shared_draws_alloc, 1),
+  CALLDEF(CPP_shared_draws_write, 3),
+  CALLDEF(CPP_shared_draws_read, 3),
+  CALLDEF(draws_file_write, 5),
+  CALLDEF(draws_file_open, 1),
+  CALLDEF(read_diagnostic_csv, 2),
+  CALLDEF(write_draws_csv, 9),
+  CALLDEF(unix_socket_listen, 1),
+  CALLDEF(unix_socket_accept, 2),
+  CALLDEF(unix_socket_connect, 1),
+  CALLDEF(unix_socket_read, 3),
+  CALLDEF(unix_socket_write, 2),
+  CALLDEF(unix_socket_close, 1),
   {"_rcpp_module_boot_class_model_base", (DL_FUNC) &_rcpp_module_boot_class_model_base, 0},
   {"_rcpp_module_boot_class_stan_fit", (DL_FUNC) &_rcpp_module_boot_class_stan_fit, 0},
   {NULL, NULL, 0}
@@ -81,6 +124,8 @@ extern "C"  {
 void attribute_visible R_init_rstan(DllInfo *dll) {
   R_registerRoutines(dll, NULL, CallEntries, NULL, NULL);
   R_useDynamicSymbols(dll, FALSE);
+  init_draws_altrep(dll);
+  init_draws_file_altrep(dll);
   // The call to R_useDynamicSymbols indicates that if the correct C
   // entry point is not found in the shared library, then an error
   // should be signaled.  Currently, the default
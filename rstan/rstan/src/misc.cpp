@@ -19,12 +19,16 @@
 
 #include <R.h>
 #include <Rinternals.h>
+#include <climits>
+#include <cmath>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 extern SEXP is_Null_NS(SEXP ns);
+extern SEXP CPP_as_integer_if_doable(SEXP x);
+extern SEXP CPP_data_preprocess(SEXP data);
 
 #ifdef __cplusplus
 }
@@ -51,3 +55,105 @@ SEXP is_Null_NS(SEXP ns) {
   return ans;
 }
 
+
+/*
+ * Whether the n doubles of x are all whole numbers smaller than
+ * INT_MAX in absolute value (NaN and infinite values are not). The
+ * test has no branch within a block, so it vectorizes.
+ */
+static bool doubles_are_ints(const double* x, R_xlen_t n) {
+  const R_xlen_t block = 1024;
+  for (R_xlen_t i = 0; i < n; i += block) {
+    R_xlen_t end = n - i < block ? n : i + block;
+    int bad = 0;
+    for (R_xlen_t j = i; j < end; j++)
+      bad |= !(std::fabs(x[j]) < INT_MAX) | (x[j] != std::trunc(x[j]));
+    if (bad) return false;
+  }
+  return true;
+}
+
+/*
+ * An integer vector with the values and all the attributes of x, a
+ * double vector that passed doubles_are_ints or a logical vector, as
+ * storage.mode(x) <- "integer" gives.
+ */
+static SEXP as_int_vector(SEXP x) {
+  R_xlen_t n = XLENGTH(x);
+  SEXP y = PROTECT(Rf_allocVector(INTSXP, n));
+  int* py = INTEGER(y);
+  if (TYPEOF(x) == REALSXP) {
+    const double* px = REAL(x);
+    for (R_xlen_t i = 0; i < n; i++) py[i] = static_cast<int>(px[i]);
+  } else {
+    const int* px = LOGICAL(x);
+    for (R_xlen_t i = 0; i < n; i++) py[i] = px[i];
+  }
+  DUPLICATE_ATTRIB(y, x);
+  UNPROTECT(1);
+  return y;
+}
+
+/*
+ * x as an integer vector if it is a double vector of whole numbers
+ * (see doubles_are_ints), x itself otherwise.
+ */
+SEXP CPP_as_integer_if_doable(SEXP x) {
+  if (TYPEOF(x) == REALSXP && doubles_are_ints(REAL(x), XLENGTH(x)))
+    return as_int_vector(x);
+  return x;
+}
+
+/*
+ * The numeric part of data_preprocess, in one pass over each element
+ * of the named list data (of numeric or logical vectors): stop at NA,
+ * and store logical vectors and double vectors of whole numbers as
+ * integers. Elements that are not converted are not copied.
+ */
+SEXP CPP_data_preprocess(SEXP data) {
+  if (TYPEOF(data) != VECSXP)
+    Rf_error("data must be a list");
+  R_xlen_t n = XLENGTH(data);
+  SEXP names = Rf_getAttrib(data, R_NamesSymbol);
+  SEXP ans = PROTECT(Rf_allocVector(VECSXP, n));
+  for (R_xlen_t k = 0; k < n; k++) {
+    SEXP x = VECTOR_ELT(data, k);
+    R_xlen_t len = XLENGTH(x);
+    bool has_na = false;
+    switch (TYPEOF(x)) {
+    case REALSXP: {
+      const double* px = REAL(x);
+      if (doubles_are_ints(px, len)) {
+        x = as_int_vector(x);
+        break;
+      }
+      for (R_xlen_t i = 0; i < len && !has_na; i++)
+        has_na = ISNAN(px[i]);
+      break;
+    }
+    case INTSXP: {
+      const int* px = INTEGER(x);
+      for (R_xlen_t i = 0; i < len && !has_na; i++)
+        has_na = px[i] == NA_INTEGER;
+      break;
+    }
+    case LGLSXP: {
+      const int* px = LOGICAL(x);
+      for (R_xlen_t i = 0; i < len && !has_na; i++)
+        has_na = px[i] == NA_LOGICAL;
+      if (!has_na) x = as_int_vector(x);
+      break;
+    }
+    default:
+      Rf_error("data with name %s is not numeric",
+               Rf_isNull(names) ? "" : CHAR(STRING_ELT(names, k)));
+    }
+    if (has_na)
+      Rf_error("Stan does not support NA (in %s) in data",
+               Rf_isNull(names) ? "" : CHAR(STRING_ELT(names, k)));
+    SET_VECTOR_ELT(ans, k, x);
+  }
+  Rf_setAttrib(ans, R_NamesSymbol, names);
+  UNPROTECT(1);
+  return ans;
+}
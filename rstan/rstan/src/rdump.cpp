@@ -0,0 +1,278 @@
+// This file is part of RStan
+// Copyright (C) 2012, 2013, 2014, 2015, 2016, 2017 Trustees of Columbia University
+//
+// RStan is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 3
+// of the License, or (at your option) any later version.
+//
+// RStan is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+/*
+ * Reading and writing the R dump format of Stan data (see read_rdump
+ * and stan_rdump in R/misc.R) without going through the R parser or
+ * R string formatting. Reading uses Stan's own parser,
+ * stan::io::dump_reader, so what is read is what a model would see,
+ * but it is returned as source() would.
+ */
+
+#include <stan/io/dump.hpp>
+#include <Rcpp.h>
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined(__has_include)
+#if __has_include(<charconv>)
+#include <charconv>
+#endif
+#endif
+
+RcppExport SEXP CPP_read_rdump(SEXP file);
+RcppExport SEXP CPP_write_rdump(SEXP file, SEXP values, SEXP append,
+                                SEXP width);
+
+namespace {
+  const size_t rdump_chunk_size = 1 << 20;
+
+  void append_number(std::string& out, double x) {
+    if (ISNA(x)) {
+      out += "NA";
+    } else if (std::isnan(x)) {
+      out += "NaN";
+    } else if (std::isinf(x)) {
+      out += x > 0 ? "Inf" : "-Inf";
+    } else {
+      // 15 significant digits, as as.character() in R
+      char buf[32];
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+      char* end = std::to_chars(buf, buf + sizeof(buf), x,
+                                std::chars_format::general, 15).ptr;
+#else
+      char* end = buf + std::snprintf(buf, sizeof(buf), "%.15g", x);
+#endif
+      // whole numbers beyond int would be read back as (overflowing)
+      // ints, so they get an exponent as in R: 1.1e+10, not 11000000000
+      if (std::fabs(x) > INT_MAX
+          && std::find(buf, end, '.') == end && std::find(buf, end, 'e') == end) {
+        end = buf + std::snprintf(buf, sizeof(buf), "%.14e", x);
+        char* e = std::find(buf, end, 'e');
+        char* m = e;
+        while (m[-1] == '0') --m;
+        if (m[-1] == '.') --m;
+        std::string exponent(e, end);
+        end = std::copy(exponent.begin(), exponent.end(), m);
+      }
+      out.append(buf, end);
+    }
+  }
+
+  void append_number(std::string& out, int x) {
+    if (x == NA_INTEGER) {
+      out += "NA";
+      return;
+    }
+    char buf[16];
+    int n = std::snprintf(buf, sizeof(buf), "%d", x);
+    out.append(buf, n);
+  }
+
+  /**
+   * Append "c(x1, x2, ...)" to out, starting a new line after a comma
+   * when a line would get longer than width. col is the length of the
+   * current line; flush is called when out gets long.
+   */
+  template <typename T, class F>
+  void append_values(std::string& out, size_t& col, const T* x, R_xlen_t n,
+                     size_t width, F flush) {
+    std::string token;
+    out += "c(";
+    col += 2;
+    for (R_xlen_t i = 0; i < n; i++) {
+      token.clear();
+      append_number(token, x[i]);
+      if (i > 0) {
+        if (col + 2 + token.size() > width) {
+          out += ",\n";
+          col = 0;
+        } else {
+          out += ", ";
+          col += 2;
+        }
+      }
+      out += token;
+      col += token.size();
+      if (out.size() >= rdump_chunk_size) flush();
+    }
+    out += ")";
+    col++;
+  }
+
+  /**
+   * Whether the value of the variable whose text starts at begin (and
+   * ends before end) is written as structure(...): a 1-D array, which
+   * dump_reader cannot tell from a vector.
+   */
+  bool is_structure(const std::string& text, std::streamoff begin,
+                    std::streamoff end, const std::string& name) {
+    if (begin < 0) return false;
+    size_t from = text.find(name, begin);
+    size_t to = end < 0 ? text.size() : static_cast<size_t>(end);
+    if (from >= to) return false;
+    from = text.find_first_not_of(" \t\r\n\"'<-=", from + name.size());
+    return from < to && text.compare(from, 9, "structure") == 0;
+  }
+}
+
+/**
+ * Read a file in the R dump format into a named list as source() would:
+ * numbers are doubles (integer(0) stays an integer vector) and arrays,
+ * including 1-D ones, have their dimensions. Return NULL if Stan's
+ * parser cannot read the whole file, for R to source() it instead.
+ */
+SEXP CPP_read_rdump(SEXP file) {
+  BEGIN_RCPP
+  std::string path = Rcpp::as<std::string>(file);
+  std::ifstream f(path.c_str(), std::ios::in | std::ios::binary);
+  if (!f)
+    throw std::runtime_error("cannot open file '" + path + "'");
+  std::stringstream text_stream;
+  text_stream << f.rdbuf();
+  const std::string text = text_stream.str();
+  std::istringstream in(text);
+
+  std::vector<std::string> names;
+  Rcpp::List holder;
+  std::vector<std::streamoff> begins;
+  std::vector<bool> one_dim;
+  try {
+    stan::io::dump_reader reader(in);
+    for (;;) {
+      std::streamoff begin = in.tellg();
+      if (!reader.next()) break;
+      std::vector<size_t> dims = reader.dims();
+      Rcpp::RObject x;
+      if (reader.is_int()) {
+        std::vector<int> v = reader.int_values();
+        if (v.empty()) x = Rcpp::IntegerVector(0);
+        else x = Rcpp::NumericVector(v.begin(), v.end());
+      } else {
+        std::vector<double> v = reader.double_values();
+        x = Rcpp::NumericVector(v.begin(), v.end());
+      }
+      if (dims.size() > 1)
+        x.attr("dim") = Rcpp::IntegerVector(dims.begin(), dims.end());
+      names.push_back(reader.name());
+      holder.push_back(x);
+      begins.push_back(begin);
+      one_dim.push_back(dims.size() == 1);
+    }
+  } catch (const std::exception& e) {
+    return R_NilValue;
+  }
+  in >> std::ws;
+  if (!in.eof()) return R_NilValue;
+  for (size_t k = 0; k < names.size(); k++) {
+    if (!one_dim[k]
+        || !is_structure(text, begins[k],
+                         k + 1 < begins.size() ? begins[k + 1] : -1,
+                         names[k]))
+      continue;
+    Rcpp::RObject x = holder[k];
+    x.attr("dim") = Rcpp::IntegerVector::create(static_cast<int>(Rf_xlength(x)));
+  }
+  holder.attr("names") = names;
+  return holder;
+  END_RCPP
+}
+
+/**
+ * Write the numeric vectors of the named list values in the R dump
+ * format, to file (appending to it if append is TRUE) or, if file is
+ * NULL, to the returned string. A vector with a dim attribute is
+ * written as structure(c(...), .Dim = c(...)). Lines are broken after
+ * commas to be at most width characters where possible.
+ */
+SEXP CPP_write_rdump(SEXP file, SEXP values_, SEXP append, SEXP width_) {
+  BEGIN_RCPP
+  Rcpp::List values(values_);
+  size_t width = static_cast<size_t>(std::max(1, Rcpp::as<int>(width_)));
+  // an empty list has no names (and makes an empty file)
+  std::vector<std::string> names;
+  if (values.size() > 0)
+    names = Rcpp::as<std::vector<std::string> >(values.names());
+
+  std::FILE* f = 0;
+  std::string path;
+  if (!Rf_isNull(file)) {
+    path = Rcpp::as<std::string>(file);
+    f = std::fopen(path.c_str(), Rcpp::as<bool>(append) ? "ab" : "wb");
+    if (!f)
+      throw std::runtime_error("cannot open file '" + path + "'");
+  }
+  std::string out;
+  bool failed = false;
+  auto flush = [&]() {
+    if (!f) return;
+    if (std::fwrite(out.data(), 1, out.size(), f) != out.size())
+      failed = true;
+    out.clear();
+  };
+
+  for (R_xlen_t k = 0; k < values.size(); k++) {
+    SEXP x = values[k];
+    if (TYPEOF(x) != REALSXP && TYPEOF(x) != INTSXP) continue;
+    R_xlen_t n = XLENGTH(x);
+    SEXP dim = Rf_getAttrib(x, R_DimSymbol);
+    const std::string& name = names[k];
+    size_t col = 0;
+    if (Rf_isNull(dim)) {
+      if (n == 0) {
+        out += name + " <- integer(0)\n";
+        continue;
+      }
+      if (n == 1) {
+        out += name + " <- ";
+        if (TYPEOF(x) == INTSXP) append_number(out, INTEGER(x)[0]);
+        else append_number(out, REAL(x)[0]);
+        out += "\n";
+        continue;
+      }
+      out += name + " <- \n";
+      if (TYPEOF(x) == INTSXP) append_values(out, col, INTEGER(x), n, width, flush);
+      else append_values(out, col, REAL(x), n, width, flush);
+      out += "\n";
+    } else {
+      out += name + " <- \nstructure(";
+      col = 10;
+      if (n == 0) out += "integer(0)";
+      else if (TYPEOF(x) == INTSXP) append_values(out, col, INTEGER(x), n, width, flush);
+      else append_values(out, col, REAL(x), n, width, flush);
+      out += ",\n.Dim = ";
+      col = 7;
+      Rcpp::IntegerVector d(dim);
+      append_values(out, col, d.begin(), d.size(), width, flush);
+      out += ")\n";
+    }
+    if (out.size() >= rdump_chunk_size) flush();
+  }
+  if (!f) return Rcpp::wrap(out);
+  flush();
+  if (std::fclose(f) != 0 || failed)
+    throw std::runtime_error("failed to write '" + path + "'");
+  return R_NilValue;
+  END_RCPP
+}
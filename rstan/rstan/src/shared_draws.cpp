@@ -0,0 +1,114 @@
+// This file is part of RStan
+// Copyright (C) 2012, 2013, 2014, 2015, 2016, 2017 Trustees of Columbia University
+//
+// RStan is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 3
+// of the License, or (at your option) any later version.
+//
+// RStan is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+/*
+ * An anonymous shared memory region used to hand the draws of chains
+ * run in forked processes (parallel::mclapply) back to the parent.
+ * The parent allocates the region before forking; the children write
+ * their draws into it and the parent reads them out, so the draws are
+ * not serialized through the pipes of mclapply. The parent keeps the
+ * region as the native store of the draws.
+ */
+
+#include <R.h>
+#include <Rinternals.h>
+#include <cstring>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern SEXP CPP_shared_draws_alloc(SEXP n);
+extern SEXP CPP_shared_draws_write(SEXP shm, SEXP offset, SEXP x);
+extern SEXP CPP_shared_draws_read(SEXP shm, SEXP offset, SEXP n);
+
+#ifdef __cplusplus
+}
+#endif
+
+SEXP make_draws_view(SEXP store, double offset, R_xlen_t n);
+
+/*
+ * The number of doubles in the region is kept in the protected
+ * slot of the external pointer.
+ */
+static R_xlen_t shared_draws_size(SEXP shm) {
+  if (TYPEOF(shm) != EXTPTRSXP || R_ExternalPtrAddr(shm) == NULL)
+    Rf_error("invalid shared draws region");
+  return static_cast<R_xlen_t>(REAL(R_ExternalPtrProtected(shm))[0]);
+}
+
+static void check_range(SEXP shm, double offset, R_xlen_t n) {
+  R_xlen_t size = shared_draws_size(shm);
+  if (offset < 0 || offset + n > size)
+    Rf_error("out of range access to shared draws region");
+}
+
+#ifndef _WIN32
+static void shared_draws_finalize(SEXP shm) {
+  void* p = R_ExternalPtrAddr(shm);
+  if (p == NULL) return;
+  munmap(p, shared_draws_size(shm) * sizeof(double));
+  R_ClearExternalPtr(shm);
+}
+#endif
+
+SEXP CPP_shared_draws_alloc(SEXP n) {
+#ifdef _WIN32
+  Rf_error("shared draws regions are not supported on Windows");
+  return R_NilValue;
+#else
+  double size = Rf_asReal(n);
+  if (!(size > 0))
+    Rf_error("the size of the shared draws region must be positive");
+  void* p = mmap(NULL, static_cast<size_t>(size) * sizeof(double),
+                 PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED)
+    Rf_error("failed to allocate the shared draws region");
+  SEXP prot = PROTECT(Rf_ScalarReal(size));
+  SEXP shm = PROTECT(R_MakeExternalPtr(p, R_NilValue, prot));
+  R_RegisterCFinalizerEx(shm, shared_draws_finalize, TRUE);
+  UNPROTECT(2);
+  return shm;
+#endif
+}
+
+SEXP CPP_shared_draws_write(SEXP shm, SEXP offset, SEXP x) {
+  double off = Rf_asReal(offset);
+  PROTECT(x = Rf_coerceVector(x, REALSXP));
+  check_range(shm, off, XLENGTH(x));
+  double* p = static_cast<double*>(R_ExternalPtrAddr(shm));
+  std::memcpy(p + static_cast<R_xlen_t>(off), REAL(x),
+              XLENGTH(x) * sizeof(double));
+  UNPROTECT(1);
+  return R_NilValue;
+}
+
+/*
+ * The values are not copied: the result is a view on the region (see
+ * draws_altrep.cpp) that keeps the region alive.
+ */
+SEXP CPP_shared_draws_read(SEXP shm, SEXP offset, SEXP n) {
+  double off = Rf_asReal(offset);
+  R_xlen_t len = static_cast<R_xlen_t>(Rf_asReal(n));
+  check_range(shm, off, len);
+  return make_draws_view(shm, off, len);
+}
@@ -19,6 +19,15 @@
 #include <rstan/io/rlist_ref_var_context.hpp>
 #include <rstan/io/r_ostream.hpp>
 #include <rstan/stan_args.hpp>
+#include <rstan/filtered_model.hpp>
+#include <rstan/parallel_gqs.hpp>
+#include <rstan/parallel_init.hpp>
+#include <rstan/parallel_fixed_param.hpp>
+#include <rstan/adaptive_warmup.hpp>
+#include <rstan/lowrank_e_nuts.hpp>
+#include <rstan/parallel_tempering.hpp>
+#include <rstan/rwm.hpp>
+#include <rstan/int_columns.hpp>
 #include <rstan/filtered_values.hpp>
 #include <rstan/sum_values.hpp>
 #include <rstan/value.hpp>
@@ -65,6 +74,8 @@
 #include <stan/services/sample/hmc_static_unit_e.hpp>
 #include <stan/services/sample/hmc_static_unit_e_adapt.hpp>
 #include <stan/services/sample/standalone_gqs.hpp>
+#include <stan/services/util/create_unit_e_dense_inv_metric.hpp>
+#include <stan/services/util/create_unit_e_diag_inv_metric.hpp>
 
 namespace rstan {
 
@@ -361,6 +372,67 @@ std::vector<std::vector<unsigned int> > get_param_dims(stan::model::model_base*
   return uintdims;
 }
 
+/**
+ * The initial inverse metric of NUTS and PT: control$inv_metric or the
+ * unit metric. The returned context may refer to
+ * <code>inv_metric_lst</code>, which must outlive it.
+ */
+std::unique_ptr<stan::io::var_context>
+initial_inv_metric(stan_args& args, size_t num_params,
+                   Rcpp::List& inv_metric_lst) {
+  std::unique_ptr<stan::io::var_context> inv_metric_ptr;
+  if (args.get_ctrl_sampling_inv_metric() != R_NilValue) {
+    inv_metric_lst = Rcpp::List::create(
+      Rcpp::Named("inv_metric") = args.get_ctrl_sampling_inv_metric());
+    inv_metric_ptr.reset(new io::rlist_ref_var_context(inv_metric_lst));
+  } else if (args.get_ctrl_sampling_metric() == DENSE_E) {
+    inv_metric_ptr.reset(new stan::io::dump(
+      stan::services::util::create_unit_e_dense_inv_metric(num_params)));
+  } else {
+    inv_metric_ptr.reset(new stan::io::dump(
+      stan::services::util::create_unit_e_diag_inv_metric(num_params)));
+  }
+  return inv_metric_ptr;
+}
+
+/**
+ * hmc_nuts_pt with the control arguments of <code>args</code>, so that
+ * the runs with the dense and the diagonal metric only differ in the
+ * sampler.
+ */
+template <template <class, class> class Sampler, class Model>
+int hmc_nuts_pt_args(Model& model, stan_args& args,
+                     const stan::io::var_context& init,
+                     const stan::io::var_context& init_inv_metric,
+                     unsigned int random_seed, unsigned int chain,
+                     double init_radius, int num_warmup, int num_samples,
+                     int num_thin, bool save_warmup, int refresh,
+                     stan::callbacks::interrupt& interrupt,
+                     stan::callbacks::logger& logger,
+                     stan::callbacks::writer& init_writer,
+                     stan::callbacks::writer& sample_writer,
+                     stan::callbacks::writer& diagnostic_writer) {
+  return rstan::hmc_nuts_pt<Sampler>(
+      model, init, init_inv_metric, random_seed, chain, init_radius,
+      num_warmup, num_samples, num_thin, save_warmup, refresh,
+      args.get_ctrl_sampling_stepsize(),
+      args.get_ctrl_sampling_stepsize_jitter(),
+      args.get_ctrl_sampling_max_treedepth(),
+      args.get_ctrl_sampling_adapt_engaged(),
+      args.get_ctrl_sampling_adapt_delta(),
+      args.get_ctrl_sampling_adapt_gamma(),
+      args.get_ctrl_sampling_adapt_kappa(),
+      args.get_ctrl_sampling_adapt_t0(),
+      args.get_ctrl_sampling_adapt_init_buffer(),
+      args.get_ctrl_sampling_adapt_term_buffer(),
+      args.get_ctrl_sampling_adapt_window(),
+      args.get_ctrl_sampling_num_temps(),
+      args.get_ctrl_sampling_beta_min(),
+      args.get_ctrl_sampling_swap_interval(),
+      args.get_ctrl_sampling_adapt_temps(),
+      interrupt, logger, init_writer, sample_writer, diagnostic_writer);
+}
+
 struct R_CheckUserInterrupt_Functor : public stan::callbacks::interrupt {
   void operator()() {
     R_CheckUserInterrupt();
@@ -451,8 +523,16 @@ int command(stan_args& args,
 
   stan::callbacks::stream_writer diagnostic_writer(diagnostic_stream, "# ");
   std::unique_ptr<stan::io::var_context> init_context_ptr;
+  std::vector<double> init_params_r;
   if (args.get_init() == "user")
     init_context_ptr.reset(new io::rlist_ref_var_context(args.get_init_list()));
+  else if (args.get_init() == "random" && args.get_init_threads() > 1
+           && parallel_random_init(*model, args.get_random_seed(),
+                                   args.get_chain_id(), args.get_init_radius(),
+                                   args.get_init_threads(), 100,
+                                   init_params_r))
+    // otherwise the services search for random inits themselves
+    init_context_ptr.reset(make_init_context(*model, base_rng, init_params_r));
   else
     init_context_ptr.reset(new stan::io::empty_var_context());
 
@@ -553,12 +633,23 @@ int command(stan_args& args,
 
   }
   if (args.get_method() == SAMPLING) {
+    // transformed parameters and generated quantities not in qoi_idx
+    // are never computed; with defer_gqs the generated quantities are
+    // left as NaN here and filled in afterwards by stan_fit::parallel_gqs
+    filtered_model<stan::model::model_base>
+      sampling_model(*model, qoi_idx, !args.get_ctrl_sampling_defer_gqs());
+    // the samplers' PRNG must not depend on whether the generated
+    // quantities are computed (Fixed_param only uses it for them)
+    if (args.get_ctrl_sampling_algorithm() != Fixed_param)
+      sampling_model.use_gq_stream(random_seed, id);
     std::vector<std::string> sample_names;
     stan::mcmc::sample::get_sample_param_names(sample_names);
     std::vector<std::string> sampler_names;
 
     std::unique_ptr<rstan_sample_writer> sample_writer_ptr;
     size_t sample_writer_offset;
+    // integer-valued quantities are returned as R integer vectors
+    std::vector<bool> int_cols = model_int_columns(*model);
 
     int num_warmup = args.get_ctrl_sampling_warmup();
     int num_samples = args.get_iter() - num_warmup;
@@ -576,16 +667,30 @@ int command(stan_args& args,
                                                     constrained_param_names.size(),
                                                     num_iter_save,
                                                     num_warmup_save,
-                                                    qoi_idx));
-      return_code
-        = stan::services::sample::fixed_param(*model, *init_context_ptr,
-                                              random_seed, id, init_radius,
-                                              num_samples,
-                                              num_thin,
-                                              refresh,
-                                              interrupt,
-                                              logger, init_writer,
-                                              *sample_writer_ptr, diagnostic_writer);
+                                                    qoi_idx,
+                                                    int_cols));
+      if (args.get_ctrl_sampling_fixed_param_threads() > 1) {
+        return_code
+          = rstan::fixed_param_parallel(sampling_model, *init_context_ptr,
+                                        random_seed, id, init_radius,
+                                        num_samples,
+                                        num_thin,
+                                        refresh,
+                                        args.get_ctrl_sampling_fixed_param_threads(),
+                                        interrupt,
+                                        logger, init_writer,
+                                        *sample_writer_ptr, diagnostic_writer);
+      } else {
+        return_code
+          = stan::services::sample::fixed_param(sampling_model, *init_context_ptr,
+                                                random_seed, id, init_radius,
+                                                num_samples,
+                                                num_thin,
+                                                refresh,
+                                                interrupt,
+                                                logger, init_writer,
+                                                *sample_writer_ptr, diagnostic_writer);
+      }
     } else if (args.get_ctrl_sampling_algorithm() == NUTS) {
       sampler_names.resize(5);
       sampler_names[0] = "stepsize__";
@@ -602,16 +707,22 @@ int command(stan_args& args,
                                                     constrained_param_names.size(),
                                                     num_iter_save,
                                                     num_warmup_save,
-                                                    qoi_idx));
+                                                    qoi_idx,
+                                                    int_cols));
 
       double stepsize = args.get_ctrl_sampling_stepsize();
       double stepsize_jitter = args.get_ctrl_sampling_stepsize_jitter();
       int max_depth = args.get_ctrl_sampling_max_treedepth();
 
+      Rcpp::List inv_metric_lst;
+      std::unique_ptr<stan::io::var_context> inv_metric_ptr
+        = initial_inv_metric(args, model->num_params_r(), inv_metric_lst);
+
       if (args.get_ctrl_sampling_metric() == DENSE_E) {
         if (!args.get_ctrl_sampling_adapt_engaged()) {
           return_code = stan::services::sample
-          ::hmc_nuts_dense_e(*model, *init_context_ptr,
+          ::hmc_nuts_dense_e(sampling_model, *init_context_ptr,
+                             *inv_metric_ptr,
                              random_seed, id, init_radius,
                              num_warmup, num_samples,
                              num_thin, save_warmup, refresh,
@@ -627,21 +738,43 @@ int command(stan_args& args,
           unsigned int term_buffer = args.get_ctrl_sampling_adapt_term_buffer();
           unsigned int window = args.get_ctrl_sampling_adapt_window();
 
-          return_code = stan::services::sample
-            ::hmc_nuts_dense_e_adapt(*model, *init_context_ptr,
-                                     random_seed, id, init_radius,
-                                     num_warmup, num_samples,
-                                     num_thin, save_warmup, refresh,
-                                     stepsize, stepsize_jitter, max_depth,
-                                     delta, gamma, kappa,
-                                     t0, init_buffer, term_buffer, window,
-                                     interrupt, logger, init_writer,
-                                     *sample_writer_ptr, diagnostic_writer);
+          if (args.get_ctrl_sampling_adapt_early_stop()) {
+            return_code = rstan::hmc_nuts_adapt_early_stop<stan::mcmc::adapt_dense_e_nuts>(
+                sampling_model, *init_context_ptr, *inv_metric_ptr,
+                random_seed, id, init_radius,
+                num_warmup, num_samples, num_thin, refresh,
+                stepsize, stepsize_jitter, max_depth, delta, gamma, kappa,
+                t0, init_buffer, term_buffer, window,
+                args.get_ctrl_sampling_adapt_early_stop_tol(),
+                interrupt, logger, init_writer,
+                *sample_writer_ptr, diagnostic_writer);
+          } else if (!args.get_ctrl_sampling_adapt_metric()) {
+            return_code = rstan::hmc_nuts_stepsize_adapt<stan::mcmc::adapt_dense_e_nuts>(
+                sampling_model, *init_context_ptr, *inv_metric_ptr,
+                random_seed, id, init_radius,
+                num_warmup, num_samples, num_thin, save_warmup, refresh,
+                stepsize, stepsize_jitter, max_depth, delta, gamma, kappa,
+                t0, interrupt, logger, init_writer,
+                *sample_writer_ptr, diagnostic_writer);
+          } else {
+            return_code = stan::services::sample
+              ::hmc_nuts_dense_e_adapt(sampling_model, *init_context_ptr,
+                                       *inv_metric_ptr,
+                                       random_seed, id, init_radius,
+                                       num_warmup, num_samples,
+                                       num_thin, save_warmup, refresh,
+                                       stepsize, stepsize_jitter, max_depth,
+                                       delta, gamma, kappa,
+                                       t0, init_buffer, term_buffer, window,
+                                       interrupt, logger, init_writer,
+                                       *sample_writer_ptr, diagnostic_writer);
+          }
         }
       } else if (args.get_ctrl_sampling_metric() == DIAG_E) {
         if (!args.get_ctrl_sampling_adapt_engaged()) {
           return_code = stan::services::sample
-          ::hmc_nuts_diag_e(*model, *init_context_ptr,
+          ::hmc_nuts_diag_e(sampling_model, *init_context_ptr,
+                            *inv_metric_ptr,
                             random_seed, id, init_radius,
                             num_warmup, num_samples,
                             num_thin, save_warmup, refresh,
@@ -657,21 +790,76 @@ int command(stan_args& args,
           unsigned int term_buffer = args.get_ctrl_sampling_adapt_term_buffer();
           unsigned int window = args.get_ctrl_sampling_adapt_window();
 
+          if (args.get_ctrl_sampling_adapt_early_stop()) {
+            return_code = rstan::hmc_nuts_adapt_early_stop<stan::mcmc::adapt_diag_e_nuts>(
+                sampling_model, *init_context_ptr, *inv_metric_ptr,
+                random_seed, id, init_radius,
+                num_warmup, num_samples, num_thin, refresh,
+                stepsize, stepsize_jitter, max_depth, delta, gamma, kappa,
+                t0, init_buffer, term_buffer, window,
+                args.get_ctrl_sampling_adapt_early_stop_tol(),
+                interrupt, logger, init_writer,
+                *sample_writer_ptr, diagnostic_writer);
+          } else if (!args.get_ctrl_sampling_adapt_metric()) {
+            return_code = rstan::hmc_nuts_stepsize_adapt<stan::mcmc::adapt_diag_e_nuts>(
+                sampling_model, *init_context_ptr, *inv_metric_ptr,
+                random_seed, id, init_radius,
+                num_warmup, num_samples, num_thin, save_warmup, refresh,
+                stepsize, stepsize_jitter, max_depth, delta, gamma, kappa,
+                t0, interrupt, logger, init_writer,
+                *sample_writer_ptr, diagnostic_writer);
+          } else {
+            return_code = stan::services::sample
+              ::hmc_nuts_diag_e_adapt(sampling_model, *init_context_ptr,
+                                      *inv_metric_ptr,
+                                      random_seed, id, init_radius,
+                                      num_warmup, num_samples,
+                                      num_thin, save_warmup, refresh,
+                                      stepsize, stepsize_jitter, max_depth,
+                                      delta, gamma, kappa,
+                                      t0, init_buffer, term_buffer, window,
+                                      interrupt, logger, init_writer,
+                                      *sample_writer_ptr, diagnostic_writer);
+          }
+        }
+      } else if (args.get_ctrl_sampling_metric() == LOWRANK_E) {
+        if (!args.get_ctrl_sampling_adapt_engaged()) {
+          // without adaptation there is no low-rank part to use
           return_code = stan::services::sample
-            ::hmc_nuts_diag_e_adapt(*model, *init_context_ptr,
-                                    random_seed, id, init_radius,
-                                    num_warmup, num_samples,
-                                    num_thin, save_warmup, refresh,
-                                    stepsize, stepsize_jitter, max_depth,
-                                    delta, gamma, kappa,
-                                    t0, init_buffer, term_buffer, window,
-                                    interrupt, logger, init_writer,
-                                    *sample_writer_ptr, diagnostic_writer);
+          ::hmc_nuts_diag_e(sampling_model, *init_context_ptr,
+                            *inv_metric_ptr,
+                            random_seed, id, init_radius,
+                            num_warmup, num_samples,
+                            num_thin, save_warmup, refresh,
+                            stepsize, stepsize_jitter, max_depth,
+                            interrupt, logger, init_writer,
+                            *sample_writer_ptr, diagnostic_writer);
+        } else {
+          double delta = args.get_ctrl_sampling_adapt_delta();
+          double gamma = args.get_ctrl_sampling_adapt_gamma();
+          double kappa = args.get_ctrl_sampling_adapt_kappa();
+          double t0 = args.get_ctrl_sampling_adapt_t0();
+          unsigned int init_buffer = args.get_ctrl_sampling_adapt_init_buffer();
+          unsigned int term_buffer = args.get_ctrl_sampling_adapt_term_buffer();
+          unsigned int window = args.get_ctrl_sampling_adapt_window();
+
+          return_code = rstan::hmc_nuts_lowrank_e_adapt(sampling_model,
+                                                        *init_context_ptr,
+                                                        *inv_metric_ptr,
+                                                        random_seed, id, init_radius,
+                                                        num_warmup, num_samples,
+                                                        num_thin, save_warmup, refresh,
+                                                        stepsize, stepsize_jitter, max_depth,
+                                                        delta, gamma, kappa,
+                                                        t0, init_buffer, term_buffer, window,
+                                                        args.get_ctrl_sampling_metric_rank(),
+                                                        interrupt, logger, init_writer,
+                                                        *sample_writer_ptr, diagnostic_writer);
         }
       } else if (args.get_ctrl_sampling_metric() == UNIT_E) {
         if (!args.get_ctrl_sampling_adapt_engaged()) {
           return_code = stan::services::sample
-          ::hmc_nuts_unit_e(*model, *init_context_ptr,
+          ::hmc_nuts_unit_e(sampling_model, *init_context_ptr,
                             random_seed, id, init_radius,
                             num_warmup, num_samples,
                             num_thin, save_warmup, refresh,
@@ -685,7 +873,7 @@ int command(stan_args& args,
           double t0 = args.get_ctrl_sampling_adapt_t0();
 
           return_code = stan::services::sample
-            ::hmc_nuts_unit_e_adapt(*model, *init_context_ptr,
+            ::hmc_nuts_unit_e_adapt(sampling_model, *init_context_ptr,
                                     random_seed, id, init_radius,
                                     num_warmup, num_samples,
                                     num_thin, save_warmup, refresh,
@@ -695,6 +883,72 @@ int command(stan_args& args,
                                     *sample_writer_ptr, diagnostic_writer);
         }
       }
+    } else if (args.get_ctrl_sampling_algorithm() == PT) {
+      sampler_names.resize(5);
+      sampler_names[0] = "stepsize__";
+      sampler_names[1] = "treedepth__";
+      sampler_names[2] = "n_leapfrog__";
+      sampler_names[3] = "divergent__";
+      sampler_names[4] = "energy__";
+      sample_writer_offset = sample_names.size() + sampler_names.size();
+
+      sample_writer_ptr.reset(sample_writer_factory(&sample_stream,
+                                                    comment_stream, "# ",
+                                                    sample_names.size(),
+                                                    sampler_names.size(),
+                                                    constrained_param_names.size(),
+                                                    num_iter_save,
+                                                    num_warmup_save,
+                                                    qoi_idx,
+                                                    int_cols));
+
+      Rcpp::List inv_metric_lst;
+      std::unique_ptr<stan::io::var_context> inv_metric_ptr
+        = initial_inv_metric(args, model->num_params_r(), inv_metric_lst);
+
+      // the replicas run on their own threads and only the untempered
+      // one is written
+      if (args.get_ctrl_sampling_metric() == DENSE_E)
+        return_code = hmc_nuts_pt_args<stan::mcmc::adapt_dense_e_nuts>(
+            sampling_model, args, *init_context_ptr, *inv_metric_ptr,
+            random_seed, id, init_radius, num_warmup, num_samples, num_thin,
+            save_warmup, refresh, interrupt, logger, init_writer,
+            *sample_writer_ptr, diagnostic_writer);
+      else
+        return_code = hmc_nuts_pt_args<stan::mcmc::adapt_diag_e_nuts>(
+            sampling_model, args, *init_context_ptr, *inv_metric_ptr,
+            random_seed, id, init_radius, num_warmup, num_samples, num_thin,
+            save_warmup, refresh, interrupt, logger, init_writer,
+            *sample_writer_ptr, diagnostic_writer);
+    } else if (args.get_ctrl_sampling_algorithm() == Metropolis) {
+      sampler_names.resize(1);
+      sampler_names[0] = "stepsize__";
+      sample_writer_offset = sample_names.size() + sampler_names.size();
+
+      sample_writer_ptr.reset(sample_writer_factory(&sample_stream,
+                                                    comment_stream, "# ",
+                                                    sample_names.size(),
+                                                    sampler_names.size(),
+                                                    constrained_param_names.size(),
+                                                    num_iter_save,
+                                                    num_warmup_save,
+                                                    qoi_idx,
+                                                    int_cols));
+
+      return_code = rstan::rwm(sampling_model, *init_context_ptr,
+                               random_seed, id, init_radius,
+                               num_warmup, num_samples,
+                               num_thin, save_warmup, refresh,
+                               args.get_ctrl_sampling_stepsize(),
+                               args.get_ctrl_sampling_adapt_engaged(),
+                               args.get_ctrl_sampling_adapt_gamma(),
+                               args.get_ctrl_sampling_adapt_kappa(),
+                               args.get_ctrl_sampling_adapt_t0(),
+                               args.get_ctrl_sampling_adapt_init_buffer(),
+                               args.get_ctrl_sampling_adapt_term_buffer(),
+                               args.get_ctrl_sampling_adapt_window(),
+                               interrupt, logger, init_writer,
+                               *sample_writer_ptr, diagnostic_writer);
     } else if (args.get_ctrl_sampling_algorithm() == HMC) {
       sampler_names.resize(3);
       sampler_names[0] = "stepsize__";
@@ -709,7 +963,8 @@ int command(stan_args& args,
                                                     constrained_param_names.size(),
                                                     num_iter_save,
                                                     num_warmup_save,
-                                                    qoi_idx));
+                                                    qoi_idx,
+                                                    int_cols));
 
       double stepsize = args.get_ctrl_sampling_stepsize();
       double stepsize_jitter = args.get_ctrl_sampling_stepsize_jitter();
@@ -718,7 +973,7 @@ int command(stan_args& args,
       if (args.get_ctrl_sampling_metric() == DENSE_E) {
         if (!args.get_ctrl_sampling_adapt_engaged()) {
           return_code = stan::services::sample
-          ::hmc_static_dense_e(*model, *init_context_ptr,
+          ::hmc_static_dense_e(sampling_model, *init_context_ptr,
                                random_seed, id, init_radius,
                                num_warmup, num_samples,
                                num_thin, save_warmup, refresh,
@@ -735,7 +990,7 @@ int command(stan_args& args,
           unsigned int window = args.get_ctrl_sampling_adapt_window();
 
           return_code = stan::services::sample
-            ::hmc_static_dense_e_adapt(*model, *init_context_ptr,
+            ::hmc_static_dense_e_adapt(sampling_model, *init_context_ptr,
                                        random_seed, id, init_radius,
                                        num_warmup, num_samples,
                                        num_thin, save_warmup, refresh,
@@ -749,7 +1004,7 @@ int command(stan_args& args,
       } else if (args.get_ctrl_sampling_metric() == DIAG_E) {
         if (!args.get_ctrl_sampling_adapt_engaged()) {
           return_code = stan::services::sample
-          ::hmc_static_diag_e(*model, *init_context_ptr,
+          ::hmc_static_diag_e(sampling_model, *init_context_ptr,
                               random_seed, id, init_radius,
                               num_warmup, num_samples,
                               num_thin, save_warmup, refresh,
@@ -767,7 +1022,7 @@ int command(stan_args& args,
           unsigned int window = args.get_ctrl_sampling_adapt_window();
 
           return_code = stan::services::sample
-            ::hmc_static_diag_e_adapt(*model, *init_context_ptr,
+            ::hmc_static_diag_e_adapt(sampling_model, *init_context_ptr,
                                       random_seed, id, init_radius,
                                       num_warmup, num_samples,
                                       num_thin, save_warmup, refresh,
@@ -780,7 +1035,7 @@ int command(stan_args& args,
       } else if (args.get_ctrl_sampling_metric() == UNIT_E) {
         if (args.get_ctrl_sampling_adapt_engaged()) {
           return_code = stan::services::sample
-          ::hmc_static_unit_e(*model, *init_context_ptr,
+          ::hmc_static_unit_e(sampling_model, *init_context_ptr,
                               random_seed, id, init_radius,
                               num_warmup, num_samples,
                               num_thin, save_warmup, refresh,
@@ -795,7 +1050,7 @@ int command(stan_args& args,
           double t0 = args.get_ctrl_sampling_adapt_t0();
 
           return_code = stan::services::sample
-            ::hmc_static_unit_e_adapt(*model, *init_context_ptr,
+            ::hmc_static_unit_e_adapt(sampling_model, *init_context_ptr,
                                       random_seed, id, init_radius,
                                       num_warmup, num_samples,
                                       num_thin, save_warmup, refresh,
@@ -1174,12 +1429,14 @@ std::vector<double> stan_fit::unconstrain_pars(Rcpp::List par) {
     int gq_size = all_names.size() - some_names.size();
     std::vector<size_t> gq_idx(gq_size);
     for (int i = 0; i < gq_size; i++) gq_idx[i] = i;
+    std::vector<bool> int_cols = model_int_columns(*model_);
+    int_cols.erase(int_cols.begin(), int_cols.begin() + some_names.size());
     sample_writer_ptr.reset(sample_writer_factory(&sample_stream,
                                                   comment_stream, "# ",
                                                   0, 0,
                                                   gq_size,
                                                   draws.rows(), 0,
-                                                  gq_idx));
+                                                  gq_idx, int_cols));
     
     int ret = stan::services::error_codes::CONFIG;
     ret = stan::services::standalone_generate(*model_, draws,
@@ -1192,6 +1449,29 @@ std::vector<double> stan_fit::unconstrain_pars(Rcpp::List par) {
     return holder;
   }
   
+  /**
+   * Drive the generated quantities in parallel, with a PRNG per draw
+   * 
+   * @param draws A matrix of posterior draws
+   * @param seed An unsigned integer to seed the PRNGs
+   * @param n_threads The number of threads to use
+   * @return A R(cpp) list of realizations from generated quantities
+   */
+  
+  Rcpp::List stan_fit::parallel_gqs(const Eigen::Map<Eigen::MatrixXd> draws, 
+                                    unsigned int seed, int n_threads) {
+    Eigen::MatrixXd gqs;
+    std::vector<std::string> errors;
+    parallel_generate_gqs(*model_, draws, seed, n_threads, gqs, errors);
+    report_gqs_errors(errors, rstan::io::rcerr);
+    std::vector<bool> int_cols = model_int_columns(*model_);
+    int_cols.erase(int_cols.begin(), int_cols.end() - gqs.cols());
+    Rcpp::List holder(gqs.cols());
+    for (int k = 0; k < gqs.cols(); k++)
+      holder[k] = typed_column(gqs.col(k).data(), gqs.rows(), int_cols[k]);
+    return holder;
+  }
+  
   /**
    * Return names (of interest)
    * 
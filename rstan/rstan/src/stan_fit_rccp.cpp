@@ -58,6 +58,11 @@ class stan_fit_proxy : public stan_fit_base {
     return fit_.standalone_gqs(draws, seed);
   }
   
+  Rcpp::List parallel_gqs(const Eigen::Map<Eigen::MatrixXd> draws, 
+                          unsigned int seed, int n_threads) {
+    return fit_.parallel_gqs(draws, seed, n_threads);
+  }
+  
   std::vector<std::string> param_names() const {
     return fit_.param_names();
   }
@@ -98,6 +103,7 @@ RCPP_MODULE(class_stan_fit){
       .method("num_pars_unconstrained", &rstan::stan_fit_proxy::num_pars_unconstrained)
       .method("call_sampler", &rstan::stan_fit_proxy::call_sampler)
       .method("standalone_gqs", &rstan::stan_fit_proxy::standalone_gqs)
+      .method("parallel_gqs", &rstan::stan_fit_proxy::parallel_gqs)
       .method("param_names", &rstan::stan_fit_proxy::param_names)
       .method("param_names_oi", &rstan::stan_fit_proxy::param_names_oi)
       .method("param_oi_tidx", &rstan::stan_fit_proxy::param_oi_tidx)
@@ -0,0 +1,307 @@
+// This file is part of RStan
+// Copyright (C) 2012, 2013, 2014, 2015, 2016, 2017 Trustees of Columbia University
+//
+// RStan is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 3
+// of the License, or (at your option) any later version.
+//
+// RStan is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+/*
+ * Unix domain sockets for stan_serve() and stan_request(). A message
+ * is an 8-byte big-endian length followed by that many bytes (an R
+ * object serialized by the R code). Sockets are passed around as
+ * integer file descriptors. A server only takes connections from
+ * processes of its own user, and its socket can only be opened by that
+ * user.
+ */
+
+#include <R.h>
+#include <Rinternals.h>
+#include <cerrno>
+#include <cstring>
+
+#ifndef _WIN32
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern SEXP unix_socket_listen(SEXP path);
+extern SEXP unix_socket_accept(SEXP fd, SEXP timeout);
+extern SEXP unix_socket_connect(SEXP path);
+extern SEXP unix_socket_read(SEXP fd, SEXP timeout, SEXP max);
+extern SEXP unix_socket_write(SEXP fd, SEXP x);
+extern SEXP unix_socket_close(SEXP fd);
+
+#ifdef __cplusplus
+}
+#endif
+
+#ifdef _WIN32
+
+static SEXP unix_socket_unsupported() {
+  Rf_error("Unix domain sockets are not supported on Windows");
+  return R_NilValue;
+}
+
+SEXP unix_socket_listen(SEXP path) { return unix_socket_unsupported(); }
+SEXP unix_socket_accept(SEXP fd, SEXP timeout) { return unix_socket_unsupported(); }
+SEXP unix_socket_connect(SEXP path) { return unix_socket_unsupported(); }
+SEXP unix_socket_read(SEXP fd, SEXP timeout, SEXP max) {
+  return unix_socket_unsupported();
+}
+SEXP unix_socket_write(SEXP fd, SEXP x) { return unix_socket_unsupported(); }
+SEXP unix_socket_close(SEXP fd) { return unix_socket_unsupported(); }
+
+#else
+
+static void socket_address(SEXP path, struct sockaddr_un* addr) {
+  if (!Rf_isString(path) || Rf_length(path) != 1)
+    Rf_error("the socket path should be a character string");
+  const char* p = Rf_translateCharUTF8(STRING_ELT(path, 0));
+  std::memset(addr, 0, sizeof(*addr));
+  addr->sun_family = AF_UNIX;
+  if (std::strlen(p) >= sizeof(addr->sun_path))
+    Rf_error("the socket path '%s' is too long", p);
+  std::strcpy(addr->sun_path, p);
+}
+
+/*
+ * A peer that has gone away should give an error, not SIGPIPE, where
+ * send() cannot be told so (MSG_NOSIGNAL is missing on macOS).
+ */
+static void no_sigpipe(int fd) {
+#ifdef SO_NOSIGPIPE
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+}
+
+static int as_fd(SEXP fd) {
+  int x = Rf_asInteger(fd);
+  if (x == NA_INTEGER || x < 0)
+    Rf_error("invalid socket");
+  return x;
+}
+
+/*
+ * Read or write exactly n bytes, retrying on interrupted calls.
+ * Return false on end of file or error.
+ */
+static bool read_all(int fd, unsigned char* buf, size_t n) {
+  while (n > 0) {
+    ssize_t k = read(fd, buf, n);
+    if (k < 0 && errno == EINTR) continue;
+    if (k <= 0) return false;
+    buf += k;
+    n -= k;
+  }
+  return true;
+}
+
+static bool write_all(int fd, const unsigned char* buf, size_t n) {
+  while (n > 0) {
+    ssize_t k = send(fd, buf, n, MSG_NOSIGNAL);
+    if (k < 0 && errno == EINTR) continue;
+    if (k <= 0) return false;
+    buf += k;
+    n -= k;
+  }
+  return true;
+}
+
+/*
+ * Whether the process at the other end of a connection runs as the
+ * same user as this one.
+ */
+static bool same_user(int fd) {
+#ifdef SO_PEERCRED
+  struct ucred cred;
+  socklen_t len = sizeof(cred);
+  if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0)
+    return false;
+  return cred.uid == geteuid();
+#else
+  uid_t uid;
+  gid_t gid;
+  if (getpeereid(fd, &uid, &gid) < 0)
+    return false;
+  return uid == geteuid();
+#endif
+}
+
+/*
+ * Listen on path, which only the user can open (0600). A socket left
+ * there by an earlier server of the user is replaced; anything else is
+ * an error rather than removed.
+ */
+SEXP unix_socket_listen(SEXP path) {
+  struct sockaddr_un addr;
+  socket_address(path, &addr);
+  struct stat st;
+  if (lstat(addr.sun_path, &st) == 0) {
+    if (!S_ISSOCK(st.st_mode) || st.st_uid != geteuid())
+      Rf_error("'%s' exists and is not a socket of this user", addr.sun_path);
+    if (unlink(addr.sun_path) < 0)
+      Rf_error("cannot remove '%s': %s", addr.sun_path, std::strerror(errno));
+  }
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0)
+    Rf_error("cannot create socket: %s", std::strerror(errno));
+  // no one else can connect between bind() and chmod()
+  mode_t mask = umask(077);
+  int ok = bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr));
+  umask(mask);
+  if (ok < 0 || chmod(addr.sun_path, 0600) < 0 || listen(fd, 16) < 0) {
+    int err = errno;
+    close(fd);
+    Rf_error("cannot listen on '%s': %s", addr.sun_path, std::strerror(err));
+  }
+  return Rf_ScalarInteger(fd);
+}
+
+/*
+ * Wait at most timeout milliseconds for a connection, so the R loop
+ * can check for interrupts in between; NA if none came. Connections
+ * from other users are closed as if none came.
+ */
+SEXP unix_socket_accept(SEXP fd, SEXP timeout) {
+  int sfd = as_fd(fd);
+  struct pollfd pfd;
+  pfd.fd = sfd;
+  pfd.events = POLLIN;
+  pfd.revents = 0;
+  int ready = poll(&pfd, 1, Rf_asInteger(timeout));
+  if (ready < 0 && errno != EINTR)
+    Rf_error("cannot wait for connections: %s", std::strerror(errno));
+  if (ready <= 0) return Rf_ScalarInteger(NA_INTEGER);
+  int cfd = accept(sfd, NULL, NULL);
+  if (cfd < 0) {
+    if (errno == EINTR || errno == EAGAIN || errno == ECONNABORTED)
+      return Rf_ScalarInteger(NA_INTEGER);
+    Rf_error("cannot accept connection: %s", std::strerror(errno));
+  }
+  if (!same_user(cfd)) {
+    close(cfd);
+    return Rf_ScalarInteger(NA_INTEGER);
+  }
+  no_sigpipe(cfd);
+  return Rf_ScalarInteger(cfd);
+}
+
+SEXP unix_socket_connect(SEXP path) {
+  struct sockaddr_un addr;
+  socket_address(path, &addr);
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0)
+    Rf_error("cannot create socket: %s", std::strerror(errno));
+  if (connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0) {
+    int err = errno;
+    close(fd);
+    Rf_error("cannot connect to '%s': %s", addr.sun_path, std::strerror(err));
+  }
+  no_sigpipe(fd);
+  return Rf_ScalarInteger(fd);
+}
+
+/*
+ * Give up on a read after timeout seconds without data (SO_RCVTIMEO),
+ * so that a client that connects and sends nothing cannot hold up the
+ * server; NA or a value that is not positive waits indefinitely.
+ */
+static void set_read_timeout(int fd, SEXP timeout) {
+  double t = Rf_asReal(timeout);
+  struct timeval tv;
+  tv.tv_sec = 0;
+  tv.tv_usec = 0;
+  if (!ISNAN(t) && t > 0) {
+    tv.tv_sec = static_cast<time_t>(t);
+    tv.tv_usec = static_cast<suseconds_t>((t - tv.tv_sec) * 1e6);
+    if (tv.tv_sec == 0 && tv.tv_usec == 0) tv.tv_usec = 1;
+  }
+  if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0)
+    Rf_error("cannot set the socket timeout: %s", std::strerror(errno));
+}
+
+static void read_failed(const char* what) {
+  if (errno == EAGAIN || errno == EWOULDBLOCK)
+    Rf_error("timed out waiting for %s", what);
+}
+
+/*
+ * One message as a raw vector, or NULL if the peer closed the
+ * connection first. An error if no data came for timeout seconds, or
+ * if the message is longer than max bytes (NA for no limit), before
+ * anything is allocated for it.
+ */
+SEXP unix_socket_read(SEXP fd, SEXP timeout, SEXP max) {
+  int cfd = as_fd(fd);
+  set_read_timeout(cfd, timeout);
+  unsigned char header[8];
+  errno = 0;
+  if (!read_all(cfd, header, 8)) {
+    read_failed("a message");
+    return R_NilValue;
+  }
+  double n = 0;
+  for (int i = 0; i < 8; i++)
+    n = n * 256 + header[i];
+  double max_n = Rf_asReal(max);
+  if (!ISNAN(max_n) && n > max_n)
+    Rf_error("a message of %.0f bytes is longer than the limit of %.0f bytes",
+             n, max_n);
+  if (n > R_XLEN_T_MAX)
+    Rf_error("message too long");
+  SEXP x = PROTECT(Rf_allocVector(RAWSXP, static_cast<R_xlen_t>(n)));
+  errno = 0;
+  bool ok = read_all(cfd, RAW(x), static_cast<size_t>(n));
+  UNPROTECT(1);
+  if (!ok) {
+    read_failed("the rest of a message");
+    Rf_error("connection closed in the middle of a message");
+  }
+  return x;
+}
+
+SEXP unix_socket_write(SEXP fd, SEXP x) {
+  int cfd = as_fd(fd);
+  if (TYPEOF(x) != RAWSXP)
+    Rf_error("a message should be a raw vector");
+  unsigned long long n = XLENGTH(x);
+  unsigned char header[8];
+  for (int i = 7; i >= 0; i--) {
+    header[i] = static_cast<unsigned char>(n & 0xff);
+    n >>= 8;
+  }
+  if (!write_all(cfd, header, 8) || !write_all(cfd, RAW(x), XLENGTH(x)))
+    Rf_error("cannot write to socket: %s", std::strerror(errno));
+  return R_NilValue;
+}
+
+SEXP unix_socket_close(SEXP fd) {
+  close(as_fd(fd));
+  return R_NilValue;
+}
+
+#endif
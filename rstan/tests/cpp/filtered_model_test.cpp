@@ -0,0 +1,72 @@
+#include <gtest/gtest.h>
+#include <rstan/filtered_model.hpp>
+#include <boost/random/mixmax.hpp>
+#include <cmath>
+#include <string>
+#include <vector>
+
+// one parameter, one transformed parameter and one generated quantity
+// drawn with the PRNG, as an _rng call would
+class mock_model {
+public:
+  void constrained_param_names(std::vector<std::string>& names,
+                               bool include_tparams = true,
+                               bool include_gqs = true) const {
+    names.assign(1, "a");
+    if (include_tparams) names.push_back("b");
+    if (include_gqs) names.push_back("y_rep");
+  }
+
+  template <typename RNG>
+  void write_array(RNG& rng, std::vector<double>& params_r,
+                   std::vector<int>& params_i, std::vector<double>& vars,
+                   bool include_tparams = true, bool include_gqs = true,
+                   std::ostream* msgs = 0) const {
+    vars.assign(1, params_r[0]);
+    if (include_tparams) vars.push_back(2 * params_r[0]);
+    if (include_gqs) vars.push_back(static_cast<double>(rng() % 1000));
+  }
+};
+
+TEST(RStan, filtered_model_pads_skipped_blocks) {
+  mock_model model;
+  rstan::filtered_model<mock_model> filtered(model, false, false);
+  boost::random::mixmax rng(1, 1, 0, 0);
+  std::vector<double> params_r(1, 1.5), vars;
+  std::vector<int> params_i;
+  filtered.write_array(rng, params_r, params_i, vars);
+  ASSERT_EQ(3U, vars.size());
+  EXPECT_FLOAT_EQ(1.5, vars[0]);
+  EXPECT_TRUE(std::isnan(vars[1]));
+  EXPECT_TRUE(std::isnan(vars[2]));
+}
+
+TEST(RStan, filtered_model_gq_stream_leaves_sampler_rng) {
+  mock_model model;
+  rstan::filtered_model<mock_model> all(model, true, true);
+  rstan::filtered_model<mock_model> no_gqs(model, true, false);
+  all.use_gq_stream(123, 2);
+  no_gqs.use_gq_stream(123, 2);
+  boost::random::mixmax rng1(123, 2, 0, 0);
+  boost::random::mixmax rng2(123, 2, 0, 0);
+  std::vector<double> params_r(1, 0.5), vars1, vars2;
+  std::vector<int> params_i;
+  for (int n = 0; n < 5; n++) {
+    all.write_array(rng1, params_r, params_i, vars1);
+    no_gqs.write_array(rng2, params_r, params_i, vars2);
+    EXPECT_FALSE(std::isnan(vars1[2]));
+    EXPECT_TRUE(std::isnan(vars2[2]));
+  }
+  // the sampler's PRNG is where it was, whether or not the generated
+  // quantities were computed
+  EXPECT_EQ(rng1(), rng2());
+
+  // the generated quantities are the same for the same (seed, chain)
+  rstan::filtered_model<mock_model> again(model, true, true);
+  again.use_gq_stream(123, 2);
+  std::vector<double> vars3;
+  again.write_array(rng2, params_r, params_i, vars3);
+  all.use_gq_stream(123, 2);
+  all.write_array(rng1, params_r, params_i, vars1);
+  EXPECT_FLOAT_EQ(vars1[2], vars3[2]);
+}
@@ -0,0 +1,70 @@
+#include <gtest/gtest.h>
+#include <rstan/int_columns.hpp>
+#include <string>
+#include <vector>
+
+// as returned by get_constrained_sizedtypes() of a model generated by stanc
+const char* sizedtypes =
+  "[{\"name\":\"mu\",\"type\":{\"name\":\"real\"},"
+  "\"block\":\"parameters\"},"
+  " {\"name\":\"n\",\"type\":{\"name\":\"int\"},"
+  "\"block\":\"generated_quantities\"},"
+  " {\"name\":\"y_rep\",\"type\":{\"name\":\"array\",\"length\":2,"
+  "\"element_type\":{\"name\":\"array\",\"length\":2,"
+  "\"element_type\":{\"name\":\"int\"}}},"
+  "\"block\":\"generated_quantities\"},"
+  " {\"name\":\"v\",\"type\":{\"name\":\"array\",\"length\":2,"
+  "\"element_type\":{\"name\":\"vector\",\"length\":3}},"
+  "\"block\":\"generated_quantities\"},"
+  " {\"name\":\"t\",\"type\":{\"name\":\"tuple\",\"element_types\":"
+  "[{\"name\":\"int\"},{\"name\":\"int\"}]},"
+  "\"block\":\"generated_quantities\"},"
+  " {\"name\":\"s\\\"q\",\"type\":{\"name\":\"int\"},"
+  "\"block\":\"generated_quantities\"}]";
+
+class RStan : public ::testing::Test {
+public:
+  RStan() {}
+};
+
+TEST_F(RStan, int_columns_from_sizedtypes) {
+  std::vector<std::string> names;
+  names.push_back("mu");
+  names.push_back("n");
+  names.push_back("y_rep.1.1");
+  names.push_back("y_rep.2.1");
+  names.push_back("y_rep[1,2]");
+  names.push_back("v.1.3");
+  names.push_back("t.1");
+  names.push_back("s\"q");
+  names.push_back("nn");
+  std::vector<bool> is_int = rstan::int_columns(sizedtypes, names);
+  ASSERT_EQ(names.size(), is_int.size());
+  EXPECT_FALSE(is_int[0]);
+  EXPECT_TRUE(is_int[1]);
+  EXPECT_TRUE(is_int[2]);
+  EXPECT_TRUE(is_int[3]);
+  EXPECT_TRUE(is_int[4]);
+  EXPECT_FALSE(is_int[5]);
+  // tuples are left as reals
+  EXPECT_FALSE(is_int[6]);
+  // escaped quotes in strings
+  EXPECT_TRUE(is_int[7]);
+  // not a variable, only a prefix of one
+  EXPECT_FALSE(is_int[8]);
+}
+
+TEST_F(RStan, int_columns_empty_and_invalid_json) {
+  std::vector<std::string> names(2, "n");
+  std::vector<bool> all_real(2, false);
+  EXPECT_EQ(all_real, rstan::int_columns("[]", names));
+  EXPECT_EQ(all_real, rstan::int_columns("", names));
+  EXPECT_EQ(all_real, rstan::int_columns("{\"name\":\"n\"}", names));
+  EXPECT_EQ(all_real,
+            rstan::int_columns("[{\"name\":\"n\",\"type\":{\"name\":\"int\"}",
+                               names));
+  EXPECT_EQ(all_real,
+            rstan::int_columns("[{\"name\":\"n\" \"type\":{}}]", names));
+  EXPECT_TRUE(rstan::int_columns("[{\"name\":\"n\",\"type\":{\"name\":\"int\"}}]",
+                                 std::vector<std::string>()).empty());
+}
@@ -0,0 +1,141 @@
+#include <gtest/gtest.h>
+#include <rstan/lowrank_e_nuts.hpp>
+#include <Eigen/Dense>
+#include <cmath>
+#include <vector>
+
+// exposes the window's draws and the estimate of the metric
+class lowrank_adaptation_probe : public rstan::windowed_lowrank_adaptation {
+public:
+  lowrank_adaptation_probe(int n, int rank)
+    : rstan::windowed_lowrank_adaptation(n, rank) {}
+
+  void add_draw(const Eigen::VectorXd& q) { draws_.push_back(q); }
+
+  void estimate_metric(Eigen::VectorXd& inv_e_metric,
+                       Eigen::MatrixXd& low_rank) {
+    estimate(inv_e_metric, low_rank);
+  }
+};
+
+// correlated draws with unequal scales, the same for every run
+Eigen::MatrixXd correlated_draws(int n, int d) {
+  Eigen::MatrixXd z(n, d);
+  for (int i = 0; i < n; ++i)
+    for (int j = 0; j < d; ++j)
+      z(i, j) = std::sin(1.7 * (i + 1) * (j + 1) + 0.3 * j) + 0.1 * std::cos(i);
+  Eigen::MatrixXd mix = Eigen::MatrixXd::Identity(d, d);
+  for (int j = 1; j < d; ++j)
+    mix(j, 0) = 0.9;
+  Eigen::VectorXd scale(d);
+  for (int j = 0; j < d; ++j)
+    scale(j) = 0.5 + j;
+  return (z * mix.transpose()) * scale.asDiagonal();
+}
+
+// diag(S) + U U^T computed with the D x D correlation matrix
+Eigen::MatrixXd dense_estimate(const Eigen::MatrixXd& draws, int rank) {
+  const int n = draws.rows();
+  const int d = draws.cols();
+  Eigen::MatrixXd y = draws.rowwise() - draws.colwise().mean();
+  Eigen::VectorXd var = y.colwise().squaredNorm().transpose() / (n - 1.0);
+  Eigen::VectorXd sd = var.cwiseSqrt();
+  Eigen::MatrixXd corr = (y.transpose() * y) / (n - 1.0);
+  corr = sd.cwiseInverse().asDiagonal() * corr * sd.cwiseInverse().asDiagonal();
+  Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> es(corr);
+
+  const double w = n / (n + 5.0);
+  Eigen::MatrixXd inv_metric = Eigen::MatrixXd::Zero(d, d);
+  inv_metric.diagonal() = w * var
+                          + 1e-3 * (5.0 / (n + 5.0)) * Eigen::VectorXd::Ones(d);
+  for (int k = 0; k < rank; ++k) {
+    int i = d - 1 - k;
+    if (es.eigenvalues()(i) <= 1 + 1e-8) break;
+    Eigen::VectorXd u = sd.cwiseProduct(es.eigenvectors().col(i));
+    inv_metric += w * (es.eigenvalues()(i) - 1) * u * u.transpose();
+  }
+  return inv_metric;
+}
+
+Eigen::MatrixXd lowrank_estimate(const Eigen::MatrixXd& draws, int rank) {
+  lowrank_adaptation_probe adaptation(draws.cols(), rank);
+  for (int i = 0; i < draws.rows(); ++i)
+    adaptation.add_draw(draws.row(i).transpose());
+  Eigen::VectorXd inv_e_metric;
+  Eigen::MatrixXd low_rank;
+  adaptation.estimate_metric(inv_e_metric, low_rank);
+  EXPECT_LE(low_rank.cols(), rank);
+  Eigen::MatrixXd inv_metric = low_rank * low_rank.transpose();
+  inv_metric.diagonal() += inv_e_metric;
+  return inv_metric;
+}
+
+class RStan : public ::testing::Test {
+public:
+  RStan() {}
+};
+
+TEST_F(RStan, lowrank_e_point_products) {
+  const int d = 6;
+  rstan::lowrank_e_point z(d);
+  Eigen::VectorXd diag(d);
+  Eigen::MatrixXd u(d, 2);
+  for (int i = 0; i < d; ++i) {
+    diag(i) = 0.5 + 0.25 * i;
+    u(i, 0) = std::cos(i + 1.0);
+    u(i, 1) = 0.3 * std::sin(2.0 * i);
+  }
+  Eigen::VectorXd x(d);
+  for (int i = 0; i < d; ++i)
+    x(i) = 1.0 - 0.4 * i;
+
+  z.set_metric(diag, u);
+  Eigen::MatrixXd inv_metric = u * u.transpose();
+  inv_metric.diagonal() += diag;
+  Eigen::VectorXd expected = inv_metric * x;
+  EXPECT_TRUE(z.inv_metric_times(x).isApprox(expected, 1e-12));
+  expected = inv_metric.ldlt().solve(x);
+  EXPECT_TRUE(z.metric_times(x).isApprox(expected, 1e-10));
+  EXPECT_TRUE(z.metric_times(z.inv_metric_times(x)).isApprox(x, 1e-10));
+
+  z.set_metric(diag);
+  EXPECT_EQ(0, z.low_rank_.cols());
+  EXPECT_TRUE(z.inv_metric_times(x).isApprox(diag.cwiseProduct(x), 1e-12));
+  EXPECT_TRUE(z.metric_times(x).isApprox(x.cwiseQuotient(diag), 1e-12));
+}
+
+TEST_F(RStan, windowed_lowrank_adaptation_matches_dense_estimate) {
+  // more draws than parameters: eigenvectors of the correlation matrix
+  Eigen::MatrixXd draws = correlated_draws(40, 5);
+  EXPECT_TRUE(lowrank_estimate(draws, 5).isApprox(dense_estimate(draws, 5),
+                                                  1e-8));
+  EXPECT_TRUE(lowrank_estimate(draws, 1).isApprox(dense_estimate(draws, 1),
+                                                  1e-8));
+
+  // fewer draws than parameters: through the Gram matrix of the draws
+  draws = correlated_draws(6, 12);
+  EXPECT_TRUE(lowrank_estimate(draws, 10).isApprox(dense_estimate(draws, 10),
+                                                   1e-8));
+  EXPECT_TRUE(lowrank_estimate(draws, 2).isApprox(dense_estimate(draws, 2),
+                                                  1e-8));
+}
+
+TEST_F(RStan, windowed_lowrank_adaptation_uncorrelated_draws) {
+  // independent columns have no eigenvalue of the correlation matrix
+  // above 1 to keep, so the metric is diagonal
+  Eigen::MatrixXd draws = Eigen::MatrixXd::Zero(4, 2);
+  draws << 1, 1,
+           -1, 1,
+           1, -1,
+           -1, -1;
+  lowrank_adaptation_probe adaptation(2, 2);
+  for (int i = 0; i < draws.rows(); ++i)
+    adaptation.add_draw(draws.row(i).transpose());
+  Eigen::VectorXd inv_e_metric;
+  Eigen::MatrixXd low_rank;
+  adaptation.estimate_metric(inv_e_metric, low_rank);
+  EXPECT_EQ(0, low_rank.cols());
+  const double w = 4 / 9.0;
+  EXPECT_NEAR(w * 4 / 3.0 + 1e-3 * 5 / 9.0, inv_e_metric(0), 1e-12);
+  EXPECT_NEAR(w * 4 / 3.0 + 1e-3 * 5 / 9.0, inv_e_metric(1), 1e-12);
+}
@@ -0,0 +1,83 @@
+#include <gtest/gtest.h>
+#include <rstan/parallel_tempering.hpp>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+class RStan : public ::testing::Test {
+public:
+  RStan() {}
+};
+
+TEST_F(RStan, pt_swap_acceptance) {
+  // the ratio pi(x_{k+1})^b_k pi(x_k)^b_{k+1} / (pi(x_k)^b_k pi(x_{k+1})^b_{k+1})
+  double beta_k = 1, beta_k1 = 0.25, lp_k = -3, lp_k1 = -5;
+  double expected = std::exp(beta_k * lp_k1 + beta_k1 * lp_k
+                             - beta_k * lp_k - beta_k1 * lp_k1);
+  EXPECT_FLOAT_EQ(expected,
+                  rstan::swap_acceptance(beta_k, beta_k1, lp_k, lp_k1));
+  EXPECT_FLOAT_EQ(std::exp(-1.5), rstan::swap_acceptance(1, 0.25, -3, -5));
+
+  // moving the better state to the colder replica is always accepted
+  EXPECT_EQ(1, rstan::swap_acceptance(1, 0.25, -5, -3));
+  EXPECT_EQ(1, rstan::swap_acceptance(0.5, 0.5, -5, -3));
+
+  double inf = std::numeric_limits<double>::infinity();
+  EXPECT_EQ(0, rstan::swap_acceptance(1, 0.25, -3, -inf));
+  EXPECT_EQ(0, rstan::swap_acceptance(1, 0.25, -inf, -inf));
+  EXPECT_EQ(0, rstan::swap_acceptance(1, 0.25, -3,
+                                      std::numeric_limits<double>::quiet_NaN()));
+}
+
+TEST_F(RStan, pt_equalize_ladder) {
+  std::vector<double> betas(4);
+  for (int k = 0; k < 4; k++)
+    betas[k] = std::pow(0.01, k / 3.0);
+
+  // equal rejection rates leave the ladder as it is
+  std::vector<double> ladder(betas);
+  rstan::equalize_ladder(ladder, std::vector<double>(3, 0.4));
+  for (int k = 0; k < 4; k++)
+    EXPECT_NEAR(betas[k], ladder[k], 1e-12);
+
+  // no rejection at all leaves it as well
+  ladder = betas;
+  rstan::equalize_ladder(ladder, std::vector<double>(3, 0));
+  for (int k = 0; k < 4; k++)
+    EXPECT_EQ(betas[k], ladder[k]);
+
+  // all the rejection between the two coldest replicas: the inner
+  // temperatures move towards 1, the ends stay, the order is kept
+  std::vector<double> rejection(3, 0);
+  rejection[0] = 0.9;
+  ladder = betas;
+  rstan::equalize_ladder(ladder, rejection);
+  EXPECT_EQ(1, ladder[0]);
+  EXPECT_EQ(betas[3], ladder[3]);
+  // the cumulative rejection is linear in log beta on [beta_1, 1], so
+  // the levels 1/3 and 2/3 of it are at a third and two thirds of log beta_1
+  EXPECT_NEAR(std::log(betas[1]) / 3, std::log(ladder[1]), 1e-12);
+  EXPECT_NEAR(2 * std::log(betas[1]) / 3, std::log(ladder[2]), 1e-12);
+  EXPECT_GT(ladder[0], ladder[1]);
+  EXPECT_GT(ladder[1], ladder[2]);
+  EXPECT_GT(ladder[2], ladder[3]);
+
+  // after equalizing, the rejection rates implied by linear
+  // interpolation of the cumulative rejection are the same
+  rejection[0] = 0.1;
+  rejection[1] = 0.2;
+  rejection[2] = 0.6;
+  ladder = betas;
+  rstan::equalize_ladder(ladder, rejection);
+  std::vector<double> cum(4, 0);
+  for (int k = 0; k < 3; k++)
+    cum[k + 1] = cum[k] + rejection[k];
+  for (int j = 1; j < 3; j++) {
+    double x = std::log(ladder[j]);
+    int k = 0;
+    while (x < std::log(betas[k + 1])) k++;
+    double w = (x - std::log(betas[k]))
+               / (std::log(betas[k + 1]) - std::log(betas[k]));
+    EXPECT_NEAR(cum[3] * j / 3, cum[k] + w * rejection[k], 1e-12);
+  }
+}
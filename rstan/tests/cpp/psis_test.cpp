@@ -0,0 +1,75 @@
+#include <gtest/gtest.h>
+#include <rstan/psis.hpp>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+// The expected values were computed for the same inputs by following
+// the code of loo::gpdfit() and loo::psis() (with r_eff = 1, and
+// weights(normalize = TRUE) for the log weights) step by step.
+
+class RStan : public ::testing::Test {
+public:
+  RStan() {}
+};
+
+TEST_F(RStan, gpd_fit_matches_loo) {
+  // the expected order statistics of a generalized Pareto distribution
+  // with k = 0.3 and sigma = 1
+  std::vector<double> x(40);
+  for (size_t i = 0; i < x.size(); i++) {
+    double p = (i + 0.5) / x.size();
+    x[i] = std::expm1(-0.3 * std::log1p(-p)) / 0.3;
+  }
+  double k, sigma;
+  rstan::gpd_fit(x, k, sigma);
+  EXPECT_NEAR(0.363254108578336, k, 1e-10);
+  EXPECT_NEAR(0.961338233749311, sigma, 1e-10);
+
+  // bounded draws have a negative shape
+  for (size_t i = 0; i < x.size(); i++)
+    x[i] = std::exp(0.7 * std::sin(i + 1.0));
+  std::sort(x.begin(), x.end());
+  rstan::gpd_fit(x, k, sigma);
+  EXPECT_NEAR(-0.894454410455486, k, 1e-10);
+  EXPECT_NEAR(2.54006249857262, sigma, 1e-10);
+}
+
+TEST_F(RStan, psis_smooth_matches_loo) {
+  const size_t S = 100;
+  std::vector<double> log_w(S);
+  for (size_t s = 0; s < S; s++)
+    log_w[s] = -0.5 * std::log1p(-(s + 0.5) / S) + 0.1 * std::sin(3.0 * s);
+  double k = rstan::psis_smooth(log_w);
+  EXPECT_NEAR(0.524719708572418, k, 1e-10);
+  EXPECT_NEAR(-5.26284061640667, log_w[0], 1e-10);
+  EXPECT_NEAR(-4.98523577207464, log_w[50], 1e-10);
+  EXPECT_NEAR(-3.17850261661637, log_w[98], 1e-10);
+  EXPECT_NEAR(-2.61702168902755, log_w[99], 1e-10);
+  double sum = 0;
+  for (size_t s = 0; s < S; s++) sum += std::exp(log_w[s]);
+  EXPECT_NEAR(1, sum, 1e-12);
+}
+
+TEST_F(RStan, psis_smooth_too_few_draws) {
+  // 20 draws have a tail of 4, too short to fit
+  const size_t S = rstan::psis_min_draws - 1;
+  std::vector<double> log_w(S);
+  for (size_t s = 0; s < S; s++)
+    log_w[s] = -0.5 * std::log1p(-(s + 0.5) / S);
+  double k = rstan::psis_smooth(log_w);
+  EXPECT_TRUE(std::isnan(k));
+  // only normalized
+  EXPECT_NEAR(-3.60622322102601, log_w[0], 1e-10);
+  EXPECT_NEAR(-1.77444239796119, log_w[S - 1], 1e-10);
+
+  // a fit with one more
+  log_w.assign(S + 1, 0);
+  for (size_t s = 0; s <= S; s++)
+    log_w[s] = -0.5 * std::log1p(-(s + 0.5) / (S + 1));
+  EXPECT_TRUE(std::isfinite(rstan::psis_smooth(log_w)));
+
+  log_w.assign(S, -std::numeric_limits<double>::infinity());
+  EXPECT_TRUE(std::isinf(rstan::psis_smooth(log_w)));
+}
@@ -0,0 +1,97 @@
+#include <gtest/gtest.h>
+#include <rstan/runner_args.hpp>
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// collects what write_as_comment() writes
+class string_writer : public stan::callbacks::writer {
+public:
+  std::vector<std::string> lines;
+
+  void operator()(const std::string& message) { lines.push_back(message); }
+};
+
+class RStan : public ::testing::Test {
+public:
+  RStan() {}
+};
+
+TEST_F(RStan, runner_args_values_and_defaults) {
+  const char* argv[] = {"model", "iter=500", "adapt_delta=0.95",
+                        "save_warmup=FALSE", "data=dir/a=b.data.R",
+                        "seed= 12 "};
+  rstan::runner_args args(6, argv);
+  EXPECT_EQ(500, args.get_int("iter", 2000));
+  EXPECT_DOUBLE_EQ(0.95, args.get_double("adapt_delta", 0.8));
+  EXPECT_FALSE(args.get_bool("save_warmup", true));
+  EXPECT_EQ("dir/a=b.data.R", args.get_string("data", ""));
+  EXPECT_EQ(12u, args.get_uint("seed", 1234));
+
+  EXPECT_EQ(1000, args.get_int("warmup", 1000));
+  EXPECT_EQ("csv", args.get_string("format", "csv"));
+  EXPECT_TRUE(args.get_bool("adapt_engaged", true));
+  EXPECT_NO_THROW(args.check_all_used());
+
+  string_writer writer;
+  args.write_as_comment(writer);
+  ASSERT_EQ(5u, writer.lines.size());
+  EXPECT_EQ("adapt_delta=0.95", writer.lines[0]);
+  EXPECT_EQ("seed= 12 ", writer.lines[4]);
+}
+
+TEST_F(RStan, runner_args_errors) {
+  const char* no_value[] = {"model", "iter"};
+  EXPECT_THROW(rstan::runner_args(2, no_value), std::invalid_argument);
+  const char* no_name[] = {"model", "=500"};
+  EXPECT_THROW(rstan::runner_args(2, no_name), std::invalid_argument);
+
+  const char* argv[] = {"model", "iter=5x", "thin=", "save_warmup=yes",
+                        "adapt_dleta=0.9"};
+  rstan::runner_args args(5, argv);
+  EXPECT_THROW(args.get_int("iter", 2000), std::invalid_argument);
+  EXPECT_THROW(args.get_int("thin", 1), std::invalid_argument);
+  EXPECT_THROW(args.get_bool("save_warmup", true), std::invalid_argument);
+  // the misspelled option is never asked for
+  EXPECT_THROW(args.check_all_used(), std::invalid_argument);
+  args.get_double("adapt_dleta", 0.8);
+  EXPECT_NO_THROW(args.check_all_used());
+}
+
+TEST_F(RStan, binary_writer_layout) {
+  std::ostringstream out;
+  rstan::binary_writer writer(out);
+  std::vector<std::string> names;
+  names.push_back("lp__");
+  names.push_back("theta[1]");
+  writer(names);
+  writer("Adaptation terminated");
+  std::vector<double> draw(2);
+  for (int i = 0; i < 3; ++i) {
+    draw[0] = -1.5 * i;
+    draw[1] = 0.25 + i;
+    writer(draw);
+  }
+  EXPECT_THROW(writer(names), std::logic_error);
+  EXPECT_THROW(writer(std::vector<double>(3)), std::length_error);
+
+  // read back as read_stan_bin() does
+  const std::string s = out.str();
+  ASSERT_EQ(8u + 4 + 5 + 9 + 3 * 2 * 8, s.size());
+  EXPECT_EQ("RSTANBIN", s.substr(0, 8));
+  std::uint32_t num_cols;
+  std::memcpy(&num_cols, s.data() + 8, 4);
+  EXPECT_EQ(2u, num_cols);
+  EXPECT_EQ("lp__", std::string(s.c_str() + 12));
+  EXPECT_EQ("theta[1]", std::string(s.c_str() + 17));
+  const char* p = s.data() + 26;
+  for (int i = 0; i < 3; ++i) {
+    double x[2];
+    std::memcpy(x, p + 16 * i, 16);
+    EXPECT_EQ(-1.5 * i, x[0]);
+    EXPECT_EQ(0.25 + i, x[1]);
+  }
+}
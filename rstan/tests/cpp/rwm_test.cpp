@@ -0,0 +1,97 @@
+#include <gtest/gtest.h>
+#include <rstan/rwm.hpp>
+#include <stan/callbacks/logger.hpp>
+#include <stan/mcmc/sample.hpp>
+#include <boost/random/mixmax.hpp>
+#include <cmath>
+#include <ostream>
+#include <vector>
+
+// a standard normal target in num_params dimensions, with its
+// normalizing constant unless propto
+class normal_model {
+public:
+  explicit normal_model(size_t num_params) : num_params_(num_params) {}
+
+  size_t num_params_r() const {
+    return num_params_;
+  }
+
+  template <bool propto, bool jacobian, typename T>
+  T log_prob(std::vector<T>& params_r, std::vector<int>& params_i,
+             std::ostream* msgs = 0) const {
+    T lp = 0;
+    for (size_t i = 0; i < params_r.size(); ++i)
+      lp -= 0.5 * params_r[i] * params_r[i];
+    if (!propto)
+      lp -= 0.5 * std::log(2 * M_PI) * params_r.size();
+    return lp;
+  }
+
+private:
+  size_t num_params_;
+};
+
+// the mean acceptance probability of sampling after adapting
+double rwm_accept_rate(size_t num_params, unsigned int seed) {
+  normal_model model(num_params);
+  boost::random::mixmax rng(seed, 1, 0, 0);
+  stan::callbacks::logger logger;
+  rstan::adapt_rwm<normal_model, boost::random::mixmax> sampler(model, rng);
+  sampler.set_nominal_stepsize(rstan::rwm_initial_stepsize(1, num_params));
+  sampler.get_stepsize_adaptation().set_mu(
+    std::log(10 * sampler.get_nominal_stepsize()));
+  sampler.get_stepsize_adaptation().set_delta(
+    rstan::rwm_target_accept(num_params));
+  sampler.get_stepsize_adaptation().set_gamma(0.05);
+  sampler.get_stepsize_adaptation().set_kappa(0.75);
+  sampler.get_stepsize_adaptation().set_t0(10);
+  sampler.set_window_params(2000, 75, 50, 25, logger);
+
+  Eigen::VectorXd q = Eigen::VectorXd::Zero(num_params);
+  stan::mcmc::sample s(q, 0, 0);
+  sampler.engage_adaptation();
+  for (int m = 0; m < 2000; ++m)
+    s = sampler.transition(s, logger);
+  sampler.disengage_adaptation();
+  double accept = 0;
+  const int num_samples = 20000;
+  for (int m = 0; m < num_samples; ++m) {
+    s = sampler.transition(s, logger);
+    accept += s.accept_stat();
+  }
+  return accept / num_samples;
+}
+
+class RStan : public ::testing::Test {
+public:
+  RStan() {}
+};
+
+TEST_F(RStan, rwm_initial_scale) {
+  EXPECT_FLOAT_EQ(2.38, rstan::rwm_initial_stepsize(1, 1));
+  EXPECT_FLOAT_EQ(0.5 * 2.38 / 2, rstan::rwm_initial_stepsize(0.5, 4));
+  EXPECT_FLOAT_EQ(0.44, rstan::rwm_target_accept(1));
+  EXPECT_FLOAT_EQ(0.234, rstan::rwm_target_accept(2));
+  EXPECT_FLOAT_EQ(0.234, rstan::rwm_target_accept(50));
+}
+
+TEST_F(RStan, rwm_adapts_scale_to_target_acceptance) {
+  EXPECT_NEAR(0.44, rwm_accept_rate(1, 1234), 0.05);
+  EXPECT_NEAR(0.234, rwm_accept_rate(10, 1234), 0.05);
+}
+
+TEST_F(RStan, rwm_lp_drops_constants) {
+  // lp__ is the log density without its constant terms, as with
+  // the other samplers
+  normal_model model(2);
+  boost::random::mixmax rng(3, 1, 0, 0);
+  stan::callbacks::logger logger;
+  rstan::adapt_rwm<normal_model, boost::random::mixmax> sampler(model, rng);
+  Eigen::VectorXd q(2);
+  q << 1, -2;
+  stan::mcmc::sample s(q, 0, 0);
+  s = sampler.transition(s, logger);
+  Eigen::VectorXd q1 = s.cont_params();
+  EXPECT_NEAR(-0.5 * q1.squaredNorm(), s.log_prob(), 1e-12);
+}